@@ -0,0 +1,76 @@
+#include "bench.hpp"
+#include "aggregate.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+namespace {
+    constexpr size_t iterations = 20;
+    constexpr uint32_t n = 1 << 24;
+
+    bool groups_match(std::span<const GroupAggregate> expected, std::span<const GroupAggregate> actual) {
+        if (expected.size() != actual.size())
+            return false;
+
+        for (size_t i = 0; i < expected.size(); ++i) {
+            const auto& a = expected[i];
+            const auto& b = actual[i];
+            // Sums are accumulated in a different order, so allow some error.
+            if (a.key != b.key || a.count != b.count || a.min != b.min || a.max != b.max
+                || std::abs(a.sum - b.sum) > 1e-3 * std::max(1.f, std::abs(a.sum)))
+                return false;
+        }
+        return true;
+    }
+}
+
+void bench_aggregate(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+
+    auto values = std::vector<float>(n);
+    std::generate(values.begin(), values.end(), [&] { return value_dist(rng); });
+    auto gpu_values = upload_buffer<float>(ctx, values);
+
+    for (uint32_t n_bins : {256u, 4096u, 65536u, 1u << 20}) {
+        auto key_dist = std::uniform_int_distribution<uint32_t>(0, n_bins - 1);
+        auto keys = std::vector<uint32_t>(n);
+        std::generate(keys.begin(), keys.end(), [&] { return key_dist(rng); });
+        auto gpu_keys = upload_buffer<uint32_t>(ctx, keys);
+        auto bins = create_device_buffer(ctx, n_bins * sizeof(uint32_t));
+
+        std::vector<uint32_t> expected;
+        double cpu_time = time_cpu(iterations, [&] {
+            expected = histogram_reference(keys, n_bins);
+        });
+        double gpu_time = time_submissions(ctx, iterations, [&] {
+            histogram(ctx, gpu_keys, n, bins, n_bins);
+        });
+        bool ok = download_buffer<uint32_t>(bins) == expected;
+        fmt::print("histogram {:>8} bins: cpu {:>8.3f} ms, gpu {:>8.3f} ms ({:.2f} Gkeys/s){}\n",
+            n_bins, cpu_time * 1000, gpu_time * 1000, n / gpu_time * 1e-9, ok ? "" : " MISMATCH");
+    }
+
+    for (uint32_t n_groups : {16u, 512u, 65536u, 1u << 22}) {
+        auto key_dist = std::uniform_int_distribution<uint32_t>(0, n_groups - 1);
+        auto keys = std::vector<uint32_t>(n);
+        // Scatter keys over the full range, so that they don't trivially hash to consecutive slots.
+        std::generate(keys.begin(), keys.end(), [&] { return key_dist(rng) * 2654435761u % 0xFFFFFFFF; });
+        auto gpu_keys = upload_buffer<uint32_t>(ctx, keys);
+        auto table = create_group_by_table(ctx, n_groups);
+
+        std::vector<GroupAggregate> expected;
+        double cpu_time = time_cpu(1, [&] {
+            expected = group_by_reference(keys, values);
+        });
+        double gpu_time = time_submissions(ctx, iterations, [&] {
+            group_by(ctx, table, gpu_keys, gpu_values, n);
+        });
+        bool ok = groups_match(expected, read_group_by(table));
+        fmt::print("group-by  {:>8} groups: cpu {:>8.3f} ms, gpu {:>8.3f} ms ({:.2f} Gkeys/s){}\n",
+            n_groups, cpu_time * 1000, gpu_time * 1000, n / gpu_time * 1e-9, ok ? "" : " MISMATCH");
+    }
+}
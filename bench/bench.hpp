@@ -0,0 +1,92 @@
+#ifndef _NIRAH_BENCH_BENCH_HPP
+#define _NIRAH_BENCH_BENCH_HPP
+
+#include "context.hpp"
+
+#include <chrono>
+#include <span>
+#include <vector>
+#include <cstddef>
+
+// Runs `record` (which records into ctx.cmd_buf) once to warm up, and then `iterations` times,
+// each in a separate submission. Returns the average time per submission in seconds.
+template <typename F>
+double time_submissions(Context& ctx, size_t iterations, F record) {
+    ctx.begin();
+    record();
+    ctx.submit();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        ctx.begin();
+        record();
+        ctx.submit();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double>(elapsed).count() / iterations;
+}
+
+template <typename F>
+double time_cpu(size_t iterations, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        f();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double>(elapsed).count() / iterations;
+}
+
+// Returns the largest relative difference between two arrays, treating values with
+// a magnitude below 1 as absolute differences.
+double max_error(std::span<const float> expected, std::span<const float> actual);
+
+struct LatencyStats {
+    double p50;
+    double p99;
+    double max;
+};
+
+// Percentiles of a non-empty set of latencies.
+LatencyStats latency_stats(std::vector<double> latencies);
+
+void bench_spmv(Context& ctx);
+
+void bench_aggregate(Context& ctx);
+
+void bench_hash_table(Context& ctx);
+
+void bench_topk(Context& ctx);
+
+void bench_stencil(Context& ctx);
+
+void bench_random(Context& ctx);
+
+void bench_fft(Context& ctx);
+
+void bench_tensor(Context& ctx);
+
+void bench_csv(Context& ctx);
+
+void bench_columnar(Context& ctx);
+
+void bench_graph(Context& ctx);
+
+void bench_tree_search(Context& ctx);
+
+void bench_suballocator(Context& ctx);
+
+void bench_shadow_buffer(Context& ctx);
+
+void bench_job_graph(Context& ctx);
+
+void bench_upload_cache(Context& ctx);
+
+void bench_queue_priority(Context& ctx);
+
+void bench_dispatch_slicing(Context& ctx);
+
+void bench_device_recovery(Context& ctx);
+
+void bench_failure_paths(Context& ctx);
+
+#endif
@@ -0,0 +1,130 @@
+#include "bench.hpp"
+#include "columnar.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <bit>
+
+namespace {
+    constexpr size_t iterations = 20;
+    constexpr uint32_t n_rows = 1 << 24;
+
+    // An Arrow array whose buffers are owned by the benchmark.
+    struct OwnedArray {
+        std::vector<uint8_t> validity;
+        std::vector<uint32_t> values;
+        const void* buffers[2];
+        ArrowArray array;
+
+        OwnedArray(std::vector<uint32_t> values, std::vector<uint8_t> validity):
+            validity(std::move(validity)), values(std::move(values)) {
+            this->buffers[0] = this->validity.empty() ? nullptr : this->validity.data();
+            this->buffers[1] = this->values.data();
+            this->array = ArrowArray{
+                .length = static_cast<int64_t>(this->values.size()),
+                .null_count = -1,
+                .offset = 0,
+                .n_buffers = 2,
+                .n_children = 0,
+                .buffers = this->buffers,
+                .children = nullptr,
+                .dictionary = nullptr,
+                .release = nullptr,
+                .private_data = nullptr,
+            };
+        }
+    };
+
+    bool aggregates_match(std::span<const ColumnAggregate> expected, std::span<const ColumnAggregate> actual) {
+        if (expected.size() != actual.size())
+            return false;
+
+        for (size_t i = 0; i < expected.size(); ++i) {
+            const auto& a = expected[i];
+            const auto& b = actual[i];
+            // Sums are accumulated in a different order, and in fp32 on the device.
+            if (a.count != b.count || a.min != b.min || a.max != b.max
+                || std::abs(a.sum - b.sum) > 1e-4 * std::max(1.0, std::abs(a.sum)))
+                return false;
+        }
+        return true;
+    }
+}
+
+void bench_columnar(Context& ctx) {
+    auto rng = std::mt19937(0);
+
+    // A lineitem-like table: price (nullable), discount, quantity and ship date.
+    auto price = std::vector<uint32_t>(n_rows);
+    auto price_validity = std::vector<uint8_t>(div_ceil(n_rows, 8));
+    auto discount = std::vector<uint32_t>(n_rows);
+    auto quantity = std::vector<uint32_t>(n_rows);
+    auto date = std::vector<uint32_t>(n_rows);
+    auto price_dist = std::uniform_real_distribution<float>(900, 100000);
+    auto discount_dist = std::uniform_int_distribution<int>(0, 10);
+    auto quantity_dist = std::uniform_int_distribution<int>(1, 50);
+    auto date_dist = std::uniform_int_distribution<int>(0, 7 * 365);
+    auto null_dist = std::bernoulli_distribution(0.05);
+    for (uint32_t i = 0; i < n_rows; ++i) {
+        price[i] = std::bit_cast<uint32_t>(price_dist(rng));
+        price_validity[i / 8] |= null_dist(rng) ? 0 : 1 << (i % 8);
+        discount[i] = std::bit_cast<uint32_t>(discount_dist(rng) / 100.f);
+        quantity[i] = quantity_dist(rng);
+        date[i] = date_dist(rng);
+    }
+
+    auto arrays = std::vector<OwnedArray>();
+    arrays.reserve(4);
+    arrays.emplace_back(std::move(price), std::move(price_validity));
+    arrays.emplace_back(std::move(discount), std::vector<uint8_t>());
+    arrays.emplace_back(std::move(quantity), std::vector<uint8_t>());
+    arrays.emplace_back(std::move(date), std::vector<uint8_t>());
+
+    auto float_schema = ArrowSchema{.format = "f"};
+    auto int_schema = ArrowSchema{.format = "i"};
+    auto columns = std::vector<ArrowColumn>{
+        {&float_schema, &arrays[0].array},
+        {&float_schema, &arrays[1].array},
+        {&int_schema, &arrays[2].array},
+        {&int_schema, &arrays[3].array},
+    };
+
+    auto inputs = std::vector<DeviceColumn>();
+    for (const auto& column : columns) {
+        inputs.push_back(import_arrow_column(ctx, column));
+    }
+
+    // SELECT sum(price * discount), sum(quantity) WHERE date in [365, 730) AND discount in [0.05, 0.07]
+    // AND quantity < 24, like TPC-H Q6.
+    auto query = Query{
+        .filters = {
+            {3, CompareOp::GreaterEqual, 365},
+            {3, CompareOp::Less, 730},
+            {1, CompareOp::GreaterEqual, 0.05f},
+            {1, CompareOp::LessEqual, 0.07f},
+            {2, CompareOp::Less, 24},
+        },
+        .projections = {{0, ArithOp::Multiply, 1}},
+        .aggregates = {4, 2},
+    };
+    auto plan = create_query_plan(ctx, query, n_rows);
+
+    std::vector<ColumnAggregate> expected;
+    double cpu_time = time_cpu(iterations, [&] {
+        expected = query_reference(columns, query);
+    });
+
+    // The inputs are read from pinned host memory by every run.
+    double gpu_time = time_submissions(ctx, iterations, [&] {
+        run_query(ctx, plan, inputs);
+    });
+    bool ok = aggregates_match(expected, read_query(plan));
+
+    double bytes = n_rows * (4.0 * columns.size() + 1 / 8.0);
+    fmt::print("q6-like query, {} rows: cpu {:>8.3f} ms, gpu {:>8.3f} ms ({:.2f} Grows/s, {:.2f} GB/s of input){}\n",
+        n_rows, cpu_time * 1000, gpu_time * 1000, n_rows / gpu_time * 1e-9, bytes / gpu_time * 1e-9, ok ? "" : " MISMATCH");
+    fmt::print("  revenue {:.2f}, {} rows selected\n", expected[0].sum, expected[1].count);
+}
@@ -0,0 +1,82 @@
+#include "bench.hpp"
+#include "csv.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+    constexpr size_t iterations = 5;
+    constexpr uint32_t n_rows = 1 << 22;
+    constexpr uint32_t n_columns = 6;
+
+    // A mix of integers, fixed point and scientific notation, as found in typical exports.
+    std::string generate_csv(std::mt19937& rng) {
+        auto value_dist = std::uniform_real_distribution<double>(-1000, 1000);
+        auto text = std::string("id,a,b,c,d,e\n");
+        char field[64];
+        for (uint32_t row = 0; row < n_rows; ++row) {
+            for (uint32_t column = 0; column < n_columns; ++column) {
+                int length;
+                switch (column % 3) {
+                    case 0: length = std::snprintf(field, sizeof(field), "%d", static_cast<int>(value_dist(rng) * 1000)); break;
+                    case 1: length = std::snprintf(field, sizeof(field), "%.4f", value_dist(rng)); break;
+                    default: length = std::snprintf(field, sizeof(field), "%.6e", value_dist(rng) * 1e-9); break;
+                }
+                text.append(field, length);
+                text += column + 1 == n_columns ? '\n' : ',';
+            }
+        }
+        return text;
+    }
+
+    bool same_bits(std::span<const float> a, std::span<const float> b) {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size_bytes()) == 0;
+    }
+}
+
+void bench_csv(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto text = generate_csv(rng);
+    double mb = text.size() * 1e-6;
+    auto format = CsvFormat{.header = true};
+
+    // Baseline: a single-threaded strtof loop.
+    auto baseline = std::vector<float>(size_t{n_rows} * n_columns);
+    double strtof_time = time_cpu(1, [&] {
+        const char* p = text.data() + text.find('\n') + 1;
+        for (uint32_t row = 0; row < n_rows; ++row) {
+            for (uint32_t column = 0; column < n_columns; ++column) {
+                char* end;
+                baseline[size_t{column} * n_rows + row] = std::strtof(p, &end);
+                p = end + 1;
+            }
+        }
+    });
+    fmt::print("{:.1f} MB, {} rows x {} columns\n", mb, n_rows, n_columns);
+    fmt::print("strtof, 1 thread:   {:>9.3f} ms {:>8.1f} MB/s\n", strtof_time * 1000, mb / strtof_time);
+
+    CsvColumns expected;
+    for (uint32_t threads : {1u, 0u}) {
+        double time = time_cpu(iterations, [&] {
+            expected = parse_csv(text, format, threads);
+        });
+        double error = max_error(baseline, expected.values);
+        fmt::print("cpu, {:>2} threads:   {:>9.3f} ms {:>8.1f} MB/s  max error vs strtof {:.2e}{}\n",
+            threads == 0 ? std::thread::hardware_concurrency() : threads, time * 1000, mb / time, error, error > 1e-6 ? " MISMATCH" : "");
+    }
+
+    // End to end, including the upload and the read back of the field count.
+    auto table = ingest_csv_gpu(ctx, text, format);
+    double time = time_cpu(iterations, [&] {
+        ingest_csv_gpu(ctx, text, format);
+    });
+    bool ok = table.n_rows == expected.n_rows && table.n_columns == expected.n_columns
+        && same_bits(expected.values, download_buffer<float>(table.values));
+    fmt::print("gpu:                {:>9.3f} ms {:>8.1f} MB/s{}\n", time * 1000, mb / time, ok ? "" : " MISMATCH");
+}
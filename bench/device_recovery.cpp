@@ -0,0 +1,96 @@
+#include "bench.hpp"
+#include "shadow_buffer.hpp"
+#include "tensor.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace {
+    constexpr size_t iterations = 5;
+    constexpr size_t n_shadow_buffers = 4;
+    constexpr Pal::gpusize shadow_buffer_size = 64 << 20;
+    constexpr auto shape = GemmShape{256, 256, 256};
+}
+
+// Recovers a healthy device, which takes the same path as a lost one: a hang cannot be provoked
+// safely from here.
+void bench_device_recovery(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+    auto values = std::vector<float>(shape.m * shape.k);
+    std::generate(values.begin(), values.end(), [&] { return value_dist(rng); });
+    auto expected = gemm_reference(values, values, shape);
+
+    auto buffers = std::vector<ShadowBuffer>();
+    auto pointers = std::vector<ShadowBuffer*>();
+    for (size_t i = 0; i < n_shadow_buffers; ++i) {
+        buffers.push_back(create_shadow_buffer(ctx, shadow_buffer_size));
+        auto data = buffers.back().data();
+        for (size_t j = 0; j < data.size(); ++j) {
+            data[j] = static_cast<std::byte>(j * 7 + i);
+        }
+        buffers.back().mark_dirty(0, shadow_buffer_size);
+        ctx.begin();
+        flush(ctx, buffers.back());
+        ctx.submit();
+    }
+    for (auto& buffer : buffers) {
+        pointers.push_back(&buffer);
+    }
+
+    // Every dispatch after recovery should run without creating pipelines.
+    auto run_gemm = [&] {
+        auto a = upload_buffer<float>(ctx, values);
+        auto c = create_device_buffer(ctx, shape.m * shape.n * sizeof(float));
+        double time = time_cpu(1, [&] {
+            ctx.begin();
+            gemm(ctx, {a, ElementType::F32}, {a, ElementType::F32}, c, shape);
+            ctx.submit();
+        });
+        return std::pair(time, max_error(expected, download_buffer<float>(c)) < 1e-3);
+    };
+    auto [steady_gemm, steady_ok] = run_gemm();
+
+    auto total = RecoveryStats{};
+    double release_time = 0;
+    double restore_time = 0;
+    double gemm_time = 0;
+    bool ok = steady_ok;
+    for (size_t i = 0; i < iterations; ++i) {
+        release_time += time_cpu(1, [&] {
+            for (auto* buffer : pointers) {
+                release_shadow_buffer(*buffer);
+            }
+        });
+        auto stats = recover_context(ctx);
+        restore_time += time_cpu(1, [&] {
+            restore_shadow_buffers(ctx, pointers);
+        });
+        auto [time, gemm_ok] = run_gemm();
+        gemm_time += time;
+
+        total.teardown += stats.teardown;
+        total.device += stats.device;
+        total.objects += stats.objects;
+        total.pipelines += stats.pipelines;
+        total.reused_device = stats.reused_device;
+        total.pipeline_count = stats.pipeline_count;
+        ok = ok && gemm_ok;
+        for (const auto& buffer : buffers) {
+            ok = ok && std::memcmp(download_buffer<std::byte>(buffer.device).data(), buffer.shadow.get(), buffer.size) == 0;
+        }
+    }
+
+    auto ms = [](double seconds) { return seconds / iterations * 1000; };
+    fmt::print("device {}, {} pipelines, {} x {} MiB shadow buffers\n",
+        total.reused_device ? "reinitialized in place" : "recreated with a new platform", total.pipeline_count,
+        n_shadow_buffers, shadow_buffer_size >> 20);
+    fmt::print("release {:>8.3f} ms, teardown {:>8.3f} ms, device {:>8.3f} ms, objects {:>8.3f} ms, pipelines {:>8.3f} ms, restore {:>8.3f} ms\n",
+        ms(release_time), ms(total.teardown), ms(total.device), ms(total.objects), ms(total.pipelines), ms(restore_time));
+    fmt::print("total {:>8.3f} ms per recovery; first gemm after recovery {:>8.3f} ms, before {:>8.3f} ms{}\n",
+        ms(release_time + total.teardown + total.device + total.objects + total.pipelines + restore_time),
+        ms(gemm_time), steady_gemm * 1000, ok ? "" : " MISMATCH");
+}
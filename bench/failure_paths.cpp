@@ -0,0 +1,66 @@
+#include "bench.hpp"
+
+#include <fmt/format.h>
+
+#include <stdexcept>
+
+namespace {
+    constexpr size_t transient_iterations = 100000;
+    constexpr size_t allocation_iterations = 1000;
+    // More than any device has, so that every allocation fails.
+    constexpr Pal::gpusize oversized_allocation = Pal::gpusize{1} << 46;
+
+    void print_comparison(const char* name, double throwing, double expected) {
+        fmt::print("{:<32} throwing {:>9.3f} us, expected {:>9.3f} us, {:>6.1f}x\n",
+            name, throwing * 1e6, expected * 1e6, throwing / expected);
+    }
+}
+
+// Compares the throwing functions with their try_ versions on paths that fail regularly.
+void bench_failure_paths(Context& ctx) {
+    auto& heap = ctx.transient;
+    size_t failures = 0;
+
+    // Successful allocations, which should cost the same either way.
+    double alloc_time = time_cpu(transient_iterations, [&] {
+        heap.alloc(64);
+        heap.reset();
+    });
+    double try_alloc_time = time_cpu(transient_iterations, [&] {
+        failures += !heap.try_alloc(64);
+        heap.reset();
+    });
+    print_comparison("transient alloc", alloc_time, try_alloc_time);
+
+    // An exhausted transient heap, as when a recording outgrows it and is split.
+    heap.offset = heap.capacity;
+    double exhausted_time = time_cpu(transient_iterations, [&] {
+        try {
+            heap.alloc(64);
+        } catch (const std::runtime_error&) {
+            ++failures;
+        }
+    });
+    double try_exhausted_time = time_cpu(transient_iterations, [&] {
+        failures += !heap.try_alloc(64);
+    });
+    heap.reset();
+    print_comparison("exhausted transient alloc", exhausted_time, try_exhausted_time);
+
+    // Device allocations that the driver refuses.
+    double oversized_time = time_cpu(allocation_iterations, [&] {
+        try {
+            create_device_buffer(ctx, oversized_allocation);
+        } catch (const PalError&) {
+            ++failures;
+        }
+    });
+    double try_oversized_time = time_cpu(allocation_iterations, [&] {
+        failures += !try_create_device_buffer(ctx, oversized_allocation);
+    });
+    print_comparison("failed device allocation", oversized_time, try_oversized_time);
+
+    auto expected_failures = 2 * transient_iterations + 2 * allocation_iterations;
+    if (failures != expected_failures)
+        fmt::print("MISMATCH: {} failures, expected {}\n", failures, expected_failures);
+}
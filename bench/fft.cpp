@@ -0,0 +1,75 @@
+#include "bench.hpp"
+#include "fft.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+namespace {
+    constexpr size_t iterations = 20;
+    // Number of complex elements transformed by every configuration.
+    constexpr uint32_t total = 1 << 22;
+
+    // Largest error relative to the root mean square of the expected values, since the error
+    // of an FFT grows with the magnitude of the whole transform rather than of single elements.
+    double rms_error(std::span<const Complex> expected, std::span<const Complex> actual) {
+        if (expected.size() != actual.size())
+            return INFINITY;
+
+        double sum_squares = 0;
+        double error = 0;
+        for (size_t i = 0; i < expected.size(); ++i) {
+            sum_squares += std::norm(std::complex<double>(expected[i]));
+            error = std::max(error, std::abs(std::complex<double>(expected[i]) - std::complex<double>(actual[i])));
+        }
+        return error / std::sqrt(sum_squares / expected.size());
+    }
+
+    void report(std::string_view name, double time, double cpu_time, uint32_t size, std::span<const Complex> expected, const Buffer& dst) {
+        // The conventional 5 n log2(n) flops per complex transform of n elements.
+        double flops = 5.0 * total * std::log2(size);
+        double error = rms_error(expected, download_buffer<Complex>(dst));
+        fmt::print("{:<22} cpu {:>9.3f} ms, gpu {:>8.3f} ms {:>8.2f} GFLOP/s  error {:.2e}{}\n",
+            name, cpu_time * 1000, time * 1000, flops / time * 1e-9, error, error > 1e-5 * std::log2(size) ? " MISMATCH" : "");
+    }
+}
+
+void bench_fft(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+
+    auto input = std::vector<Complex>(total);
+    std::generate(input.begin(), input.end(), [&] { return Complex(value_dist(rng), value_dist(rng)); });
+    auto src = upload_buffer<Complex>(ctx, input);
+    auto dst = create_device_buffer(ctx, total * sizeof(Complex));
+    auto cache = FftPlanCache();
+
+    for (uint32_t n : {64u, 512u, 4096u, 1u << 16, 1u << 22}) {
+        for (auto direction : {FftDirection::Forward, FftDirection::Inverse}) {
+            uint32_t batch = total / n;
+            std::vector<Complex> expected;
+            double cpu_time = time_cpu(1, [&] {
+                expected = fft_reference(input, n, batch, direction);
+            });
+            double time = time_submissions(ctx, iterations, [&] {
+                fft(ctx, cache.plan(ctx, n, batch), src, dst, direction);
+            });
+            auto name = fmt::format("1d {:>7} x {:<5} {}", n, batch, direction == FftDirection::Forward ? "fwd" : "inv");
+            report(name, time, cpu_time, n, expected, dst);
+        }
+    }
+
+    for (uint32_t n : {256u, 1024u, 2048u}) {
+        uint32_t batch = total / (n * n);
+        std::vector<Complex> expected;
+        double cpu_time = time_cpu(1, [&] {
+            expected = fft2d_reference(input, n, n, batch, FftDirection::Forward);
+        });
+        double time = time_submissions(ctx, iterations, [&] {
+            fft(ctx, cache.plan_2d(ctx, n, n, batch), src, dst, FftDirection::Forward);
+        });
+        report(fmt::format("2d {:>4}x{:<4} x {:<3} fwd", n, n, batch), time, cpu_time, n * n, expected, dst);
+    }
+}
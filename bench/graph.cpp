@@ -0,0 +1,144 @@
+#include "bench.hpp"
+#include "graph.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <utility>
+
+namespace {
+    constexpr size_t iterations = 8;
+    constexpr uint32_t scale = 20;
+    constexpr uint32_t edge_factor = 16;
+    constexpr size_t sources = 4;
+
+    // Generates an undirected R-MAT graph as in Graph500: every edge picks one quadrant of the
+    // adjacency matrix per bit of the vertex ids with probabilities a, b, c and 1 - a - b - c,
+    // and vertex ids are permuted randomly afterwards, so that high-degree vertices are spread out.
+    // Self loops and duplicate edges are removed. Weights are uniform in (0, 1].
+    CsrMatrix rmat_graph(uint32_t scale, uint32_t edge_factor, std::mt19937& rng) {
+        constexpr double a = 0.57;
+        constexpr double b = 0.19;
+        constexpr double c = 0.19;
+        const uint32_t n = 1 << scale;
+
+        auto permutation = std::vector<uint32_t>(n);
+        std::iota(permutation.begin(), permutation.end(), 0);
+        std::shuffle(permutation.begin(), permutation.end(), rng);
+
+        auto uniform = std::uniform_real_distribution<double>(0, 1);
+        auto edges = std::vector<std::pair<uint32_t, uint32_t>>();
+        edges.reserve(2 * size_t{n} * edge_factor);
+        for (size_t i = 0; i < size_t{n} * edge_factor; ++i) {
+            uint32_t u = 0;
+            uint32_t v = 0;
+            for (uint32_t bit = 0; bit < scale; ++bit) {
+                double r = uniform(rng);
+                u |= (r >= a + b) << bit;
+                v |= ((r >= a && r < a + b) || r >= a + b + c) << bit;
+            }
+            if (u == v)
+                continue;
+            edges.emplace_back(permutation[u], permutation[v]);
+            edges.emplace_back(permutation[v], permutation[u]);
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        auto weight_dist = std::uniform_real_distribution<float>(0, 1);
+        auto graph = CsrMatrix{
+            .rows = n,
+            .cols = n,
+            .row_offsets = std::vector<uint32_t>(n + 1),
+            .col_indices = {},
+            .values = {},
+        };
+        graph.col_indices.reserve(edges.size());
+        graph.values.reserve(edges.size());
+        for (auto [u, v] : edges) {
+            ++graph.row_offsets[u + 1];
+            graph.col_indices.push_back(v);
+            graph.values.push_back(1 - weight_dist(rng));
+        }
+        std::partial_sum(graph.row_offsets.begin(), graph.row_offsets.end(), graph.row_offsets.begin());
+        return graph;
+    }
+
+    // Undirected edges within the component of the source, as counted by Graph500.
+    double traversed_edges(const CsrMatrix& graph, std::span<const uint32_t> depths) {
+        double edges = 0;
+        for (uint32_t v = 0; v < graph.rows; ++v) {
+            if (depths[v] != bfs_unreached)
+                edges += graph.row_offsets[v + 1] - graph.row_offsets[v];
+        }
+        return edges / 2;
+    }
+}
+
+void bench_graph(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto graph = rmat_graph(scale, edge_factor, rng);
+    fmt::print("rmat scale {}, edge factor {}: {} vertices, {} directed edges\n", scale, edge_factor, graph.rows, graph.nnz());
+
+    // Sources with at least one edge, so that they are in the giant component.
+    auto picks = std::vector<uint32_t>();
+    auto vertex_dist = std::uniform_int_distribution<uint32_t>(0, graph.rows - 1);
+    while (picks.size() < sources) {
+        auto v = vertex_dist(rng);
+        if (graph.row_offsets[v + 1] > graph.row_offsets[v])
+            picks.push_back(v);
+    }
+
+    // The graph is undirected, so it is its own reverse.
+    auto gpu_graph = upload_graph(ctx, graph);
+    auto bfs_plan = create_bfs_plan(ctx, graph.rows);
+    auto sssp_plan = create_sssp_plan(ctx, graph.rows);
+
+    for (auto source : picks) {
+        auto expected = bfs_reference(graph, source);
+        double edges = traversed_edges(graph, expected);
+        double cpu_time = time_cpu(1, [&] {
+            bfs_reference(graph, source);
+        });
+        fmt::print("bfs from {}: {:.0f} edges, cpu {:>8.3f} ms ({:.3f} GTEPS)\n", source, edges, cpu_time * 1000, edges / cpu_time * 1e-9);
+
+        for (float alpha : {0.f, 15.f}) {
+            auto options = BfsOptions{.alpha = alpha};
+            BfsStats stats;
+            double gpu_time = time_cpu(iterations, [&] {
+                stats = bfs(ctx, bfs_plan, gpu_graph, gpu_graph, source, options);
+            });
+            bool ok = read_bfs_depths(bfs_plan) == expected;
+            fmt::print("  {:<20} {:>8.3f} ms ({:.3f} GTEPS), {} levels ({} pull), {} submissions{}\n",
+                alpha == 0 ? "push only" : "direction-optimizing", gpu_time * 1000, edges / gpu_time * 1e-9,
+                stats.levels, stats.pull_levels, stats.submissions, ok ? "" : " MISMATCH");
+        }
+    }
+
+    // Davidson et al. suggest a bucket width around the warp size times the average weight divided
+    // by the average degree.
+    double average_degree = static_cast<double>(graph.nnz()) / graph.rows;
+    for (auto source : picks) {
+        std::vector<float> expected;
+        double cpu_time = time_cpu(1, [&] {
+            expected = sssp_reference(graph, source);
+        });
+        auto depths = bfs_reference(graph, source);
+        double edges = traversed_edges(graph, depths);
+        fmt::print("sssp from {}: cpu {:>8.3f} ms ({:.3f} GTEPS)\n", source, cpu_time * 1000, edges / cpu_time * 1e-9);
+
+        for (double width : {16.0, 64.0, 256.0}) {
+            auto options = SsspOptions{.delta = static_cast<float>(width * 0.5 / average_degree)};
+            SsspStats stats;
+            double gpu_time = time_cpu(iterations, [&] {
+                stats = sssp(ctx, sssp_plan, gpu_graph, source, options);
+            });
+            double error = max_error(expected, read_sssp_distances(sssp_plan));
+            fmt::print("  delta {:<8.4f} {:>8.3f} ms ({:.3f} GTEPS), {} steps, {} buckets, {} submissions{}\n",
+                options.delta, gpu_time * 1000, edges / gpu_time * 1e-9, stats.steps, stats.buckets, stats.submissions,
+                error == 0 ? "" : " MISMATCH");
+        }
+    }
+}
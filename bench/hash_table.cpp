@@ -0,0 +1,58 @@
+#include "bench.hpp"
+#include "hash_table.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+namespace {
+    constexpr size_t iterations = 10;
+    constexpr uint32_t n_probe = 1 << 24;
+}
+
+void bench_hash_table(Context& ctx) {
+    auto rng = std::mt19937(0);
+
+    // Table sizes range from well within L2 to far beyond it.
+    for (uint32_t n_build : {1u << 14, 1u << 16, 1u << 18, 1u << 20, 1u << 22, 1u << 24}) {
+        // Unique build keys, and probe keys of which about half hit.
+        auto build_keys = std::vector<uint32_t>(n_build);
+        std::iota(build_keys.begin(), build_keys.end(), 0);
+        std::shuffle(build_keys.begin(), build_keys.end(), rng);
+        auto key_dist = std::uniform_int_distribution<uint32_t>(0, n_build * 2 - 1);
+        auto probe_keys = std::vector<uint32_t>(n_probe);
+        std::generate(probe_keys.begin(), probe_keys.end(), [&] { return key_dist(rng); });
+
+        auto gpu_build_keys = upload_buffer<uint32_t>(ctx, build_keys);
+        auto gpu_probe_keys = upload_buffer<uint32_t>(ctx, probe_keys);
+        auto table = create_hash_table(ctx, n_build);
+        // About half of the probe keys hit, so this has to grow once.
+        auto output = create_join_output(ctx, n_probe, n_probe / 8);
+
+        double build_time = time_submissions(ctx, iterations, [&] {
+            hash_table_build(ctx, table, gpu_build_keys, n_build);
+        });
+
+        ctx.begin();
+        hash_table_probe(ctx, table, gpu_probe_keys, n_probe, output);
+        ctx.submit();
+        bool grew = grow_join_output(ctx, output);
+
+        double probe_time = time_submissions(ctx, iterations, [&] {
+            hash_table_probe(ctx, table, gpu_probe_keys, n_probe, output);
+        });
+
+        bool ok = read_join(ctx, table, output) == hash_join_reference(build_keys, probe_keys);
+        fmt::print("{:>9} keys ({:>7.1f} MiB table): build {:>8.1f} Mkeys/s, probe {:>8.1f} Mkeys/s, output {} in {} chunks{}{}\n",
+            n_build,
+            table.capacity * 8.0 / (1024 * 1024),
+            n_build / build_time * 1e-6,
+            n_probe / probe_time * 1e-6,
+            output.matches.capacity(),
+            output.matches.chunks.size(),
+            grew ? " (grew)" : "",
+            ok ? "" : " MISMATCH");
+    }
+}
@@ -0,0 +1,132 @@
+#include "bench.hpp"
+#include "job_graph.hpp"
+#include "shadow_buffer.hpp"
+#include "stencil.hpp"
+#include "tensor.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <bit>
+#include <optional>
+#include <random>
+
+namespace {
+    constexpr size_t iterations = 10;
+    constexpr uint32_t size = 2048;
+    constexpr uint32_t n = size * size;
+    constexpr uint32_t radius = 4;
+    constexpr auto shape = GemmShape{size, size, 1024};
+    constexpr float bias = 0.5f;
+
+    // The image is blurred and added to a product of two weight matrices and a constant bias: the
+    // weights rarely change, so the product is the part that incremental runs save.
+    struct Pipeline {
+        ShadowBuffer image;
+        Buffer a;
+        Buffer b;
+        std::vector<float> filter;
+        JobGraph graph;
+        ResourceId image_id;
+        ResourceId weights_id;
+        ResourceId output_id;
+    };
+
+    // The jobs refer to the pipeline, so this builds the graph in place.
+    void create_pipeline(Context& ctx, std::mt19937& rng, std::optional<Pipeline>& result) {
+        auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+        auto values = std::vector<float>(shape.m * shape.k);
+        std::generate(values.begin(), values.end(), [&] { return value_dist(rng); });
+
+        auto& pipeline = result.emplace(Pipeline{
+            .image = create_shadow_buffer(ctx, n * sizeof(float)),
+            .a = upload_buffer<float>(ctx, values),
+            .b = upload_buffer<float>(ctx, values),
+            .filter = std::vector<float>((2 * radius + 1) * (2 * radius + 1), 1.f / ((2 * radius + 1) * (2 * radius + 1))),
+            .graph = {},
+            .image_id = 0,
+            .weights_id = 0,
+            .output_id = 0,
+        });
+
+        auto& graph = pipeline.graph;
+        pipeline.image_id = graph.add_input(pipeline.image);
+        pipeline.weights_id = graph.add_input(pipeline.a);
+        auto blurred = graph.add_buffer(ctx, n * sizeof(float));
+        auto product = graph.add_buffer(ctx, n * sizeof(float));
+        auto biases = graph.add_buffer(ctx, n * sizeof(float));
+        pipeline.output_id = graph.add_buffer(ctx, n * sizeof(float));
+
+        graph.add_job("blur", {pipeline.image_id}, {blurred}, [&, blurred](Context& ctx) {
+            convolve2d(ctx, pipeline.image, graph.view(blurred), size, size, pipeline.filter, radius, radius);
+        });
+        graph.add_job("product", {pipeline.weights_id}, {product}, [&, product](Context& ctx) {
+            gemm(ctx, {pipeline.a, ElementType::F32}, {pipeline.b, ElementType::F32}, graph.view(product), shape);
+        });
+        // Has no inputs, so it only runs the first time and after the graph is invalidated.
+        graph.add_job("bias", {}, {biases}, [&, biases](Context& ctx) {
+            fill(ctx, graph.view(biases), std::bit_cast<uint32_t>(bias));
+        });
+        graph.add_job("combine", {blurred, product, biases}, {pipeline.output_id}, [&, blurred, product, biases](Context& ctx) {
+            auto output = graph.view(pipeline.output_id);
+            copy(ctx, graph.view(blurred), output);
+            barrier(ctx);
+            axpby(ctx, 1, {graph.view(product), ElementType::F32}, 1, {output, ElementType::F32}, n);
+            barrier(ctx);
+            axpby(ctx, 1, {graph.view(biases), ElementType::F32}, 1, {output, ElementType::F32}, n);
+        });
+    }
+}
+
+void bench_job_graph(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(0, 1);
+    auto pos_dist = std::uniform_int_distribution<uint32_t>(0, n - size);
+    auto row = std::vector<float>(size);
+
+    auto storage = std::optional<Pipeline>();
+    create_pipeline(ctx, rng, storage);
+    auto& pipeline = *storage;
+    auto& graph = pipeline.graph;
+
+    // Every run changes one row of the image.
+    auto update_image = [&] {
+        std::generate(row.begin(), row.end(), [&] { return value_dist(rng); });
+        pipeline.image.write<float>(pos_dist(rng), row);
+        flush(ctx, pipeline.image);
+        barrier(ctx);
+        graph.touch(pipeline.image_id);
+    };
+
+    ctx.begin();
+    auto stats = run_jobs(ctx, graph);
+    ctx.submit();
+    if (stats.recorded != graph.jobs.size())
+        fmt::print("MISMATCH: first run recorded {} of {} jobs\n", stats.recorded, graph.jobs.size());
+
+    double full_time = time_submissions(ctx, iterations, [&] {
+        update_image();
+        graph.invalidate();
+        stats = run_jobs(ctx, graph);
+    });
+    fmt::print("full recompute:       {} jobs recorded, {} skipped: {:>8.3f} ms\n", stats.recorded, stats.skipped, full_time * 1000);
+
+    double incremental_time = time_submissions(ctx, iterations, [&] {
+        update_image();
+        stats = run_jobs(ctx, graph);
+    });
+    fmt::print("image changed:        {} jobs recorded, {} skipped: {:>8.3f} ms\n", stats.recorded, stats.skipped, incremental_time * 1000);
+
+    double unchanged_time = time_submissions(ctx, iterations, [&] {
+        stats = run_jobs(ctx, graph);
+    });
+    fmt::print("nothing changed:      {} jobs recorded, {} skipped: {:>8.3f} ms\n", stats.recorded, stats.skipped, unchanged_time * 1000);
+
+    auto incremental = download_buffer<float>(graph.view(pipeline.output_id));
+    graph.invalidate();
+    ctx.begin();
+    run_jobs(ctx, graph);
+    ctx.submit();
+    auto full = download_buffer<float>(graph.view(pipeline.output_id));
+    fmt::print("incremental vs full max error: {:.3g}\n", max_error(full, incremental));
+}
@@ -0,0 +1,72 @@
+#include "bench.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <string_view>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+    struct Benchmark {
+        std::string_view name;
+        void (*run)(Context& ctx);
+    };
+
+    constexpr Benchmark benchmarks[] = {
+        {"spmv", bench_spmv},
+        {"aggregate", bench_aggregate},
+        {"hash_table", bench_hash_table},
+        {"topk", bench_topk},
+        {"stencil", bench_stencil},
+        {"random", bench_random},
+        {"fft", bench_fft},
+        {"tensor", bench_tensor},
+        {"csv", bench_csv},
+        {"columnar", bench_columnar},
+        {"graph", bench_graph},
+        {"tree_search", bench_tree_search},
+        {"suballocator", bench_suballocator},
+        {"shadow_buffer", bench_shadow_buffer},
+        {"job_graph", bench_job_graph},
+        {"upload_cache", bench_upload_cache},
+        {"queue_priority", bench_queue_priority},
+        {"dispatch_slicing", bench_dispatch_slicing},
+        {"device_recovery", bench_device_recovery},
+        {"failure_paths", bench_failure_paths},
+    };
+}
+
+double max_error(std::span<const float> expected, std::span<const float> actual) {
+    if (expected.size() != actual.size())
+        return INFINITY;
+
+    double error = 0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        double diff = std::abs(double{expected[i]} - double{actual[i]});
+        error = std::max(error, diff / std::max(1.0, std::abs(double{expected[i]})));
+    }
+    return error;
+}
+
+LatencyStats latency_stats(std::vector<double> latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+    return {at(0.5), at(0.99), latencies.back()};
+}
+
+int main(int argc, char* argv[]) {
+    auto ctx = create_context();
+
+    // Without arguments, run every benchmark.
+    for (const auto& benchmark : benchmarks) {
+        bool selected = argc == 1 || std::any_of(argv + 1, argv + argc, [&](const char* arg) { return benchmark.name == arg; });
+        if (!selected)
+            continue;
+
+        fmt::print("== {} ==\n", benchmark.name);
+        benchmark.run(ctx);
+    }
+
+    return EXIT_SUCCESS;
+}
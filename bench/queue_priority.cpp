@@ -0,0 +1,86 @@
+#include "bench.hpp"
+#include "tensor.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+namespace {
+    constexpr size_t interactive_jobs = 200;
+    constexpr auto interactive_shape = GemmShape{256, 256, 256};
+    constexpr auto bulk_shape = GemmShape{4096, 4096, 1024};
+    constexpr auto interactive_interval = std::chrono::milliseconds(2);
+}
+
+void bench_queue_priority(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+    auto random_vector = [&](size_t n) {
+        auto values = std::vector<float>(n);
+        std::generate(values.begin(), values.end(), [&] { return value_dist(rng); });
+        return values;
+    };
+
+    auto small = random_vector(interactive_shape.m * interactive_shape.k);
+    auto a = upload_buffer<float>(ctx, small);
+    auto c = create_device_buffer(ctx, interactive_shape.m * interactive_shape.n * sizeof(float));
+    auto big = upload_buffer<float>(ctx, random_vector(bulk_shape.m * bulk_shape.k));
+    auto big_c = create_device_buffer(ctx, bulk_shape.m * bulk_shape.n * sizeof(float));
+    auto expected = gemm_reference(small, small, interactive_shape);
+
+    auto router = create_queue_router(ctx);
+    // For comparison: the same engines as the router uses, but both queues of normal priority.
+    auto engines = ctx.props.engineProperties[Pal::EngineTypeCompute].engineCount;
+    auto baseline = QueueRouter{
+        .interactive = create_queue_context(ctx, Pal::QueuePriority::Normal, engines > 1 ? 1 : 0),
+        .bulk = create_queue_context(ctx, Pal::QueuePriority::Normal, engines > 2 ? 2 : 0),
+    };
+
+    auto run = [&](const char* name, Context& interactive, Context* bulk) {
+        auto stop = std::atomic<bool>(false);
+        auto bulk_jobs = std::atomic<uint64_t>(0);
+        auto background = std::thread([&] {
+            while (bulk && !stop) {
+                bulk->begin();
+                gemm(*bulk, {big, ElementType::F32}, {big, ElementType::F32}, big_c, bulk_shape);
+                bulk->submit();
+                ++bulk_jobs;
+            }
+        });
+
+        auto latencies = std::vector<double>();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < interactive_jobs; ++i) {
+            double latency = time_cpu(1, [&] {
+                interactive.begin();
+                gemm(interactive, {a, ElementType::F32}, {a, ElementType::F32}, c, interactive_shape);
+                interactive.submit();
+            });
+            latencies.push_back(latency);
+            std::this_thread::sleep_for(interactive_interval);
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        stop = true;
+        background.join();
+
+        auto stats = latency_stats(latencies);
+        bool ok = max_error(expected, download_buffer<float>(c)) < 1e-3;
+        fmt::print("{:<28} interactive p50 {:>8.3f} ms, p99 {:>8.3f} ms, max {:>8.3f} ms, bulk {:>6.1f} jobs/s{}\n",
+            name, stats.p50 * 1000, stats.p99 * 1000, stats.max * 1000, bulk_jobs / elapsed, ok ? "" : " MISMATCH");
+    };
+
+    // Warm up the pipelines of every context.
+    for (auto* context : {&router.interactive, &router.bulk, &baseline.interactive, &baseline.bulk}) {
+        context->begin();
+        gemm(*context, {a, ElementType::F32}, {a, ElementType::F32}, c, interactive_shape);
+        context->submit();
+    }
+
+    run("no background load", router.interactive, nullptr);
+    run("background, equal priority", baseline.interactive, &baseline.bulk);
+    run("routed by priority", route(router, WorkClass::Interactive), &route(router, WorkClass::Bulk));
+}
@@ -0,0 +1,74 @@
+#include "bench.hpp"
+#include "random.hpp"
+#include "monte_carlo.hpp"
+
+#include <fmt/format.h>
+
+#include <cmath>
+#include <numbers>
+#include <type_traits>
+
+namespace {
+    constexpr size_t iterations = 20;
+    constexpr uint32_t n = 1 << 26;
+    // Number of elements that is verified against the CPU implementation.
+    constexpr uint32_t n_verify = 1 << 20;
+    constexpr uint32_t mc_blocks = 1 << 28;
+}
+
+void bench_random(Context& ctx) {
+    auto dst = create_device_buffer(ctx, n * sizeof(float));
+
+    for (auto generator : {RngGenerator::Philox4x32, RngGenerator::Threefry4x32}) {
+        auto name = generator == RngGenerator::Philox4x32 ? "philox4x32" : "threefry4x32";
+
+        auto run = [&](std::string_view distribution, auto fill, auto reference, bool exact) {
+            auto stream = RandomStream{.generator = generator, .seed = 0x12345678'9ABCDEF0};
+            double time = time_submissions(ctx, iterations, [&] {
+                fill(stream);
+            });
+
+            // The stream was advanced by every iteration, so regenerate the start for verification.
+            auto verify_stream = RandomStream{.generator = generator, .seed = stream.seed};
+            ctx.begin();
+            fill(verify_stream);
+            ctx.submit();
+
+            auto expected = reference(RandomStream{.generator = generator, .seed = stream.seed});
+            auto actual = download_buffer<std::decay_t<decltype(expected[0])>>(dst.view(0, n_verify * sizeof(expected[0])));
+            bool ok;
+            if constexpr (std::is_same_v<decltype(expected), std::vector<float>>) {
+                ok = exact ? expected == actual : max_error(expected, actual) < 1e-4;
+            } else {
+                ok = expected == actual;
+            }
+
+            fmt::print("{:<13} {:<12} {:>8.3f} ms {:>8.2f} GB/s{}\n",
+                name, distribution, time * 1000, n * 4.0 / time * 1e-9, ok ? "" : " MISMATCH");
+        };
+
+        run("bits", [&](RandomStream& s) { random_bits(ctx, dst, n, s); }, [&](RandomStream s) { return random_bits_reference(s, n_verify); }, true);
+        run("uniform", [&](RandomStream& s) { random_uniform(ctx, dst, n, s, -1, 1); }, [&](RandomStream s) { return random_uniform_reference(s, n_verify, -1, 1); }, true);
+        run("normal", [&](RandomStream& s) { random_normal(ctx, dst, n, s); }, [&](RandomStream s) { return random_normal_reference(s, n_verify); }, false);
+        run("exponential", [&](RandomStream& s) { random_exponential(ctx, dst, n, s, 2); }, [&](RandomStream s) { return random_exponential_reference(s, n_verify, 2); }, false);
+    }
+
+    auto plan = create_monte_carlo_plan(ctx, mc_blocks);
+    auto stream = RandomStream{.seed = 42};
+
+    double time = time_submissions(ctx, iterations, [&] {
+        monte_carlo_pi(ctx, plan, stream);
+    });
+    double pi = read_monte_carlo_pi(plan);
+    fmt::print("monte carlo pi:     {:>8.3f} ms {:>8.2f} Gsamples/s, pi ~ {:.6f} (error {:.2e})\n",
+        time * 1000, 2.0 * mc_blocks / time * 1e-9, pi, std::abs(pi - std::numbers::pi));
+
+    auto option = EuropeanOption{.spot = 100, .strike = 105, .rate = 0.03f, .volatility = 0.2f, .maturity = 1};
+    time = time_submissions(ctx, iterations, [&] {
+        monte_carlo_option(ctx, plan, stream, option);
+    });
+    double price = read_monte_carlo_option(plan, option);
+    double exact = black_scholes_call(option);
+    fmt::print("monte carlo option: {:>8.3f} ms {:>8.2f} Gpaths/s, price {:.4f} (black-scholes {:.4f})\n",
+        time * 1000, 4.0 * mc_blocks / time * 1e-9, price, exact);
+}
@@ -0,0 +1,59 @@
+#include "bench.hpp"
+#include "shadow_buffer.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace {
+    constexpr size_t iterations = 10;
+    constexpr uint32_t n = 1 << 26;
+
+    struct Pattern {
+        const char* name;
+        // Number of updates per job, and floats per update.
+        uint32_t updates;
+        uint32_t length;
+    };
+
+    constexpr Pattern patterns[] = {
+        {"1000 x 1 KiB", 1000, 256},
+        {"100 x 256 KiB", 100, 64 * 1024},
+        {"100000 single floats", 100000, 1},
+    };
+}
+
+void bench_shadow_buffer(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto buffer = create_shadow_buffer(ctx, n * sizeof(float));
+    auto values = std::vector<float>(64 * 1024);
+    std::generate(values.begin(), values.end(), [&] { return std::uniform_real_distribution<float>(-1, 1)(rng); });
+
+    // The full upload paths, for comparison: rewriting the mapped device buffer from the host, and
+    // copying all of the pinned host copy on the device.
+    double rewrite_time = time_cpu(iterations, [&] {
+        write_buffer(buffer.device, buffer.shadow.get());
+    });
+    double copy_time = time_submissions(ctx, iterations, [&] {
+        copy(ctx, {buffer.pinned.ptr, 0, buffer.size}, buffer.device);
+    });
+    fmt::print("full upload of {} MiB: rewrite mapped {:>8.3f} ms, copy from pinned {:>8.3f} ms\n",
+        buffer.size >> 20, rewrite_time * 1000, copy_time * 1000);
+
+    for (const auto& pattern : patterns) {
+        auto index_dist = std::uniform_int_distribution<uint32_t>(0, n - pattern.length);
+        UploadStats stats;
+        double time = time_submissions(ctx, iterations, [&] {
+            for (uint32_t i = 0; i < pattern.updates; ++i) {
+                buffer.write<float>(index_dist(rng), std::span(values).first(pattern.length));
+            }
+            stats = flush(ctx, buffer);
+        });
+
+        bool ok = std::memcmp(download_buffer<float>(buffer.device).data(), buffer.shadow.get(), buffer.size) == 0;
+        fmt::print("{:<22} {:>5} regions, {:>8.1f} KiB uploaded: {:>8.3f} ms per job{}\n",
+            pattern.name, stats.regions, stats.bytes / 1024.0, time * 1000, ok ? "" : " MISMATCH");
+    }
+}
@@ -0,0 +1,90 @@
+#include "bench.hpp"
+#include "spmv.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+namespace {
+    constexpr size_t iterations = 20;
+    constexpr uint32_t rows = 1 << 18;
+    // Don't bother with ELL if padding would blow up the matrix more than this.
+    constexpr size_t max_ell_padding = 16;
+
+    // Generates a square matrix of which the number of nonzeros per row follows a power law
+    // (Pareto distribution with shape `alpha`), similar to the adjacency matrices of real-world graphs.
+    CsrMatrix power_law_matrix(uint32_t n, double alpha, uint32_t min_nnz, std::mt19937& rng) {
+        auto uniform = std::uniform_real_distribution<double>(0, 1);
+        auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+        auto col_dist = std::uniform_int_distribution<uint32_t>(0, n - 1);
+
+        auto a = CsrMatrix{
+            .rows = n,
+            .cols = n,
+            .row_offsets = {0},
+            .col_indices = {},
+            .values = {},
+        };
+
+        for (uint32_t row = 0; row < n; ++row) {
+            double length = min_nnz * std::pow(1 - uniform(rng), -1 / alpha);
+            auto nnz = static_cast<uint32_t>(std::min<double>(length, n));
+
+            auto first = a.col_indices.size();
+            for (uint32_t i = 0; i < nnz; ++i) {
+                a.col_indices.push_back(col_dist(rng));
+                a.values.push_back(value_dist(rng));
+            }
+            std::sort(a.col_indices.begin() + first, a.col_indices.end());
+            a.row_offsets.push_back(a.col_indices.size());
+        }
+
+        return a;
+    }
+}
+
+void bench_spmv(Context& ctx) {
+    auto rng = std::mt19937(0);
+
+    for (double alpha : {2.5, 2.0, 1.5, 1.2}) {
+        auto a = power_law_matrix(rows, alpha, 4, rng);
+        uint32_t max_row = 0;
+        for (uint32_t row = 0; row < a.rows; ++row) {
+            max_row = std::max(max_row, a.row_offsets[row + 1] - a.row_offsets[row]);
+        }
+        fmt::print("alpha = {}: {} rows, {} nonzeros, longest row {}\n", alpha, a.rows, a.nnz(), max_row);
+
+        auto x_items = std::vector<float>(a.cols);
+        auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+        std::generate(x_items.begin(), x_items.end(), [&] { return value_dist(rng); });
+        auto x = upload_buffer<float>(ctx, x_items);
+
+        auto flops = 2.0 * a.nnz();
+        std::vector<float> expected;
+        double cpu_time = time_cpu(iterations, [&] {
+            expected = spmv_reference(a, x_items);
+        });
+        fmt::print("  {:<16} {:>8.3f} ms {:>8.2f} GFLOP/s\n", "cpu reference", cpu_time * 1000, flops / cpu_time * 1e-9);
+
+        auto report = [&](std::string_view name, const auto& gpu_a) {
+            auto y = create_device_buffer(ctx, a.rows * sizeof(float));
+            double time = time_submissions(ctx, iterations, [&] {
+                spmv(ctx, gpu_a, x, y);
+            });
+            double error = max_error(expected, download_buffer<float>(y));
+            fmt::print("  {:<16} {:>8.3f} ms {:>8.2f} GFLOP/s  max error {:.2e}{}\n",
+                name, time * 1000, flops / time * 1e-9, error, error > 1e-3 ? " MISMATCH" : "");
+        };
+
+        report("csr scalar", upload_csr(ctx, a, {.vector_threshold = UINT32_MAX, .long_threshold = UINT32_MAX}));
+        report("csr binned", upload_csr(ctx, a));
+        report("sliced ell", upload_sliced_ell(ctx, csr_to_sliced_ell(a)));
+
+        if (size_t{max_row} * a.rows <= max_ell_padding * a.nnz())
+            report("ell", upload_ell(ctx, csr_to_ell(a)));
+        else
+            fmt::print("  {:<16} skipped, too much padding\n", "ell");
+    }
+}
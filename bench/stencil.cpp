@@ -0,0 +1,96 @@
+#include "bench.hpp"
+#include "stencil.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+namespace {
+    constexpr size_t iterations = 20;
+    constexpr uint32_t width = 4096;
+    constexpr uint32_t height = 4096;
+    constexpr auto volume = DispatchSize{256, 256, 256};
+
+    std::vector<float> gaussian(uint32_t radius) {
+        auto weights = std::vector<float>(2 * radius + 1);
+        float sigma = std::max(radius / 2.f, 0.5f);
+        float total = 0;
+        for (uint32_t i = 0; i < weights.size(); ++i) {
+            float d = static_cast<float>(i) - radius;
+            weights[i] = std::exp(-d * d / (2 * sigma * sigma));
+            total += weights[i];
+        }
+        for (auto& w : weights) {
+            w /= total;
+        }
+        return weights;
+    }
+
+    void report(std::string_view name, double time, size_t elements, std::span<const float> expected, const Buffer& dst) {
+        double error = max_error(expected, download_buffer<float>(dst));
+        fmt::print("  {:<24} {:>8.3f} ms {:>8.2f} Gelem/s  max error {:.2e}{}\n",
+            name, time * 1000, elements / time * 1e-9, error, error > 1e-4 ? " MISMATCH" : "");
+    }
+}
+
+void bench_stencil(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(0, 1);
+
+    auto image = std::vector<float>(width * height);
+    std::generate(image.begin(), image.end(), [&] { return value_dist(rng); });
+    auto src = upload_buffer<float>(ctx, image);
+    auto tmp = create_device_buffer(ctx, image.size() * sizeof(float));
+    auto dst = create_device_buffer(ctx, image.size() * sizeof(float));
+
+    for (uint32_t radius : {1u, 3u, 8u}) {
+        auto weights_1d = gaussian(radius);
+        auto weights_2d = std::vector<float>();
+        for (float wy : weights_1d) {
+            for (float wx : weights_1d) {
+                weights_2d.push_back(wy * wx);
+            }
+        }
+
+        fmt::print("{}x{} image, {}x{} gaussian filter\n", width, height, 2 * radius + 1, 2 * radius + 1);
+        auto expected = convolve2d_reference(image, width, height, weights_2d, radius, radius);
+
+        double time = time_submissions(ctx, iterations, [&] {
+            convolve2d_naive(ctx, src, dst, width, height, weights_2d, radius, radius);
+        });
+        report("naive", time, image.size(), expected, dst);
+
+        for (auto tile : {TileShape{16, 16}, TileShape{32, 8}, TileShape{64, 4}}) {
+            double time = time_submissions(ctx, iterations, [&] {
+                convolve2d(ctx, src, dst, width, height, weights_2d, radius, radius, tile);
+            });
+            report(fmt::format("tiled {}x{}", tile.x, tile.y), time, image.size(), expected, dst);
+        }
+
+        time = time_submissions(ctx, iterations, [&] {
+            convolve2d_separable(ctx, src, tmp, dst, width, height, weights_1d, weights_1d, radius);
+        });
+        report("separable", time, image.size(), expected, dst);
+    }
+
+    auto field = std::vector<float>(size_t{volume.x} * volume.y * volume.z);
+    std::generate(field.begin(), field.end(), [&] { return value_dist(rng); });
+    auto src3d = upload_buffer<float>(ctx, field);
+    auto dst3d = create_device_buffer(ctx, field.size() * sizeof(float));
+    auto expected = stencil3d_reference(field, volume, 0.4f, 0.1f);
+
+    fmt::print("{}x{}x{} volume, 7-point stencil\n", volume.x, volume.y, volume.z);
+    double time = time_submissions(ctx, iterations, [&] {
+        stencil3d_naive(ctx, src3d, dst3d, volume, 0.4f, 0.1f);
+    });
+    report("naive", time, field.size(), expected, dst3d);
+
+    for (auto tile : {TileShape{16, 4, 4}, TileShape{8, 8, 4}, TileShape{64, 4, 1}}) {
+        double time = time_submissions(ctx, iterations, [&] {
+            stencil3d(ctx, src3d, dst3d, volume, 0.4f, 0.1f, tile);
+        });
+        report(fmt::format("tiled {}x{}x{}", tile.x, tile.y, tile.z), time, field.size(), expected, dst3d);
+    }
+}
@@ -0,0 +1,101 @@
+#include "bench.hpp"
+#include "suballocator.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+namespace {
+    constexpr Pal::gpusize max_committed = Pal::gpusize{1} << 30;
+    constexpr Pal::gpusize large_allocation = 48 * 1024 * 1024;
+    constexpr double pass_budget = 0.002;
+    constexpr uint32_t max_passes = 100;
+
+    struct Tagged {
+        Suballocation allocation;
+        uint32_t tag;
+    };
+
+    void print_stats(std::string_view label, const FragmentationStats& stats) {
+        fmt::print("{:<12} {:>3} blocks, {:>5} allocations, {:>7.1f} / {:>7.1f} MiB used, {:>5} free ranges, largest {:>6.1f} MiB, fragmentation {:.3f}\n",
+            label, stats.blocks, stats.allocations, stats.used / 1048576.0, stats.committed / 1048576.0, stats.free_ranges,
+            stats.largest_free / 1048576.0, stats.fragmentation);
+    }
+
+    bool try_allocate(Context& ctx, Suballocator& heap, Pal::gpusize size) {
+        try {
+            heap.release(heap.allocate(ctx, size));
+            return true;
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    }
+
+    // Checks the first word of every allocation, which was filled with its tag.
+    bool tags_match(const Suballocator& heap, std::span<const Tagged> allocations) {
+        for (const auto& [allocation, tag] : allocations) {
+            auto view = heap.view(allocation);
+            uint32_t value;
+            read_buffer({view.memory, view.offset, sizeof(value)}, &value);
+            if (value != tag)
+                return false;
+        }
+        return true;
+    }
+}
+
+void bench_suballocator(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto heap = create_suballocator({.max_committed = max_committed});
+    auto size_dist = std::uniform_int_distribution<uint32_t>(64 * 1024, 8 * 1024 * 1024);
+
+    // Churn like a long-running process: fill the heap to its limit, then release a random half,
+    // a few times over.
+    auto live = std::vector<Tagged>();
+    for (int round = 0; round < 4; ++round) {
+        ctx.begin();
+        while (true) {
+            Suballocation allocation;
+            try {
+                allocation = heap.allocate(ctx, size_dist(rng));
+            } catch (const std::runtime_error&) {
+                break;
+            }
+            auto tag = static_cast<uint32_t>(rng());
+            auto view = heap.view(allocation);
+            fill(ctx, {view.memory, view.offset, sizeof(tag)}, tag);
+            live.push_back({allocation, tag});
+        }
+        ctx.submit();
+
+        std::shuffle(live.begin(), live.end(), rng);
+        for (size_t i = live.size() / 2; i < live.size(); ++i) {
+            heap.release(live[i].allocation);
+        }
+        live.resize(live.size() / 2);
+    }
+
+    print_stats("fragmented", fragmentation_stats(heap));
+    fmt::print("{} MiB allocation {}\n", large_allocation >> 20, try_allocate(ctx, heap, large_allocation) ? "succeeds" : "fails");
+
+    // Incremental passes, as if run in the idle time between jobs.
+    for (uint32_t pass = 0; pass < max_passes; ++pass) {
+        auto stats = defragment(ctx, heap, pass_budget);
+        fmt::print("pass {:>3}: {:>4} moves, {:>7.1f} MiB in {:>6.3f} ms ({:.1f} GB/s), {} blocks released\n",
+            pass, stats.moves, stats.bytes_moved / 1048576.0, stats.seconds * 1000, stats.bytes_moved / stats.seconds * 1e-9,
+            stats.blocks_released);
+        print_stats("", fragmentation_stats(heap));
+        if (stats.complete)
+            break;
+    }
+
+    bool ok = tags_match(heap, live);
+    fmt::print("{} MiB allocation {}{}\n", large_allocation >> 20, try_allocate(ctx, heap, large_allocation) ? "succeeds" : "fails",
+        ok ? "" : " MISMATCH");
+
+    for (const auto& tagged : live) {
+        heap.release(tagged.allocation);
+    }
+}
@@ -0,0 +1,150 @@
+#include "bench.hpp"
+#include "tensor.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+namespace {
+    constexpr size_t iterations = 20;
+    constexpr uint32_t n = 1 << 26;
+    constexpr auto shape = GemmShape{2048, 2048, 2048};
+    // Rows of C that are verified against the CPU implementation.
+    constexpr uint32_t verify_rows = 32;
+
+    constexpr auto x_quantization = Quantization{.scale = 1.f / 127, .zero_point = 0};
+    constexpr auto y_quantization = Quantization{.scale = 1.f / 60, .zero_point = 5};
+
+    std::string_view type_name(ElementType type) {
+        switch (type) {
+            case ElementType::F32: return "fp32";
+            case ElementType::F16: return "fp16";
+            case ElementType::I8: return "int8";
+        }
+        return "";
+    }
+
+    // The values that the device operates on after converting `values` to `type`.
+    std::vector<float> representable(std::span<const float> values, ElementType type, Quantization quantization) {
+        switch (type) {
+            case ElementType::F32:
+                return {values.begin(), values.end()};
+            case ElementType::F16: {
+                auto result = std::vector<float>(values.size());
+                std::transform(values.begin(), values.end(), result.begin(), [](float x) { return half_to_float(float_to_half(x)); });
+                return result;
+            }
+            case ElementType::I8:
+                return dequantize_i8_reference(quantize_i8_reference(values, quantization), quantization);
+        }
+        return {};
+    }
+
+    // Converts fp32 values on the device into a new tensor of `type`.
+    Buffer to_device(Context& ctx, std::span<const float> values, ElementType type, Quantization quantization) {
+        auto src = upload_buffer<float>(ctx, values);
+        if (type == ElementType::F32)
+            return src;
+
+        auto count = static_cast<uint32_t>(values.size());
+        auto dst = create_device_buffer(ctx, div_ceil(count, elements_per_word(type)) * 4);
+        ctx.begin();
+        quantize(ctx, src, {dst, type, quantization}, count);
+        ctx.submit();
+        return dst;
+    }
+
+    std::vector<float> from_device(Context& ctx, const Buffer& buffer, uint32_t count, ElementType type, Quantization quantization) {
+        if (type == ElementType::F32)
+            return download_buffer<float>(buffer.view(0, count * sizeof(float)));
+
+        auto dst = create_device_buffer(ctx, count * sizeof(float));
+        ctx.begin();
+        dequantize(ctx, {buffer, type, quantization}, dst, count);
+        ctx.submit();
+        return download_buffer<float>(dst);
+    }
+}
+
+void bench_tensor(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+    fmt::print("packed fp16 math: {}\n", use_packed_fp16(ctx) ? "yes" : "no");
+
+    auto x = std::vector<float>(n);
+    auto y = std::vector<float>(n);
+    std::generate(x.begin(), x.end(), [&] { return value_dist(rng); });
+    std::generate(y.begin(), y.end(), [&] { return value_dist(rng); });
+
+    for (auto type : {ElementType::F32, ElementType::F16, ElementType::I8}) {
+        double bytes = double{n} / elements_per_word(type) * 4;
+        auto gpu_x = to_device(ctx, x, type, x_quantization);
+        auto gpu_y = to_device(ctx, y, type, y_quantization);
+        auto tx = TensorView{gpu_x, type, x_quantization};
+        auto ty = TensorView{gpu_y, type, y_quantization};
+
+        // Compare a single application, as repeated ones would quickly saturate the int8 range.
+        ctx.begin();
+        axpby(ctx, 0.5f, tx, 0.25f, ty, n);
+        ctx.submit();
+
+        auto rx = representable(x, type, x_quantization);
+        auto ry = representable(y, type, y_quantization);
+        auto expected = std::vector<float>(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            expected[i] = 0.5f * rx[i] + 0.25f * ry[i];
+        }
+        expected = representable(expected, type, y_quantization);
+        double error = max_error(expected, from_device(ctx, gpu_y, n, type, y_quantization));
+        // Results may round to a neighbouring representable value.
+        double tolerance = type == ElementType::F32 ? 1e-6 : type == ElementType::F16 ? 1e-3 : y_quantization.scale * 1.01;
+
+        double time = time_submissions(ctx, iterations, [&] {
+            axpby(ctx, 0.5f, tx, 0.25f, ty, n);
+        });
+        fmt::print("axpby {}: {:>8.3f} ms {:>8.2f} Gelem/s {:>8.2f} GB/s{}\n",
+            type_name(type), time * 1000, n / time * 1e-9, 3 * bytes / time * 1e-9, error > tolerance ? " MISMATCH" : "");
+
+        if (type == ElementType::F32)
+            continue;
+
+        auto gpu_src = upload_buffer<float>(ctx, x);
+        double quantize_time = time_submissions(ctx, iterations, [&] {
+            quantize(ctx, gpu_src, tx, n);
+        });
+        double dequantize_time = time_submissions(ctx, iterations, [&] {
+            dequantize(ctx, tx, gpu_src, n);
+        });
+        fmt::print("  quantize {:>8.3f} ms, dequantize {:>8.3f} ms ({:.2f} / {:.2f} Gelem/s)\n",
+            quantize_time * 1000, dequantize_time * 1000, n / quantize_time * 1e-9, n / dequantize_time * 1e-9);
+    }
+
+    auto a = std::vector<float>(size_t{shape.m} * shape.k);
+    auto b = std::vector<float>(size_t{shape.n} * shape.k);
+    std::generate(a.begin(), a.end(), [&] { return value_dist(rng); });
+    std::generate(b.begin(), b.end(), [&] { return value_dist(rng); });
+    auto c = create_device_buffer(ctx, size_t{shape.m} * shape.n * sizeof(float));
+
+    for (auto type : {ElementType::F32, ElementType::F16, ElementType::I8}) {
+        auto ta = TensorView{to_device(ctx, a, type, x_quantization), type, x_quantization};
+        auto tb = TensorView{to_device(ctx, b, type, y_quantization), type, y_quantization};
+
+        double time = time_submissions(ctx, iterations, [&] {
+            gemm(ctx, ta, tb, c, shape);
+        });
+
+        auto ra = representable(a, type, x_quantization);
+        auto rb = representable(b, type, y_quantization);
+        auto expected = gemm_reference(std::span(ra).first(verify_rows * shape.k), rb, {verify_rows, shape.n, shape.k});
+        auto actual = download_buffer<float>(c.view(0, expected.size() * sizeof(float)));
+        double error = max_error(expected, actual);
+        // Packed fp16 arithmetic accumulates partial sums in fp16.
+        double tolerance = type == ElementType::F16 && use_packed_fp16(ctx) ? 5e-2 : 1e-3;
+
+        fmt::print("gemm {}x{}x{} {}: {:>8.3f} ms {:>8.2f} GFLOP/s  max error {:.2e}{}\n",
+            shape.m, shape.n, shape.k, type_name(type), time * 1000, 2.0 * shape.m * shape.n * shape.k / time * 1e-9,
+            error, error > tolerance ? " MISMATCH" : "");
+    }
+}
@@ -0,0 +1,90 @@
+#include "bench.hpp"
+#include "topk.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+namespace {
+    constexpr size_t iterations = 10;
+    constexpr uint32_t n = 1 << 24;
+    constexpr uint32_t segments = 4096;
+
+    // Ties may be resolved differently, so only compare values, and check that indices point
+    // to the right values.
+    bool topk_matches(std::span<const float> values, std::span<const TopKEntry> expected, std::span<const TopKEntry> actual) {
+        if (expected.size() != actual.size())
+            return false;
+
+        for (size_t i = 0; i < expected.size(); ++i) {
+            if (expected[i].value != actual[i].value)
+                return false;
+            if (actual[i].index != 0xFFFFFFFF && values[actual[i].index] != actual[i].value)
+                return false;
+        }
+        return true;
+    }
+}
+
+void bench_topk(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::normal_distribution<float>(0, 1);
+
+    auto values = std::vector<float>(n);
+    std::generate(values.begin(), values.end(), [&] { return value_dist(rng); });
+    auto gpu_values = upload_buffer<float>(ctx, values);
+
+    double sort_time = time_cpu(1, [&] {
+        auto sorted = values;
+        std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+    });
+    fmt::print("{} elements, cpu full sort {:.3f} ms\n", n, sort_time * 1000);
+
+    for (uint32_t k : {16u, 256u, 1000u, 100000u}) {
+        auto plan = create_topk_plan(ctx, n, k);
+
+        std::vector<TopKEntry> expected;
+        double cpu_time = time_cpu(1, [&] {
+            expected = topk_reference(values, k);
+        });
+
+        fmt::print("k = {}: cpu nth_element {:.3f} ms\n", k, cpu_time * 1000);
+
+        auto run = [&](std::string_view name, auto algorithm) {
+            double time = time_submissions(ctx, iterations, [&] {
+                algorithm(ctx, plan, gpu_values, n);
+            });
+            bool ok = topk_matches(values, expected, read_topk(plan));
+            fmt::print("  {:<8} {:>8.3f} ms ({:.2f} Gelem/s){}\n", name, time * 1000, n / time * 1e-9, ok ? "" : " MISMATCH");
+        };
+
+        run("radix", topk_radix);
+        if (k <= topk_max_bitonic_k)
+            run("bitonic", topk_bitonic);
+    }
+
+    // Batched queries of varying length.
+    auto length_dist = std::uniform_int_distribution<uint32_t>(0, 2 * n / segments);
+    auto offsets = std::vector<uint32_t>{0};
+    for (uint32_t s = 0; s < segments; ++s) {
+        offsets.push_back(std::min(offsets.back() + length_dist(rng), n));
+    }
+    auto gpu_offsets = upload_buffer<uint32_t>(ctx, offsets);
+
+    for (uint32_t k : {16u, 128u}) {
+        auto plan = create_topk_plan(ctx, n, k, segments);
+
+        std::vector<TopKEntry> expected;
+        double cpu_time = time_cpu(1, [&] {
+            expected = topk_segmented_reference(values, offsets, k);
+        });
+        double gpu_time = time_submissions(ctx, iterations, [&] {
+            topk_segmented(ctx, plan, gpu_values, gpu_offsets);
+        });
+        bool ok = topk_matches(values, expected, read_topk(plan));
+        fmt::print("segmented, {} segments, k = {}: cpu {:.3f} ms, gpu {:.3f} ms{}\n",
+            segments, k, cpu_time * 1000, gpu_time * 1000, ok ? "" : " MISMATCH");
+    }
+}
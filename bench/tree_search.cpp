@@ -0,0 +1,39 @@
+#include "bench.hpp"
+#include "tree_search.hpp"
+
+#include <fmt/format.h>
+
+namespace {
+    constexpr size_t iterations = 10;
+    constexpr uint32_t queue_capacity = 1 << 20;
+}
+
+void bench_tree_search(Context& ctx) {
+    auto plan = create_uts_plan(ctx, queue_capacity);
+    fmt::print("{} persistent workgroups, queue of {} tasks\n", plan.groups, queue_capacity);
+
+    // The parameters of T3 from the UTS suite (with a different hash, so not the same tree), a
+    // variant closer to the critical q * m = 1, and a deep binary tree.
+    const UtsTree trees[] = {
+        {.seed = 42, .root_children = 2000, .children = 8, .q = 0.124875},
+        {.seed = 42, .root_children = 2000, .children = 8, .q = 0.1249},
+        {.seed = 7, .root_children = 500, .children = 2, .q = 0.4999},
+    };
+
+    for (const auto& tree : trees) {
+        UtsResult expected;
+        double cpu_time = time_cpu(1, [&] {
+            expected = uts_reference(tree);
+        });
+
+        double gpu_time = time_submissions(ctx, iterations, [&] {
+            uts(ctx, plan, tree);
+        });
+        auto result = read_uts(plan);
+        auto pushed = read_work_queue(plan.queue).pushed;
+
+        fmt::print("b0 = {}, m = {}, q = {}: {} nodes, depth {}, {} tasks: cpu {:>8.3f} ms, gpu {:>8.3f} ms ({:.1f} Mnodes/s){}\n",
+            tree.root_children, tree.children, tree.q, expected.nodes, expected.max_depth, pushed, cpu_time * 1000,
+            gpu_time * 1000, expected.nodes / gpu_time * 1e-6, result == expected ? "" : " MISMATCH");
+    }
+}
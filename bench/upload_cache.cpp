@@ -0,0 +1,145 @@
+#include "bench.hpp"
+#include "tensor.hpp"
+#include "upload_cache.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace {
+    constexpr uint32_t jobs = 32;
+    constexpr uint32_t n = 1 << 23;
+    // Every job reads two arrays that the previous jobs did not, so nothing is resident unless
+    // it was prefetched.
+    constexpr uint32_t n_arrays = 16;
+    constexpr auto shape = GemmShape{2048, 2048, 1024};
+
+    struct Job {
+        HostArray x;
+        HostArray y;
+    };
+}
+
+void bench_upload_cache(Context& ctx) {
+    auto rng = std::mt19937(0);
+    auto value_dist = std::uniform_real_distribution<float>(-1, 1);
+
+    auto arrays = std::vector<std::vector<float>>(n_arrays, std::vector<float>(n));
+    for (auto& array : arrays) {
+        std::generate(array.begin(), array.end(), [&] { return value_dist(rng); });
+    }
+
+    auto job_inputs = [&](uint32_t job) {
+        const auto& x = arrays[(2 * job) % n_arrays];
+        const auto& y = arrays[(2 * job + 1) % n_arrays];
+        return Job{
+            .x = {x.data(), x.size() * sizeof(float)},
+            .y = {y.data(), y.size() * sizeof(float)},
+        };
+    };
+
+    // Besides combining its inputs, every job runs a gemm, which stands in for the compute that
+    // prefetches overlap with.
+    auto weights = std::vector<float>(shape.m * shape.k);
+    std::generate(weights.begin(), weights.end(), [&] { return value_dist(rng); });
+    auto a = upload_buffer<float>(ctx, weights);
+    auto c = create_device_buffer(ctx, shape.m * shape.n * sizeof(float));
+    auto output = create_device_buffer(ctx, n * sizeof(float));
+
+    auto record_job = [&](BufferView x, BufferView y) {
+        gemm(ctx, {a, ElementType::F32}, {a, ElementType::F32}, c, shape);
+        copy(ctx, y, output);
+        barrier(ctx);
+        axpby(ctx, 1, {x, ElementType::F32}, 2, {output, ElementType::F32}, n);
+    };
+
+    auto verify = [&] {
+        auto inputs = job_inputs(jobs - 1);
+        const auto* x = static_cast<const float*>(inputs.x.data);
+        const auto* y = static_cast<const float*>(inputs.y.data);
+        auto expected = std::vector<float>(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            expected[i] = x[i] + 2 * y[i];
+        }
+        return max_error(expected, download_buffer<float>(output)) < 1e-5 ? "" : " MISMATCH";
+    };
+
+    auto capacity = Pal::gpusize{6} * n * sizeof(float);
+    auto report = [&](const char* name, double time, const UploadCache& cache) {
+        fmt::print("{:<12} {:>8.3f} ms per job, {} hits, {} misses, {} prefetched, {:.1f} GB uploaded{}\n",
+            name, time * 1000, cache.stats.hits, cache.stats.misses, cache.stats.prefetched,
+            cache.stats.uploaded_bytes / 1e9, verify());
+    };
+
+    // Warm up the pipelines.
+    auto zero = create_device_buffer(ctx, n * sizeof(float));
+    ctx.begin();
+    fill(ctx, zero, 0);
+    barrier(ctx);
+    record_job(zero, zero);
+    ctx.submit();
+
+    {
+        auto cache = create_upload_cache(ctx, capacity);
+        double time = time_cpu(1, [&] {
+            for (uint32_t job = 0; job < jobs; ++job) {
+                begin_job(cache);
+                auto inputs = job_inputs(job);
+                auto x = acquire(ctx, cache, inputs.x);
+                auto y = acquire(ctx, cache, inputs.y);
+                ctx.begin();
+                record_job(x, y);
+                ctx.submit();
+            }
+        });
+        report("on demand", time / jobs, cache);
+    }
+
+    {
+        auto cache = create_upload_cache(ctx, capacity);
+        double time = time_cpu(1, [&] {
+            for (uint32_t job = 0; job < jobs; ++job) {
+                begin_job(cache);
+                auto inputs = job_inputs(job);
+                auto x = acquire(ctx, cache, inputs.x);
+                auto y = acquire(ctx, cache, inputs.y);
+                ctx.begin();
+                record_job(x, y);
+                ctx.submit_async();
+
+                if (job + 1 < jobs) {
+                    auto next = job_inputs(job + 1);
+                    HostArray next_arrays[] = {next.x, next.y};
+                    prefetch(ctx, cache, next_arrays);
+                }
+                ctx.wait();
+            }
+        });
+        report("prefetched", time / jobs, cache);
+    }
+
+    // A prefetch into a full cache, of arrays of which some are resident already: only the others
+    // may be evicted to make room.
+    {
+        auto cache = create_upload_cache(ctx, Pal::gpusize{2} * n * sizeof(float));
+        auto first = job_inputs(0);
+        auto second = job_inputs(1);
+        begin_job(cache);
+        acquire(ctx, cache, first.x);
+        acquire(ctx, cache, first.y);
+
+        begin_job(cache);
+        HostArray mixed[] = {second.x, first.x, second.y, first.y};
+        prefetch(ctx, cache, mixed);
+        bool ok = true;
+        for (const auto& array : mixed) {
+            auto view = acquire(ctx, cache, array);
+            const auto* data = static_cast<const float*>(array.data);
+            ok = ok && download_buffer<float>(view) == std::vector<float>(data, data + n);
+        }
+        fmt::print("mixed prefetch: {} prefetched, {} hits, {} misses{}\n", cache.stats.prefetched, cache.stats.hits,
+            cache.stats.misses, ok && cache.stats.prefetched == 2 && cache.stats.hits == 4 ? "" : " MISMATCH");
+    }
+}
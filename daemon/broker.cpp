@@ -0,0 +1,1043 @@
+#include "broker.hpp"
+#include "aggregate.hpp"
+#include "tensor.hpp"
+
+#include <fmt/format.h>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <optional>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+    [[noreturn]] void throw_errno(const char* what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    Pal::gpusize alignment(const Context& ctx) {
+        return std::max<Pal::gpusize>(ctx.props.gpuMemoryProperties.realMemAllocGranularity, sysconf(_SC_PAGESIZE));
+    }
+
+    // The reply succeeds if `error` is empty, and fails with `status` otherwise.
+    ReplyMessage make_reply(MessageType type, const std::string& error, ReplyStatus status = ReplyStatus::Failed) {
+        auto reply = ReplyMessage{};
+        reply.type = type;
+        reply.status = error.empty() ? ReplyStatus::Ok : status;
+        std::memcpy(reply.error, error.data(), std::min(error.size(), sizeof(reply.error) - 1));
+        return reply;
+    }
+
+    void send_reply(const Broker& broker, BrokerConnection& connection, ReplyMessage reply) {
+        reply.queued_jobs = broker.queued_jobs;
+        // A client that went away is noticed and dropped by the next poll.
+        try {
+            send_packet(connection.socket.fd, &reply, sizeof(reply));
+        } catch (const std::system_error&) {
+        }
+    }
+
+    Tenant& find_tenant(Broker& broker, const std::string& name) {
+        auto it = broker.tenants.find(name);
+        if (it != broker.tenants.end())
+            return *it->second;
+
+        auto config = broker.options.default_tenant;
+        for (const auto& tenant : broker.options.tenants) {
+            if (tenant.name == name)
+                config = tenant;
+        }
+
+        return *broker.tenants.emplace(name, std::unique_ptr<Tenant>(new Tenant{
+            .name = name,
+            .weight = std::max(config.weight, 1u),
+            .quota = config.quota,
+            .memory = 0,
+            .virtual_time = broker.virtual_time,
+            .average_cost = 0,
+            .stats = {},
+        })).first->second;
+    }
+
+    bool lists_user(const TenantConfig& config, uid_t user) {
+        return std::find(config.users.begin(), config.users.end(), user) != config.users.end();
+    }
+
+    // Whether connections of `user` may belong to the tenant, see BrokerOptions::tenants.
+    bool allows_user(const TenantConfig& config, uid_t user) {
+        return config.users.empty() ? user == geteuid() : lists_user(config, user);
+    }
+
+    // Cost assumed for the jobs of tenants without history, in seconds.
+    constexpr double initial_cost = 100e-6;
+    // Weight of the newest job in Tenant::average_cost.
+    constexpr double cost_smoothing = 0.125;
+
+    double estimated_cost(const Tenant& tenant) {
+        return tenant.stats.jobs > 0 ? tenant.average_cost : initial_cost;
+    }
+
+    bool is_job(const BrokerConnection::Request& request) {
+        return !request.release && request.status == ReplyStatus::Ok;
+    }
+
+    bool has_jobs(const BrokerConnection& connection) {
+        return std::any_of(connection.pending.begin(), connection.pending.end(), is_job);
+    }
+
+    bool is_busy(const Broker& broker, const Tenant* tenant) {
+        return std::any_of(broker.connections.begin(), broker.connections.end(), [&](const auto& connection) {
+            return connection->tenant == tenant && has_jobs(*connection);
+        });
+    }
+
+    void drop_buffer(BrokerConnection& connection, uint32_t id) {
+        auto it = connection.buffers.find(id);
+        if (it == connection.buffers.end())
+            return;
+        connection.tenant->memory -= it->second->mapping.size;
+        connection.buffers.erase(it);
+    }
+
+    // Moves the connection to another tenant. Only allowed before it has buffers or jobs, which
+    // are accounted to the tenant, and only to a configured tenant that allows the connection's user.
+    bool identify(Broker& broker, BrokerConnection& connection, const IdentifyMessage& message) {
+        if (!connection.buffers.empty() || !connection.pending.empty()) {
+            fmt::print(stderr, "Dropping client: Identify after other requests\n");
+            return false;
+        }
+
+        auto name = std::string(message.tenant, strnlen(message.tenant, sizeof(message.tenant)));
+        const auto& tenants = broker.options.tenants;
+        auto config = std::find_if(tenants.begin(), tenants.end(), [&](const TenantConfig& tenant) { return tenant.name == name; });
+        if (config == tenants.end() || !allows_user(*config, connection.user)) {
+            fmt::print(stderr, "Dropping client: user {} may not identify as tenant '{}'\n", connection.user, name);
+            return false;
+        }
+
+        connection.tenant = &find_tenant(broker, name);
+        return true;
+    }
+
+    // Size of the shared buffers of all clients.
+    Pal::gpusize committed_memory(const Broker& broker) {
+        Pal::gpusize memory = 0;
+        for (const auto& [name, tenant] : broker.tenants) {
+            memory += tenant->memory;
+        }
+        return memory;
+    }
+
+    void register_buffer(Broker& broker, BrokerConnection& connection, const RegisterBufferMessage& message, FileDescriptor memfd) {
+        auto error = std::string();
+        auto status = ReplyStatus::Failed;
+        auto id = connection.next_buffer;
+        auto& tenant = *connection.tenant;
+        auto max_memory = broker.options.max_memory;
+        auto memory = committed_memory(broker);
+        struct stat info;
+        if (memfd.fd < 0) {
+            error = "RegisterBuffer without a memfd";
+        } else if (tenant.quota != 0 && message.size > tenant.quota - std::min(tenant.memory, tenant.quota)) {
+            error = fmt::format("Memory quota of tenant '{}' exceeded: {} of {} bytes in use", tenant.name, tenant.memory, tenant.quota);
+        } else if (max_memory != 0 && message.size > max_memory - std::min(memory, max_memory)) {
+            error = fmt::format("Daemon memory limit exceeded: {} of {} bytes in use", memory, max_memory);
+            status = ReplyStatus::MemoryFull;
+        } else if (message.size == 0 || message.size % alignment(broker.ctx) != 0) {
+            error = fmt::format("Shared buffer size must be a multiple of {}", alignment(broker.ctx));
+        } else if (fstat(memfd.fd, &info) < 0 || static_cast<uint64_t>(info.st_size) < message.size) {
+            error = "Shared buffer is larger than its memfd";
+        } else {
+            void* data = mmap(nullptr, message.size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd.fd, 0);
+            if (data == MAP_FAILED) {
+                error = fmt::format("Failed to map shared buffer: {}", std::strerror(errno));
+            } else {
+                try {
+                    connection.buffers.emplace(id, new SharedMapping{
+                        .mapping = {static_cast<std::byte*>(data), message.size},
+                        .pinned = create_pinned_memory(broker.ctx.device, data, message.size),
+                        .released = false,
+                    });
+                    ++connection.next_buffer;
+                    tenant.memory += message.size;
+                } catch (const PalError& e) {
+                    error = fmt::format("Failed to pin shared buffer: error {}", static_cast<int>(e.result));
+                }
+            }
+        }
+
+        auto reply = make_reply(MessageType::BufferRegistered, error, status);
+        reply.buffer = id;
+        send_reply(broker, connection, reply);
+    }
+
+    void release_buffer(BrokerConnection& connection, uint32_t id) {
+        auto it = connection.buffers.find(id);
+        if (it == connection.buffers.end())
+            return;
+
+        if (connection.pending.empty()) {
+            drop_buffer(connection, id);
+        } else {
+            it->second->released = true;
+            connection.pending.push_back({
+                .release = true,
+                .buffer = id,
+                .submit = {},
+                .arrival = {},
+                .cost = 0,
+                .status = ReplyStatus::Ok,
+                .error = {},
+                .running = false,
+                .cancel_requested = false,
+            });
+        }
+    }
+
+    // Releases the buffers and replies to the refused jobs that are next in line, so that the next
+    // pending request, if any, is a job to run.
+    void settle_front(const Broker& broker, BrokerConnection& connection) {
+        while (!connection.pending.empty()) {
+            const auto& request = connection.pending.front();
+            if (request.release) {
+                drop_buffer(connection, request.buffer);
+            } else if (request.status != ReplyStatus::Ok) {
+                auto reply = make_reply(MessageType::JobDone, request.error, request.status);
+                reply.job = request.submit.job;
+                send_reply(broker, connection, reply);
+            } else {
+                break;
+            }
+            connection.pending.pop_front();
+        }
+    }
+
+    // Fails a job without running it. The reply waits for the connection's earlier jobs.
+    void refuse(Broker& broker, BrokerConnection& connection, const SubmitMessage& message, ReplyStatus status, std::string error) {
+        connection.pending.push_back({
+            .release = false,
+            .buffer = 0,
+            .submit = message,
+            .arrival = std::chrono::steady_clock::now(),
+            .cost = 0,
+            .status = status,
+            .error = std::move(error),
+            .running = false,
+            .cancel_requested = false,
+        });
+        settle_front(broker, connection);
+    }
+
+    // Removes an admitted job from the queue totals, once it completed or was shed.
+    void dequeue(Broker& broker, const BrokerConnection::Request& request) {
+        --broker.queued_jobs;
+        // Reset rather than subtract the last estimate, so that rounding errors do not accumulate.
+        broker.queued_time = broker.queued_jobs == 0 ? 0 : broker.queued_time - request.cost;
+    }
+
+    // Whether a job of estimated cost `cost` fits in the queue limits.
+    bool admits(const Broker& broker, double cost) {
+        const auto& options = broker.options;
+        if (broker.queued_jobs == 0)
+            return true;
+        else if (options.max_queued_jobs != 0 && broker.queued_jobs >= options.max_queued_jobs)
+            return false;
+
+        auto max_time = std::chrono::duration<double>(options.max_queued_time).count();
+        return max_time == 0 || broker.queued_time + cost <= max_time;
+    }
+
+    // Whether requests should be left unread, see AdmissionPolicy::Block.
+    bool is_blocked(const Broker& broker) {
+        return broker.options.admission == AdmissionPolicy::Block && !admits(broker, 0);
+    }
+
+    // Sheds the newest queued job of the tenant with the lowest weight, if that is below `weight`.
+    // Returns false if there is no such job.
+    bool shed_job(Broker& broker, uint32_t weight) {
+        BrokerConnection* victim = nullptr;
+        BrokerConnection::Request* request = nullptr;
+        for (auto& connection : broker.connections) {
+            const auto* tenant = connection->tenant;
+            if (tenant->weight >= weight)
+                continue;
+            for (auto& candidate : connection->pending) {
+                // Jobs of a batch, including a stalled one, are no longer queued.
+                if (!is_job(candidate) || candidate.running)
+                    continue;
+                bool better = !request
+                    || tenant->weight < victim->tenant->weight
+                    || (tenant->weight == victim->tenant->weight && candidate.arrival > request->arrival);
+                if (better) {
+                    victim = connection.get();
+                    request = &candidate;
+                }
+            }
+        }
+
+        if (!request)
+            return false;
+
+        dequeue(broker, *request);
+        request->status = ReplyStatus::Shed;
+        request->error = "Shed to make room for a tenant with a higher weight";
+        ++broker.stats.shed_jobs;
+        ++victim->tenant->stats.refused_jobs;
+        settle_front(broker, *victim);
+        return true;
+    }
+
+    std::string validate(const BrokerConnection& connection, const SubmitMessage& message) {
+        if (message.command_count > max_job_commands)
+            return "Too many commands";
+
+        for (uint32_t i = 0; i < message.command_count; ++i) {
+            const auto& command = message.commands[i];
+            if (command.operand_count > max_command_operands)
+                return fmt::format("Command {}: too many operands", i);
+
+            for (uint32_t j = 0; j < command.operand_count; ++j) {
+                const auto& operand = command.operands[j];
+                auto it = connection.buffers.find(operand.buffer);
+                if (it == connection.buffers.end() || it->second->released)
+                    return fmt::format("Command {}: unknown buffer {}", i, operand.buffer);
+                else if (operand.offset % 4 != 0 || operand.size % 4 != 0)
+                    return fmt::format("Command {}: operand {} is not 4-byte aligned", i, j);
+                else if (operand.offset > it->second->mapping.size || operand.size > it->second->mapping.size - operand.offset)
+                    return fmt::format("Command {}: operand {} is out of bounds", i, j);
+            }
+
+            auto operand_size = [&](uint32_t j) { return command.operands[j].size; };
+            auto floats = [](uint64_t count) { return count * sizeof(float); };
+            bool valid = true;
+            switch (command.type) {
+                case CommandType::Fill:
+                    valid = command.operand_count == 1;
+                    break;
+                case CommandType::Copy:
+                    valid = command.operand_count == 2 && operand_size(1) >= operand_size(0);
+                    break;
+                case CommandType::Axpby:
+                    valid = command.operand_count == 2
+                        && operand_size(0) >= floats(command.counts[0])
+                        && operand_size(1) >= floats(command.counts[0]);
+                    break;
+                case CommandType::Gemm:
+                    valid = command.operand_count == 3
+                        && operand_size(0) >= floats(uint64_t{command.counts[0]} * command.counts[2])
+                        && operand_size(1) >= floats(uint64_t{command.counts[1]} * command.counts[2])
+                        && operand_size(2) >= floats(uint64_t{command.counts[0]} * command.counts[1]);
+                    break;
+                case CommandType::Histogram:
+                    valid = command.operand_count == 2
+                        && operand_size(0) >= floats(command.counts[0])
+                        && operand_size(1) >= floats(command.counts[1]);
+                    break;
+                default:
+                    return fmt::format("Command {}: unknown command type", i);
+            }
+
+            if (!valid)
+                return fmt::format("Command {}: wrong operands for its type", i);
+        }
+
+        return "";
+    }
+
+    void record_command(Context& ctx, const BrokerConnection& connection, const Command& command) {
+        auto operand = [&](uint32_t j) {
+            return connection.buffers.at(command.operands[j].buffer)->view(command.operands[j]);
+        };
+
+        switch (command.type) {
+            case CommandType::Fill:
+                fill(ctx, operand(0), command.value);
+                break;
+            case CommandType::Copy:
+                copy(ctx, operand(0), operand(1));
+                break;
+            case CommandType::Axpby:
+                axpby(ctx, command.scalars[0], {operand(0), ElementType::F32}, command.scalars[1], {operand(1), ElementType::F32}, command.counts[0]);
+                break;
+            case CommandType::Gemm:
+                gemm(
+                    ctx,
+                    {operand(0), ElementType::F32},
+                    {operand(1), ElementType::F32},
+                    operand(2),
+                    {command.counts[0], command.counts[1], command.counts[2]},
+                    command.scalars[0]
+                );
+                break;
+            case CommandType::Histogram:
+                histogram(ctx, operand(0), command.counts[0], operand(1), command.counts[1]);
+                break;
+        }
+    }
+
+    void submit(Broker& broker, BrokerConnection& connection, const SubmitMessage& message) {
+        auto error = validate(connection, message);
+        if (!error.empty()) {
+            refuse(broker, connection, message, ReplyStatus::Failed, std::move(error));
+            ++broker.stats.failed_jobs;
+            return;
+        }
+
+        // Under AdmissionPolicy::Block, requests are only read while the queue has room.
+        auto& tenant = *connection.tenant;
+        auto cost = estimated_cost(tenant);
+        if (broker.options.admission == AdmissionPolicy::Shed) {
+            while (!admits(broker, cost) && shed_job(broker, tenant.weight)) {
+            }
+        }
+        if (broker.options.admission != AdmissionPolicy::Block && !admits(broker, cost)) {
+            auto reason = fmt::format("Queue full: {} jobs, {:.3f} ms of GPU time queued", broker.queued_jobs, broker.queued_time * 1000);
+            refuse(broker, connection, message, ReplyStatus::QueueFull, std::move(reason));
+            ++broker.stats.rejected_jobs;
+            ++tenant.stats.refused_jobs;
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::none_of(broker.connections.begin(), broker.connections.end(), [](const auto& c) { return has_jobs(*c); }))
+            broker.batch_start = now;
+        if (!is_busy(broker, &tenant))
+            tenant.virtual_time = std::max(tenant.virtual_time, broker.virtual_time);
+        connection.pending.push_back({
+            .release = false,
+            .buffer = 0,
+            .submit = message,
+            .arrival = now,
+            .cost = cost,
+            .status = ReplyStatus::Ok,
+            .error = {},
+            .running = false,
+            .cancel_requested = false,
+        });
+        ++broker.queued_jobs;
+        broker.queued_time += cost;
+    }
+
+    // Drops a job that is still queued. Jobs that are running are only flagged, and stop at the next
+    // slice, if dispatches are sliced.
+    void cancel_job(Broker& broker, BrokerConnection& connection, uint64_t job) {
+        auto it = std::find_if(connection.pending.begin(), connection.pending.end(), [&](const auto& request) {
+            return is_job(request) && request.submit.job == job;
+        });
+        if (it == connection.pending.end())
+            return;
+
+        if (it->running) {
+            it->cancel_requested = true;
+            return;
+        }
+
+        dequeue(broker, *it);
+        it->status = ReplyStatus::Cancelled;
+        it->error = "Job cancelled";
+        ++broker.stats.cancelled_jobs;
+        // Releases that were waiting for the job take effect right away if it was next in line.
+        settle_front(broker, connection);
+    }
+
+    // Handles the Cancel messages at the head of every connection's socket, and leaves any other
+    // request for the next poll. This runs between the slices of a batch, while the jobs of the
+    // batch must stay where they are.
+    void receive_cancels(Broker& broker) {
+        for (auto& connection : broker.connections) {
+            auto type = MessageType{};
+            while (recv(connection->socket.fd, &type, sizeof(type), MSG_PEEK | MSG_DONTWAIT) == sizeof(type) && type == MessageType::Cancel) {
+                auto message = CancelMessage{};
+                try {
+                    if (receive_packet(connection->socket.fd, &message, sizeof(message), nullptr, MSG_DONTWAIT) != sizeof(message))
+                        break;
+                } catch (const std::exception&) {
+                    break;
+                }
+                cancel_job(broker, *connection, message.job);
+            }
+        }
+    }
+
+    // How often the fence of a stalled batch is checked.
+    constexpr auto stall_poll_interval = std::chrono::milliseconds(1);
+
+    // Handles all messages that are waiting on the connection. Returns false if the client hung up
+    // or misbehaved, in which case the connection should be dropped.
+    bool receive(Broker& broker, BrokerConnection& connection) {
+        union {
+            MessageType type;
+            IdentifyMessage identify;
+            RegisterBufferMessage register_buffer;
+            ReleaseBufferMessage release_buffer;
+            SubmitMessage submit;
+            CancelMessage cancel;
+        } message;
+
+        while (!is_blocked(broker)) {
+            auto memfd = FileDescriptor();
+            ssize_t size;
+            try {
+                size = receive_packet(connection.socket.fd, &message, sizeof(message), &memfd, MSG_DONTWAIT);
+            } catch (const std::exception& e) {
+                fmt::print(stderr, "Dropping client: {}\n", e.what());
+                return false;
+            }
+
+            if (size < 0)
+                return true;
+            else if (size == 0)
+                return false;
+
+            auto expect = [&](size_t expected) {
+                if (static_cast<size_t>(size) != expected)
+                    fmt::print(stderr, "Dropping client: malformed message\n");
+                return static_cast<size_t>(size) == expected;
+            };
+
+            switch (message.type) {
+                case MessageType::Identify:
+                    if (!expect(sizeof(IdentifyMessage)) || !identify(broker, connection, message.identify))
+                        return false;
+                    break;
+                case MessageType::RegisterBuffer:
+                    if (!expect(sizeof(RegisterBufferMessage)))
+                        return false;
+                    register_buffer(broker, connection, message.register_buffer, std::move(memfd));
+                    break;
+                case MessageType::ReleaseBuffer:
+                    if (!expect(sizeof(ReleaseBufferMessage)))
+                        return false;
+                    release_buffer(connection, message.release_buffer.buffer);
+                    break;
+                case MessageType::Submit:
+                    if (!expect(sizeof(SubmitMessage)))
+                        return false;
+                    submit(broker, connection, message.submit);
+                    break;
+                case MessageType::Cancel:
+                    if (!expect(sizeof(CancelMessage)))
+                        return false;
+                    cancel_job(broker, connection, message.cancel.job);
+                    break;
+                default:
+                    fmt::print(stderr, "Dropping client: unexpected message\n");
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Host readable, and mapped into `data`.
+    Unique<Pal::IGpuMemory> create_timestamps(Context& ctx, uint32_t max_batch, const uint64_t*& data) {
+        auto timestamps = create_buffer(ctx.device, (max_batch + 1) * sizeof(uint64_t), Pal::VaRange::Default, Pal::GpuHeapGartCacheable);
+        void* mapped;
+        checkResult(timestamps->Map(&mapped));
+        data = static_cast<const uint64_t*>(mapped);
+        return timestamps;
+    }
+
+    // Rebuilds the context after the device was lost. Shared buffers live in client memory, so
+    // they keep their contents and only need to be pinned again. Jobs that were on the device have
+    // failed by then; the clients decide whether to submit them again.
+    void recover_device(Broker& broker) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto& connection : broker.connections) {
+            for (auto& [id, buffer] : connection->buffers) {
+                buffer->pinned = {};
+            }
+        }
+        broker.timestamps = {};
+
+        auto stats = recover_context(broker.ctx);
+        for (auto& connection : broker.connections) {
+            for (auto& [id, buffer] : connection->buffers) {
+                buffer->pinned = create_pinned_memory(broker.ctx.device, buffer->mapping.data, buffer->mapping.size);
+            }
+        }
+        broker.timestamps = create_timestamps(broker.ctx, broker.options.max_batch, broker.timestamp_data);
+        ++broker.stats.recoveries;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fmt::print(stderr, "Recovered from device loss in {:.3f} ms ({}, {} pipelines in {:.3f} ms)\n",
+            elapsed * 1000, stats.reused_device ? "device reinitialized" : "new platform", stats.pipeline_count, stats.pipelines * 1000);
+    }
+
+    // Charges a job of a batch to its tenant, and updates the tenant's metrics.
+    void charge_job(Tenant& tenant, const BrokerConnection::Request& request, double gpu_time, std::chrono::steady_clock::time_point now) {
+        tenant.virtual_time += gpu_time / tenant.weight;
+        tenant.stats.gpu_time += gpu_time;
+        ++tenant.stats.jobs;
+
+        double latency = std::chrono::duration<double>(now - request.arrival).count();
+        if (tenant.stats.latencies.size() < max_tenant_latencies) {
+            tenant.stats.latencies.push_back(latency);
+        } else {
+            tenant.stats.latencies[tenant.stats.next_latency] = latency;
+            tenant.stats.next_latency = (tenant.stats.next_latency + 1) % max_tenant_latencies;
+        }
+    }
+
+    // Removes the jobs of a batch from their connections, once the device is done with them.
+    void retire_batch(Broker& broker, const std::vector<BatchJob>& jobs) {
+        for (const auto& job : jobs) {
+            dequeue(broker, *job.request);
+            job.connection->pending.pop_front();
+            settle_front(broker, *job.connection);
+        }
+    }
+
+    // Picks the jobs of the next batch by weighted fair queueing, and records them into one
+    // submission with a timestamp after each, so that every tenant can be charged the GPU time of
+    // its own jobs. The jobs run one after another for that, rather than interleaved.
+    //
+    // While the batch is being filled, tenants are charged their estimated cost, so that a tenant
+    // does not get all the slots of a batch just because it is behind. Once the timestamps are in,
+    // the estimate is replaced by the measured cost.
+    void run_batch(Broker& broker) {
+        if (!broker.stalled.empty())
+            return;
+
+        // Every connection contributes at most its oldest job, so that jobs of one connection run
+        // in order.
+        auto candidates = std::vector<BatchJob>();
+        for (auto& connection : broker.connections) {
+            settle_front(broker, *connection);
+            if (!connection->pending.empty())
+                candidates.push_back({connection.get(), &connection->pending.front()});
+        }
+
+        auto tentative = std::unordered_map<const Tenant*, double>();
+        for (const auto& candidate : candidates) {
+            tentative[candidate.connection->tenant] = candidate.connection->tenant->virtual_time;
+        }
+
+        auto jobs = std::vector<BatchJob>();
+        double budget = std::chrono::duration<double>(broker.options.batch_budget).count();
+        while (!candidates.empty() && jobs.size() < broker.options.max_batch) {
+            // The tenant furthest behind goes first, and within a tenant the oldest job.
+            auto next = std::min_element(candidates.begin(), candidates.end(), [&](const BatchJob& a, const BatchJob& b) {
+                auto va = tentative[a.connection->tenant];
+                auto vb = tentative[b.connection->tenant];
+                return va != vb ? va < vb : a.request->arrival < b.request->arrival;
+            });
+
+            auto& tenant = *next->connection->tenant;
+            if (!jobs.empty() && estimated_cost(tenant) > budget)
+                break;
+
+            budget -= estimated_cost(tenant);
+            tentative[&tenant] += estimated_cost(tenant) / tenant.weight;
+            broker.virtual_time = std::max(broker.virtual_time, tenant.virtual_time);
+            next->request->running = true;
+            jobs.push_back(*next);
+            candidates.erase(next);
+        }
+
+        if (jobs.empty())
+            return;
+
+        // Cancellations of the running job take effect between its slices, and the timeout applies
+        // to every slice as well as to the whole batch.
+        size_t current = 0;
+        bool timed = broker.options.job_timeout.count() > 0;
+        auto deadline = std::chrono::steady_clock::now() + broker.options.job_timeout;
+        if (broker.ctx.slicing) {
+            broker.ctx.slicing->cancelled = [&] {
+                receive_cancels(broker);
+                return jobs[current].request->cancel_requested;
+            };
+            if (timed)
+                broker.ctx.slicing->deadline = deadline;
+        }
+
+        auto error = std::string();
+        auto cancelled = std::vector<bool>(jobs.size(), false);
+        bool completed = true;
+        bool lost = false;
+        try {
+            broker.ctx.begin();
+            write_timestamp(broker.ctx, {broker.timestamps.ptr, 0, sizeof(uint64_t)});
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                current = i;
+                const auto& request = *jobs[i].request;
+                try {
+                    // Cancelled while an earlier job of the batch ran.
+                    if (request.cancel_requested)
+                        throw CancelledError("Job cancelled");
+                    for (uint32_t step = 0; step < request.submit.command_count; ++step) {
+                        barrier(broker.ctx);
+                        record_command(broker.ctx, *jobs[i].connection, request.submit.commands[step]);
+                    }
+                } catch (const CancelledError&) {
+                    cancelled[i] = true;
+                }
+                write_timestamp(broker.ctx, {broker.timestamps.ptr, (i + 1) * sizeof(uint64_t), sizeof(uint64_t)});
+            }
+            broker.ctx.submit_async();
+            if (timed) {
+                completed = broker.ctx.wait_for(deadline - std::chrono::steady_clock::now());
+            } else {
+                broker.ctx.wait();
+            }
+        } catch (const SliceTimeoutError&) {
+            // The slice stays in flight, and the batch is retired like any other stalled one.
+            completed = false;
+        } catch (const PalError& e) {
+            lost = is_device_lost(e);
+            error = lost ? "Device lost" : fmt::format("Device error {}", static_cast<int>(e.result));
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        if (broker.ctx.slicing) {
+            broker.ctx.slicing->cancelled = nullptr;
+            broker.ctx.slicing->deadline = std::chrono::steady_clock::time_point::max();
+        }
+
+        // A batch that failed partway leaves its recording open, or earlier slices in flight. If
+        // that cannot be cleaned up, the context is rebuilt as after a device loss.
+        if (!error.empty() && !lost) {
+            try {
+                completed = broker.ctx.discard(timed ? deadline - std::chrono::steady_clock::now() : std::chrono::nanoseconds::max());
+            } catch (const PalError&) {
+                lost = true;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        ++broker.stats.batches;
+        broker.stats.jobs += jobs.size();
+        broker.batch_start = now;
+
+        // The jobs are failed right away, but their buffers stay in place until the device is
+        // done with them, see finish_stalled.
+        if (!completed) {
+            auto reason = fmt::format("Job did not complete within {} ms", broker.options.job_timeout.count());
+            for (const auto& job : jobs) {
+                auto reply = make_reply(MessageType::JobDone, reason, ReplyStatus::TimedOut);
+                reply.job = job.request->submit.job;
+                reply.batch_size = static_cast<uint32_t>(jobs.size());
+                send_reply(broker, *job.connection, reply);
+
+                auto& tenant = *job.connection->tenant;
+                charge_job(tenant, *job.request, estimated_cost(tenant), now);
+                ++tenant.stats.failed_jobs;
+            }
+            fmt::print(stderr, "Batch of {} jobs did not complete within {} ms\n", jobs.size(), broker.options.job_timeout.count());
+            broker.stats.timed_out_jobs += jobs.size();
+            broker.stats.failed_jobs += jobs.size();
+            broker.stalled = std::move(jobs);
+            return;
+        }
+
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            auto& connection = *jobs[i].connection;
+            auto& tenant = *connection.tenant;
+
+            auto status = cancelled[i] ? ReplyStatus::Cancelled : ReplyStatus::Failed;
+            auto reply = make_reply(MessageType::JobDone, cancelled[i] && error.empty() ? "Job cancelled" : error, status);
+            reply.job = jobs[i].request->submit.job;
+            reply.batch_size = static_cast<uint32_t>(jobs.size());
+            send_reply(broker, connection, reply);
+
+            // Failed submissions are charged their estimate, as there are no timestamps. Cancelled
+            // jobs are charged what they used, but do not count towards the estimate.
+            double gpu_time = estimated_cost(tenant);
+            if (error.empty()) {
+                auto ticks = broker.timestamp_data[i + 1] - broker.timestamp_data[i];
+                gpu_time = static_cast<double>(ticks) / broker.ctx.props.timestampFrequency;
+                if (!cancelled[i]) {
+                    tenant.average_cost = tenant.stats.jobs > 0
+                        ? tenant.average_cost + cost_smoothing * (gpu_time - tenant.average_cost)
+                        : gpu_time;
+                }
+            }
+            charge_job(tenant, *jobs[i].request, gpu_time, now);
+            if (!error.empty())
+                ++tenant.stats.failed_jobs;
+            if (error.empty() && cancelled[i])
+                ++broker.stats.cancelled_jobs;
+        }
+
+        retire_batch(broker, jobs);
+        if (!error.empty())
+            broker.stats.failed_jobs += jobs.size();
+        if (lost)
+            recover_device(broker);
+    }
+
+    // Drops the connections for which `drop` returns true, and returns the memory of their buffers
+    // to their tenants.
+    template <typename F>
+    void drop_connections(Broker& broker, F drop) {
+        std::erase_if(broker.connections, [&](const auto& connection) {
+            if (!drop(*connection))
+                return false;
+            for (const auto& [id, buffer] : connection->buffers) {
+                connection->tenant->memory -= buffer->mapping.size;
+            }
+            for (const auto& request : connection->pending) {
+                if (is_job(request))
+                    dequeue(broker, request);
+            }
+            return true;
+        });
+    }
+
+    bool is_running(const BrokerConnection& connection) {
+        return !connection.pending.empty() && connection.pending.front().running;
+    }
+
+    // Retires the stalled batch once the device completed it, or once the device was lost, which
+    // is how a hang usually ends.
+    void finish_stalled(Broker& broker) {
+        if (broker.stalled.empty())
+            return;
+        try {
+            if (!broker.ctx.wait_for(std::chrono::nanoseconds(0)))
+                return;
+        } catch (const PalError& e) {
+            if (!is_device_lost(e))
+                throw;
+            recover_device(broker);
+        }
+
+        fmt::print(stderr, "Stalled batch of {} jobs completed\n", broker.stalled.size());
+        retire_batch(broker, broker.stalled);
+        broker.stalled.clear();
+        drop_connections(broker, [](const BrokerConnection& connection) { return connection.closed; });
+        broker.batch_start = std::chrono::steady_clock::now();
+    }
+
+    void accept_connection(Broker& broker) {
+        auto socket = FileDescriptor(accept4(broker.listener.fd, nullptr, nullptr, SOCK_CLOEXEC));
+        if (socket.fd < 0) {
+            fmt::print(stderr, "Failed to accept client: {}\n", std::strerror(errno));
+            return;
+        }
+
+        // Until the client identifies itself, it belongs to the tenant of its user, see
+        // BrokerOptions::tenants.
+        auto credentials = ucred{};
+        auto length = socklen_t{sizeof(credentials)};
+        if (getsockopt(socket.fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0)
+            credentials.uid = static_cast<uid_t>(-1);
+        const auto& tenants = broker.options.tenants;
+        auto config = std::find_if(tenants.begin(), tenants.end(), [&](const TenantConfig& tenant) { return lists_user(tenant, credentials.uid); });
+        if (config == tenants.end() && credentials.uid != geteuid()) {
+            fmt::print(stderr, "Refusing client: no tenant lists user {}\n", credentials.uid);
+            return;
+        }
+
+        auto hello = HelloMessage{
+            .type = MessageType::Hello,
+            .version = broker_protocol_version,
+            .alignment = alignment(broker.ctx),
+        };
+        try {
+            send_packet(socket.fd, &hello, sizeof(hello));
+        } catch (const std::system_error&) {
+            return;
+        }
+
+        auto& tenant = find_tenant(broker, config != tenants.end() ? config->name : fmt::format("uid:{}", credentials.uid));
+        broker.connections.push_back(std::unique_ptr<BrokerConnection>(new BrokerConnection{
+            .socket = std::move(socket),
+            .user = credentials.uid,
+            .tenant = &tenant,
+            .buffers = {},
+            .next_buffer = 1,
+            .pending = {},
+            .closed = false,
+        }));
+        ++broker.stats.connections;
+    }
+}
+
+SharedMapping::Mapping::~Mapping() {
+    munmap(this->data, this->size);
+}
+
+Broker create_broker(Context& ctx, BrokerOptions options) {
+    auto address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (options.path.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("Socket path too long");
+    std::memcpy(address.sun_path, options.path.c_str(), options.path.size() + 1);
+
+    auto listener = FileDescriptor(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    if (listener.fd < 0)
+        throw_errno("Failed to create socket");
+
+    // A socket file that nobody accepts on is left over from a daemon that did not exit cleanly.
+    if (connect(listener.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0)
+        throw std::runtime_error(fmt::format("A daemon is already listening on {}", options.path));
+    listener = FileDescriptor(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    unlink(options.path.c_str());
+
+    if (bind(listener.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+        throw_errno("Failed to bind socket");
+    // Only the user that runs the daemon may connect, unless tenants list other users. Users that no
+    // tenant lists are then refused by accept_connection.
+    bool shared = std::any_of(options.tenants.begin(), options.tenants.end(), [](const TenantConfig& tenant) {
+        return std::any_of(tenant.users.begin(), tenant.users.end(), [](uid_t user) { return user != geteuid(); });
+    });
+    if (chmod(options.path.c_str(), shared ? 0666 : 0600) < 0)
+        throw_errno("Failed to restrict socket permissions");
+    if (listen(listener.fd, SOMAXCONN) < 0)
+        throw_errno("Failed to listen on socket");
+
+    const uint64_t* timestamp_data;
+    auto timestamps = create_timestamps(ctx, options.max_batch, timestamp_data);
+
+    if (options.slice_target.count() > 0)
+        enable_slicing(ctx, options.slice_target);
+
+    auto now = std::chrono::steady_clock::now();
+    return {
+        .ctx = ctx,
+        .options = std::move(options),
+        .listener = std::move(listener),
+        .connections = {},
+        .tenants = {},
+        .virtual_time = 0,
+        .queued_jobs = 0,
+        .queued_time = 0,
+        .timestamps = std::move(timestamps),
+        .timestamp_data = timestamp_data,
+        .stalled = {},
+        .batch_start = now,
+        .start = now,
+        .last_report = now,
+        .stats = {},
+    };
+}
+
+void serve(Broker& broker, const volatile std::sig_atomic_t& stop) {
+    auto fds = std::vector<pollfd>();
+    while (!stop) {
+        auto interval = broker.options.report_interval;
+        if (interval.count() > 0 && std::chrono::steady_clock::now() - broker.last_report >= interval) {
+            report(broker);
+            broker.last_report = std::chrono::steady_clock::now();
+        }
+
+        finish_stalled(broker);
+        bool stalled = !broker.stalled.empty();
+        bool pending = !stalled && std::any_of(broker.connections.begin(), broker.connections.end(), [](const auto& c) { return has_jobs(*c); });
+
+        // Without pending jobs or reports, wait for the next message indefinitely.
+        auto wait = std::optional<std::chrono::steady_clock::duration>();
+        if (pending) {
+            auto remaining = broker.batch_start + broker.options.batch_window - std::chrono::steady_clock::now();
+            if (remaining <= std::chrono::steady_clock::duration::zero()) {
+                run_batch(broker);
+                continue;
+            }
+            wait = remaining;
+        }
+        if (interval.count() > 0) {
+            auto remaining = broker.last_report + interval - std::chrono::steady_clock::now();
+            wait = wait ? std::min(*wait, remaining) : remaining;
+        }
+        // Fences cannot be polled along with the sockets, so check the stalled batch regularly.
+        if (stalled)
+            wait = wait ? std::min<std::chrono::steady_clock::duration>(*wait, stall_poll_interval) : stall_poll_interval;
+
+        auto timeout = timespec{};
+        if (wait) {
+            auto ns = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(*wait).count(), 0);
+            timeout.tv_sec = ns / 1000000000;
+            timeout.tv_nsec = ns % 1000000000;
+        }
+
+        // While blocked, only hangups are polled for. There are pending jobs then, so the wait ends
+        // with the next batch, which makes room.
+        short events = is_blocked(broker) ? 0 : POLLIN;
+        fds.clear();
+        fds.push_back({.fd = broker.listener.fd, .events = POLLIN, .revents = 0});
+        for (const auto& connection : broker.connections) {
+            fds.push_back({.fd = connection->socket.fd, .events = events, .revents = 0});
+        }
+
+        if (ppoll(fds.data(), fds.size(), wait ? &timeout : nullptr, nullptr) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw_errno("Failed to poll");
+        }
+
+        // Handle the existing connections before accepting new ones, which are appended.
+        auto dropped = std::vector<BrokerConnection*>();
+        for (size_t i = 1; i < fds.size(); ++i) {
+            auto& connection = *broker.connections[i - 1];
+            if (fds[i].revents == 0)
+                continue;
+            if (!receive(broker, connection) || (fds[i].revents & (POLLHUP | POLLERR)))
+                dropped.push_back(&connection);
+        }
+
+        // Connections with a stalled job keep their buffers until the device is done with them.
+        for (auto* connection : dropped) {
+            connection->closed = true;
+            connection->socket = FileDescriptor();
+        }
+        drop_connections(broker, [](const BrokerConnection& connection) {
+            return connection.closed && !is_running(connection);
+        });
+
+        if (fds[0].revents & POLLIN)
+            accept_connection(broker);
+
+        // Full batches do not wait for the window.
+        auto ready = std::count_if(broker.connections.begin(), broker.connections.end(), [](const auto& c) { return has_jobs(*c); });
+        if (static_cast<uint32_t>(ready) >= broker.options.max_batch)
+            run_batch(broker);
+    }
+}
+
+void report(const Broker& broker) {
+    double total_gpu_time = 0;
+    for (const auto& [name, tenant] : broker.tenants) {
+        total_gpu_time += tenant->stats.gpu_time;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - broker.start).count();
+
+    fmt::print("{:<20} {:>6} {:>8} {:>6} {:>8} {:>10} {:>7} {:>7} {:>9} {:>9} {:>9} {:>10}\n",
+        "tenant", "weight", "jobs", "failed", "refused", "gpu s", "share", "util", "mean ms", "p50 ms", "p99 ms", "memory MiB");
+    for (const auto& [name, tenant] : broker.tenants) {
+        const auto& stats = tenant->stats;
+        auto latencies = stats.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            return latencies.empty() ? 0 : latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+        };
+        double mean = 0;
+        for (auto latency : latencies) {
+            mean += latency / latencies.size();
+        }
+
+        auto quota = tenant->quota ? fmt::format("/{}", tenant->quota >> 20) : "";
+        fmt::print("{:<20} {:>6} {:>8} {:>6} {:>8} {:>10.3f} {:>6.1f}% {:>6.1f}% {:>9.3f} {:>9.3f} {:>9.3f} {:>10}\n",
+            name,
+            tenant->weight,
+            stats.jobs,
+            stats.failed_jobs,
+            stats.refused_jobs,
+            stats.gpu_time,
+            total_gpu_time > 0 ? 100 * stats.gpu_time / total_gpu_time : 0,
+            elapsed > 0 ? 100 * stats.gpu_time / elapsed : 0,
+            mean * 1000,
+            percentile(0.5) * 1000,
+            percentile(0.99) * 1000,
+            fmt::format("{}{}", tenant->memory >> 20, quota));
+    }
+}
@@ -0,0 +1,222 @@
+#ifndef _NIRAH_DAEMON_BROKER_HPP
+#define _NIRAH_DAEMON_BROKER_HPP
+
+#include "context.hpp"
+#include "protocol.hpp"
+#include "socket.hpp"
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// The daemon side of the broker protocol, see client.hpp.
+//
+// Clients belong to tenants, which share the device by weighted fair queueing: every tenant has a
+// virtual time, which advances by the GPU time of its jobs, measured with timestamps, divided by
+// its weight. Batches are filled with the jobs of the tenants that are furthest behind, so over time
+// every busy tenant gets GPU time in proportion to its weight, however many jobs it submits.
+
+struct TenantConfig {
+    std::string name;
+    uint32_t weight = 1;
+    // Limit on the shared buffers of all of its connections, in bytes, or 0 for no limit.
+    Pal::gpusize quota = 0;
+    // Users whose connections belong to this tenant, and who may identify as it. If empty, only the
+    // user that runs the daemon may identify as it.
+    std::vector<uid_t> users;
+};
+
+// What the daemon does with jobs that arrive while it is at one of its queue limits.
+enum class AdmissionPolicy {
+    // Stops reading requests from clients until the queue drains, so that their sends block.
+    Block,
+    // Fails the new job with ReplyStatus::QueueFull.
+    Reject,
+    // Fails queued jobs of the tenant with the lowest weight with ReplyStatus::Shed to make room,
+    // newest first, as long as that weight is lower than the weight of the new job's tenant. Rejects
+    // the new job otherwise.
+    Shed,
+};
+
+struct BrokerOptions {
+    std::string path;
+    // Largest number of jobs recorded into one submission.
+    uint32_t max_batch = 64;
+    // How long the first pending job waits for jobs of other clients to join its batch.
+    std::chrono::microseconds batch_window{100};
+    // Batches stop taking jobs once their estimated GPU time exceeds this, so that a batch of heavy
+    // jobs does not delay the next one for too long. A batch always takes at least one job.
+    std::chrono::microseconds batch_budget{5000};
+    // Tenants are taken from the peer credentials of a connection: a connection belongs to the first
+    // tenant that lists its user. The user that runs the daemon may be unlisted, and then gets a
+    // tenant of its own with the default weight and quota; connections of other unlisted users are
+    // refused. A connection may move to another tenant that allows its user, see IdentifyMessage.
+    std::vector<TenantConfig> tenants;
+    TenantConfig default_tenant;
+    // How often tenant metrics are printed, or 0 to only print them on exit.
+    std::chrono::seconds report_interval{0};
+    // Limits on the jobs that are queued but have not completed, of all clients together, or 0 for
+    // no limit: their number, and their estimated GPU time. A job is admitted into an empty queue
+    // whatever its estimate.
+    uint32_t max_queued_jobs = 0;
+    std::chrono::microseconds max_queued_time{0};
+    AdmissionPolicy admission = AdmissionPolicy::Reject;
+    // Limit on the shared buffers of all clients together, in bytes, or 0 for no limit. Buffers over
+    // the limit fail with ReplyStatus::MemoryFull.
+    Pal::gpusize max_memory = 0;
+    // If not 0, long dispatches are sliced, see enable_slicing, and running jobs that are cancelled
+    // stop at the next slice. Otherwise they run to completion.
+    std::chrono::microseconds slice_target{0};
+    // How long the daemon waits for a batch before failing its jobs with ReplyStatus::TimedOut, or 0
+    // to wait indefinitely. With slicing, a slice that does not complete in time fails the batch as
+    // well. It keeps serving clients in the meantime, but runs no other batches until the device is
+    // done with the stalled one.
+    std::chrono::milliseconds job_timeout{0};
+};
+
+constexpr size_t max_tenant_latencies = 4096;
+
+struct TenantStats {
+    uint64_t jobs;
+    uint64_t failed_jobs;
+    // Jobs that were rejected or shed by admission control, which do not count as jobs.
+    uint64_t refused_jobs;
+    // In seconds.
+    double gpu_time;
+    // Times from the arrival of a job to its reply, in seconds, of the last max_tenant_latencies jobs.
+    std::vector<double> latencies;
+    size_t next_latency;
+};
+
+struct Tenant {
+    std::string name;
+    uint32_t weight;
+    Pal::gpusize quota;
+    // Size of the shared buffers of all of its connections.
+    Pal::gpusize memory;
+    double virtual_time;
+    // Moving average of the GPU time of its jobs, used to estimate the cost of pending jobs.
+    double average_cost;
+    TenantStats stats;
+};
+
+// A client's memfd, mapped into the daemon and pinned so that jobs can bind it directly.
+struct SharedMapping {
+    struct Mapping {
+        std::byte* data;
+        size_t size;
+
+        Mapping(std::byte* data, size_t size):
+            data(data), size(size) {
+        }
+
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        ~Mapping();
+    };
+
+    // Declared first, so that the memory is unpinned before it is unmapped.
+    Mapping mapping;
+    Unique<Pal::IGpuMemory> pinned;
+    // Set when the client released the buffer while it still had pending jobs, which may use it.
+    bool released;
+
+    BufferView view(const Operand& operand) const {
+        return {this->pinned.ptr, operand.offset, operand.size};
+    }
+};
+
+struct BrokerConnection {
+    // Either a job, or the release of a buffer that was requested after it.
+    struct Request {
+        bool release;
+        uint32_t buffer;
+        SubmitMessage submit;
+        std::chrono::steady_clock::time_point arrival;
+        // Estimated GPU time that the job was admitted with, in seconds.
+        double cost;
+        // Jobs that failed validation or admission stay in line with this status other than Ok,
+        // so that their reply is not sent ahead of the replies to earlier jobs.
+        ReplyStatus status;
+        std::string error;
+        // Set while the job is part of a batch on the device.
+        bool running;
+        // Set if the client cancelled the job while it was running.
+        bool cancel_requested;
+    };
+
+    FileDescriptor socket;
+    // From the peer credentials of the socket.
+    uid_t user;
+    Tenant* tenant;
+    std::unordered_map<uint32_t, std::unique_ptr<SharedMapping>> buffers;
+    uint32_t next_buffer;
+    std::deque<Request> pending;
+    // Set if the client hung up while one of its jobs was stalled on the device. The connection,
+    // and with it the memory of its buffers, is dropped once the device is done with them.
+    bool closed;
+};
+
+struct BatchJob {
+    BrokerConnection* connection;
+    BrokerConnection::Request* request;
+};
+
+struct BrokerStats {
+    uint64_t jobs;
+    uint64_t failed_jobs;
+    uint64_t rejected_jobs;
+    uint64_t shed_jobs;
+    uint64_t cancelled_jobs;
+    uint64_t timed_out_jobs;
+    uint64_t batches;
+    // Times the device was lost and rebuilt.
+    uint64_t recoveries;
+    uint64_t connections;
+};
+
+struct Broker {
+    Context& ctx;
+    BrokerOptions options;
+    FileDescriptor listener;
+    std::vector<std::unique_ptr<BrokerConnection>> connections;
+    // Tenants outlive their connections, to keep their virtual time and metrics.
+    std::unordered_map<std::string, std::unique_ptr<Tenant>> tenants;
+    // Virtual time of the last job that was scheduled. Tenants that become busy again start from
+    // here, so that they do not bank credit while idle.
+    double virtual_time;
+    // Admitted jobs that have not completed, and the sum of their estimated GPU time in seconds.
+    uint32_t queued_jobs;
+    double queued_time;
+    // Host readable, one timestamp before and one after every job of a batch.
+    Unique<Pal::IGpuMemory> timestamps;
+    const uint64_t* timestamp_data;
+    // Jobs of a batch that exceeded options.job_timeout. They have been replied to, but stay at the
+    // front of their connections until the device completes them.
+    std::vector<BatchJob> stalled;
+    // When the oldest job that has not been run yet arrived.
+    std::chrono::steady_clock::time_point batch_start;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point last_report;
+    BrokerStats stats;
+};
+
+// Listens on options.path, which must not be in use by a running daemon.
+Broker create_broker(Context& ctx, BrokerOptions options);
+
+// Serves clients until `stop` is set, which is checked whenever a signal interrupts the wait.
+void serve(Broker& broker, const volatile std::sig_atomic_t& stop);
+
+// Prints the metrics of every tenant: jobs, jobs refused by admission control, GPU time and its share
+// of the total, utilisation of the device since the daemon started, latencies and memory use.
+void report(const Broker& broker);
+
+#endif
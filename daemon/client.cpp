@@ -0,0 +1,277 @@
+#include "client.hpp"
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+    [[noreturn]] void throw_errno(const char* what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    Command make_command(CommandType type, std::initializer_list<Operand> operands) {
+        auto command = Command{};
+        command.type = type;
+        command.operand_count = static_cast<uint32_t>(operands.size());
+        std::copy(operands.begin(), operands.end(), command.operands);
+        return command;
+    }
+
+    std::string error_message(const ReplyMessage& reply) {
+        return std::string(reply.error, strnlen(reply.error, sizeof(reply.error)));
+    }
+
+    bool is_busy(ReplyStatus status) {
+        return status == ReplyStatus::QueueFull || status == ReplyStatus::Shed || status == ReplyStatus::MemoryFull;
+    }
+
+    SubmitMessage make_submit(BrokerClient& client, const BrokerJob& job) {
+        if (job.commands.size() > max_job_commands)
+            throw std::invalid_argument("Too many commands in job");
+
+        auto message = SubmitMessage{};
+        message.type = MessageType::Submit;
+        message.command_count = static_cast<uint32_t>(job.commands.size());
+        message.job = client.next_job;
+        std::copy(job.commands.begin(), job.commands.end(), message.commands);
+        return message;
+    }
+
+    // Receives replies until one of `type` arrives. Job replies that arrive in between are recorded.
+    ReplyMessage receive_reply(BrokerClient& client, MessageType type) {
+        while (true) {
+            auto reply = ReplyMessage{};
+            auto size = receive_packet(client.socket.fd, &reply, sizeof(reply));
+            if (size == 0)
+                throw std::runtime_error("Daemon closed the connection");
+            else if (static_cast<size_t>(size) != sizeof(reply))
+                throw std::runtime_error("Malformed reply from daemon");
+
+            client.queued_jobs = reply.queued_jobs;
+            if (reply.type == MessageType::JobDone) {
+                if (reply.status != ReplyStatus::Ok)
+                    client.failures.emplace(reply.job, JobFailure{reply.status, error_message(reply)});
+                client.completed = reply.job;
+                client.last_batch_size = reply.batch_size;
+            }
+
+            if (reply.type == type)
+                return reply;
+        }
+    }
+}
+
+std::string default_broker_path() {
+    if (const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR"); runtime_dir && *runtime_dir)
+        return std::string(runtime_dir) + "/nirah.sock";
+    return "/tmp/nirah-" + std::to_string(getuid()) + ".sock";
+}
+
+SharedBuffer::SharedBuffer(uint32_t id, std::byte* data, size_t size, FileDescriptor memfd):
+    id(id), data(data), size(size), memfd(std::move(memfd)) {
+}
+
+SharedBuffer::SharedBuffer(SharedBuffer&& other):
+    id(other.id),
+    data(std::exchange(other.data, nullptr)),
+    size(std::exchange(other.size, 0)),
+    memfd(std::move(other.memfd)) {
+}
+
+SharedBuffer& SharedBuffer::operator=(SharedBuffer&& other) {
+    std::swap(this->id, other.id);
+    std::swap(this->data, other.data);
+    std::swap(this->size, other.size);
+    std::swap(this->memfd, other.memfd);
+    return *this;
+}
+
+SharedBuffer::~SharedBuffer() {
+    if (this->data)
+        munmap(this->data, this->size);
+}
+
+BrokerJob& BrokerJob::fill(Operand dst, uint32_t value) {
+    auto command = make_command(CommandType::Fill, {dst});
+    command.value = value;
+    this->commands.push_back(command);
+    return *this;
+}
+
+BrokerJob& BrokerJob::copy(Operand src, Operand dst) {
+    this->commands.push_back(make_command(CommandType::Copy, {src, dst}));
+    return *this;
+}
+
+BrokerJob& BrokerJob::axpby(float alpha, Operand x, float beta, Operand y, uint32_t n) {
+    auto command = make_command(CommandType::Axpby, {x, y});
+    command.counts[0] = n;
+    command.scalars[0] = alpha;
+    command.scalars[1] = beta;
+    this->commands.push_back(command);
+    return *this;
+}
+
+BrokerJob& BrokerJob::gemm(Operand a, Operand b, Operand c, uint32_t m, uint32_t n, uint32_t k, float alpha) {
+    auto command = make_command(CommandType::Gemm, {a, b, c});
+    command.counts[0] = m;
+    command.counts[1] = n;
+    command.counts[2] = k;
+    command.scalars[0] = alpha;
+    this->commands.push_back(command);
+    return *this;
+}
+
+BrokerJob& BrokerJob::histogram(Operand keys, uint32_t n, Operand bins, uint32_t n_bins) {
+    auto command = make_command(CommandType::Histogram, {keys, bins});
+    command.counts[0] = n;
+    command.counts[1] = n_bins;
+    this->commands.push_back(command);
+    return *this;
+}
+
+BrokerClient connect_broker(const std::string& path, const std::string& tenant) {
+    auto address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("Socket path too long");
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    auto socket = FileDescriptor(::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    if (socket.fd < 0)
+        throw_errno("Failed to create socket");
+    if (connect(socket.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+        throw_errno("Failed to connect to nirah-daemon");
+
+    auto hello = HelloMessage{};
+    auto size = receive_packet(socket.fd, &hello, sizeof(hello));
+    if (size == 0)
+        throw std::runtime_error("nirah-daemon refused the connection");
+    else if (size != sizeof(hello) || hello.type != MessageType::Hello)
+        throw std::runtime_error("Malformed hello from daemon");
+    else if (hello.version != broker_protocol_version)
+        throw std::runtime_error("Daemon speaks a different protocol version");
+
+    if (!tenant.empty()) {
+        auto identify = IdentifyMessage{};
+        identify.type = MessageType::Identify;
+        if (tenant.size() > sizeof(identify.tenant))
+            throw std::invalid_argument("Tenant name too long");
+        std::memcpy(identify.tenant, tenant.data(), tenant.size());
+        send_packet(socket.fd, &identify, sizeof(identify));
+    }
+
+    return {
+        .socket = std::move(socket),
+        .alignment = hello.alignment,
+        .next_job = 1,
+        .completed = 0,
+        .failures = {},
+        .last_batch_size = 0,
+        .queued_jobs = 0,
+    };
+}
+
+SharedBuffer create_shared_buffer(BrokerClient& client, size_t size) {
+    size = std::max<size_t>((size + client.alignment - 1) / client.alignment * client.alignment, client.alignment);
+
+    auto memfd = FileDescriptor(memfd_create("nirah-shared-buffer", MFD_CLOEXEC));
+    if (memfd.fd < 0)
+        throw_errno("Failed to create memfd");
+    if (ftruncate(memfd.fd, static_cast<off_t>(size)) < 0)
+        throw_errno("Failed to resize memfd");
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd.fd, 0);
+    if (data == MAP_FAILED)
+        throw_errno("Failed to map memfd");
+    auto buffer = SharedBuffer(0, static_cast<std::byte*>(data), size, std::move(memfd));
+
+    auto message = RegisterBufferMessage{
+        .type = MessageType::RegisterBuffer,
+        .reserved = 0,
+        .size = size,
+    };
+    send_packet(client.socket.fd, &message, sizeof(message), buffer.memfd.fd);
+
+    auto reply = receive_reply(client, MessageType::BufferRegistered);
+    if (is_busy(reply.status))
+        throw BrokerBusyError(reply.status, error_message(reply));
+    else if (reply.status != ReplyStatus::Ok)
+        throw std::runtime_error(error_message(reply));
+    buffer.id = reply.buffer;
+    return buffer;
+}
+
+void release_shared_buffer(BrokerClient& client, const SharedBuffer& buffer) {
+    auto message = ReleaseBufferMessage{
+        .type = MessageType::ReleaseBuffer,
+        .buffer = buffer.id,
+    };
+    send_packet(client.socket.fd, &message, sizeof(message));
+}
+
+uint64_t submit_job(BrokerClient& client, const BrokerJob& job) {
+    auto message = make_submit(client, job);
+    send_packet(client.socket.fd, &message, sizeof(message));
+    return client.next_job++;
+}
+
+std::optional<uint64_t> try_submit_job(BrokerClient& client, const BrokerJob& job) {
+    auto message = make_submit(client, job);
+    if (!send_packet(client.socket.fd, &message, sizeof(message), -1, MSG_DONTWAIT))
+        return std::nullopt;
+    return client.next_job++;
+}
+
+void cancel_job(BrokerClient& client, uint64_t job) {
+    auto message = CancelMessage{
+        .type = MessageType::Cancel,
+        .reserved = 0,
+        .job = job,
+    };
+    send_packet(client.socket.fd, &message, sizeof(message));
+}
+
+void wait_job(BrokerClient& client, uint64_t job) {
+    while (client.completed < job) {
+        receive_reply(client, MessageType::JobDone);
+    }
+
+    auto it = client.failures.find(job);
+    if (it != client.failures.end()) {
+        auto failure = std::move(it->second);
+        client.failures.erase(it);
+        if (is_busy(failure.status))
+            throw BrokerBusyError(failure.status, failure.error);
+        else if (failure.status == ReplyStatus::Cancelled)
+            throw JobCancelledError(failure.error);
+        throw std::runtime_error(failure.error);
+    }
+}
+
+bool wait_job_for(BrokerClient& client, uint64_t job, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (client.completed < job) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        auto fd = pollfd{.fd = client.socket.fd, .events = POLLIN, .revents = 0};
+        int ready = poll(&fd, 1, static_cast<int>(std::max<int64_t>(remaining.count(), 0)));
+        if (ready < 0 && errno != EINTR)
+            throw_errno("Failed to poll");
+        else if (ready == 0)
+            return false;
+        else if (ready > 0)
+            receive_reply(client, MessageType::JobDone);
+    }
+
+    wait_job(client, job);
+    return true;
+}
@@ -0,0 +1,146 @@
+#ifndef _NIRAH_DAEMON_CLIENT_HPP
+#define _NIRAH_DAEMON_CLIENT_HPP
+
+#include "protocol.hpp"
+#include "socket.hpp"
+
+#include <chrono>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Client library of nirah-daemon, which owns the device so that several processes can share it
+// without each initializing it. Clients allocate shared buffers, which the daemon maps and binds
+// directly, and submit jobs: short lists of commands on those buffers. The daemon records the jobs
+// of all clients that are pending at the same time into one submission.
+
+// Thrown for requests that the daemon refused because it is at one of its limits, see ReplyStatus.
+// They may succeed when retried later, so callers should back off rather than give up.
+struct BrokerBusyError : std::runtime_error {
+    ReplyStatus status;
+
+    BrokerBusyError(ReplyStatus status, const std::string& what):
+        std::runtime_error(what), status(status) {
+    }
+};
+
+// Thrown when waiting for a job that was cancelled with cancel_job.
+struct JobCancelledError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+struct JobFailure {
+    ReplyStatus status;
+    std::string error;
+};
+
+// $XDG_RUNTIME_DIR/nirah.sock, or /tmp/nirah-<uid>.sock without a runtime directory.
+std::string default_broker_path();
+
+struct BrokerClient {
+    FileDescriptor socket;
+    // From the daemon's hello, see HelloMessage.
+    uint64_t alignment;
+    uint64_t next_job;
+    // Every job up to this one has completed.
+    uint64_t completed;
+    // Failed jobs that have not been waited for yet.
+    std::map<uint64_t, JobFailure> failures;
+    // Batch size of the last completed job.
+    uint32_t last_batch_size;
+    // Number of jobs queued in the daemon, from all clients, as of the last reply. Clients can use
+    // this to back off before the daemon starts refusing jobs.
+    uint32_t queued_jobs;
+};
+
+// Host memory shared with the daemon, backed by a memfd. Writes by the client are visible to jobs
+// without a copy, and the results of a job are visible once it has been waited for.
+struct SharedBuffer {
+    uint32_t id;
+    std::byte* data;
+    size_t size;
+    FileDescriptor memfd;
+
+    SharedBuffer(uint32_t id, std::byte* data, size_t size, FileDescriptor memfd);
+
+    SharedBuffer(const SharedBuffer&) = delete;
+    SharedBuffer& operator=(const SharedBuffer&) = delete;
+
+    SharedBuffer(SharedBuffer&& other);
+    SharedBuffer& operator=(SharedBuffer&& other);
+
+    // Unmaps the buffer locally; the daemon keeps its mapping until release_shared_buffer or until
+    // the client disconnects.
+    ~SharedBuffer();
+
+    Operand range(uint64_t offset, uint64_t size) const {
+        return {this->id, 0, offset, size};
+    }
+
+    operator Operand() const {
+        return this->range(0, this->size);
+    }
+};
+
+// A list of commands that run in order, with barriers between them, when the job is submitted.
+struct BrokerJob {
+    std::vector<Command> commands;
+
+    // Fills `dst` with a repeated 32-bit value.
+    BrokerJob& fill(Operand dst, uint32_t value);
+
+    // Copies `src` to the start of `dst`.
+    BrokerJob& copy(Operand src, Operand dst);
+
+    // y = alpha * x + beta * y for n fp32 elements.
+    BrokerJob& axpby(float alpha, Operand x, float beta, Operand y, uint32_t n);
+
+    // C = alpha * A * B^T for fp32 matrices, see gemm in tensor.hpp.
+    BrokerJob& gemm(Operand a, Operand b, Operand c, uint32_t m, uint32_t n, uint32_t k, float alpha = 1);
+
+    // Histogram of n uint32 keys in [0, n_bins), see histogram in aggregate.hpp.
+    BrokerJob& histogram(Operand keys, uint32_t n, Operand bins, uint32_t n_bins);
+};
+
+// Connects as a client of `tenant`, if given, or of the tenant of the current user otherwise. The
+// daemon's configuration determines the tenant's scheduling weight and memory quota, and which users
+// may use it: the daemon drops connections that identify as a tenant that is not theirs.
+BrokerClient connect_broker(const std::string& path = default_broker_path(), const std::string& tenant = "");
+
+// The size is rounded up to the daemon's alignment. Fails if it would exceed the memory quota of the
+// client's tenant, or throws BrokerBusyError if it would exceed the daemon's memory limit.
+SharedBuffer create_shared_buffer(BrokerClient& client, size_t size);
+
+void release_shared_buffer(BrokerClient& client, const SharedBuffer& buffer);
+
+// Sends a job to the daemon and returns its id without waiting for it. Jobs of one client run in
+// submission order.
+uint64_t submit_job(BrokerClient& client, const BrokerJob& job);
+
+// Like submit_job, but returns nothing instead of waiting while the connection is full. That is the
+// case when the daemon stopped reading requests under its Block admission policy.
+std::optional<uint64_t> try_submit_job(BrokerClient& client, const BrokerJob& job);
+
+// Asks the daemon to drop the job. Queued jobs are dropped right away; running jobs stop at their
+// next slice if the daemon slices dispatches, and complete otherwise. Waiting for the job throws
+// JobCancelledError if it was cancelled in time.
+void cancel_job(BrokerClient& client, uint64_t job);
+
+// Waits until the job has completed. Throws BrokerBusyError if the daemon refused or shed the job,
+// JobCancelledError if it was cancelled, and std::runtime_error with the daemon's description if it
+// failed otherwise, including when it exceeded the daemon's job timeout.
+void wait_job(BrokerClient& client, uint64_t job);
+
+// Like wait_job, but returns false if the job has not completed within `timeout`. The job keeps
+// running; cancel it to free the daemon.
+bool wait_job_for(BrokerClient& client, uint64_t job, std::chrono::milliseconds timeout);
+
+inline void run_job(BrokerClient& client, const BrokerJob& job) {
+    wait_job(client, submit_job(client, job));
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "broker.hpp"
+#include "client.hpp"
+
+#include <fmt/format.h>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+namespace {
+    volatile std::sig_atomic_t stop = 0;
+
+    void handle_signal(int) {
+        stop = 1;
+    }
+
+    uint32_t parse_number(std::string_view text) {
+        uint32_t value = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end != text.data() + text.size())
+            throw std::invalid_argument(fmt::format("Invalid number '{}'", text));
+        return value;
+    }
+
+    // NAME:WEIGHT, NAME:WEIGHT:QUOTA_MIB or NAME:WEIGHT:QUOTA_MIB:UID[,UID]...
+    TenantConfig parse_tenant(std::string_view text) {
+        auto first = text.find(':');
+        if (first == std::string_view::npos || first == 0)
+            throw std::invalid_argument(fmt::format("Invalid tenant '{}'", text));
+
+        auto config = TenantConfig{.name = std::string(text.substr(0, first))};
+        auto rest = text.substr(first + 1);
+        auto second = rest.find(':');
+        config.weight = parse_number(rest.substr(0, second));
+        if (second == std::string_view::npos)
+            return config;
+
+        rest = rest.substr(second + 1);
+        auto third = rest.find(':');
+        config.quota = Pal::gpusize{parse_number(rest.substr(0, third))} << 20;
+        if (third == std::string_view::npos)
+            return config;
+
+        rest = rest.substr(third + 1);
+        while (true) {
+            auto comma = rest.find(',');
+            config.users.push_back(parse_number(rest.substr(0, comma)));
+            if (comma == std::string_view::npos)
+                return config;
+            rest = rest.substr(comma + 1);
+        }
+    }
+
+    AdmissionPolicy parse_admission(std::string_view text) {
+        if (text == "block")
+            return AdmissionPolicy::Block;
+        else if (text == "reject")
+            return AdmissionPolicy::Reject;
+        else if (text == "shed")
+            return AdmissionPolicy::Shed;
+        throw std::invalid_argument(fmt::format("Invalid admission policy '{}'", text));
+    }
+
+    void usage(const char* program) {
+        fmt::print(
+            stderr,
+            "Usage: {} [--socket PATH] [--max-batch JOBS] [--batch-window-us MICROSECONDS] [--batch-budget-us MICROSECONDS]\n"
+            "       [--tenant NAME:WEIGHT[:QUOTA_MIB[:UID[,UID]...]]]... [--default-quota-mib MIB] [--report-interval-s SECONDS]\n"
+            "       [--max-queued-jobs JOBS] [--max-queued-time-us MICROSECONDS] [--admission block|reject|shed]\n"
+            "       [--max-memory-mib MIB] [--slice-us MICROSECONDS] [--job-timeout-ms MILLISECONDS]\n",
+            program
+        );
+    }
+}
+
+int main(int argc, char* argv[]) {
+    auto options = BrokerOptions{.path = default_broker_path()};
+    try {
+        for (int i = 1; i < argc; ++i) {
+            auto arg = std::string_view(argv[i]);
+            if (i + 1 == argc) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            } else if (arg == "--socket") {
+                options.path = argv[++i];
+            } else if (arg == "--max-batch") {
+                options.max_batch = std::max(parse_number(argv[++i]), 1u);
+            } else if (arg == "--batch-window-us") {
+                options.batch_window = std::chrono::microseconds(parse_number(argv[++i]));
+            } else if (arg == "--batch-budget-us") {
+                options.batch_budget = std::chrono::microseconds(parse_number(argv[++i]));
+            } else if (arg == "--tenant") {
+                options.tenants.push_back(parse_tenant(argv[++i]));
+            } else if (arg == "--default-quota-mib") {
+                options.default_tenant.quota = Pal::gpusize{parse_number(argv[++i])} << 20;
+            } else if (arg == "--report-interval-s") {
+                options.report_interval = std::chrono::seconds(parse_number(argv[++i]));
+            } else if (arg == "--max-queued-jobs") {
+                options.max_queued_jobs = parse_number(argv[++i]);
+            } else if (arg == "--max-queued-time-us") {
+                options.max_queued_time = std::chrono::microseconds(parse_number(argv[++i]));
+            } else if (arg == "--admission") {
+                options.admission = parse_admission(argv[++i]);
+            } else if (arg == "--max-memory-mib") {
+                options.max_memory = Pal::gpusize{parse_number(argv[++i])} << 20;
+            } else if (arg == "--slice-us") {
+                options.slice_target = std::chrono::microseconds(parse_number(argv[++i]));
+            } else if (arg == "--job-timeout-ms") {
+                options.job_timeout = std::chrono::milliseconds(parse_number(argv[++i]));
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::invalid_argument& e) {
+        fmt::print(stderr, "{}\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    // Without SA_RESTART, so that the signal interrupts the wait for clients.
+    struct sigaction action = {};
+    action.sa_handler = handle_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    auto ctx = create_context();
+    auto broker = create_broker(ctx, options);
+    fmt::print("Listening on {}\n", options.path);
+
+    serve(broker, stop);
+
+    unlink(options.path.c_str());
+    fmt::print(
+        "Served {} connections, {} jobs ({} failed, {} cancelled, {} timed out) in {} batches, rejected {} and shed {} jobs, recovered from {} device losses\n",
+        broker.stats.connections,
+        broker.stats.jobs,
+        broker.stats.failed_jobs,
+        broker.stats.cancelled_jobs,
+        broker.stats.timed_out_jobs,
+        broker.stats.batches,
+        broker.stats.rejected_jobs,
+        broker.stats.shed_jobs,
+        broker.stats.recoveries
+    );
+    report(broker);
+    return EXIT_SUCCESS;
+}
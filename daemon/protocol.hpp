@@ -0,0 +1,132 @@
+#ifndef _NIRAH_DAEMON_PROTOCOL_HPP
+#define _NIRAH_DAEMON_PROTOCOL_HPP
+
+#include <cstdint>
+
+// Messages between nirah-daemon and its clients. They are exchanged over a local unix socket of
+// type SOCK_SEQPACKET, one message per packet, and every message starts with its type. Shared
+// buffers are memfds, whose file descriptor is passed along with RegisterBuffer as SCM_RIGHTS
+// ancillary data, so that the daemon maps the same pages as the client.
+//
+// This header is shared by the daemon and the client library, and must not depend on pal.
+
+constexpr uint32_t broker_protocol_version = 4;
+constexpr uint32_t max_job_commands = 16;
+constexpr uint32_t max_command_operands = 3;
+
+enum class MessageType : uint32_t {
+    // Daemon -> client, once after connecting.
+    Hello,
+    RegisterBuffer,
+    ReleaseBuffer,
+    Submit,
+    // Daemon -> client, in reply to RegisterBuffer.
+    BufferRegistered,
+    // Daemon -> client, once for every Submit, in submission order.
+    JobDone,
+    // Optional, before any other request.
+    Identify,
+    Cancel,
+};
+
+// The operations that jobs are built from. They map onto the library functions of the same name,
+// see BrokerJob in client.hpp for their operands.
+enum class CommandType : uint32_t {
+    Fill,
+    Copy,
+    Axpby,
+    Gemm,
+    Histogram,
+};
+
+// A range of a shared buffer. Offsets must be multiples of 4.
+struct Operand {
+    uint32_t buffer;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct Command {
+    CommandType type;
+    uint32_t counts[3];
+    float scalars[2];
+    uint32_t value;
+    uint32_t operand_count;
+    Operand operands[max_command_operands];
+};
+
+struct HelloMessage {
+    MessageType type;
+    uint32_t version;
+    // Shared buffer sizes must be multiples of this.
+    uint64_t alignment;
+};
+
+// Attributes the connection to a tenant, whose connections share its scheduling weight and memory
+// quota. The tenant must be configured on the daemon and allow the user of the connection, or the
+// daemon drops the connection. Without it, connections are attributed to the tenant of their user.
+struct IdentifyMessage {
+    MessageType type;
+    uint32_t reserved;
+    char tenant[56];
+};
+
+struct RegisterBufferMessage {
+    MessageType type;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+struct ReleaseBufferMessage {
+    MessageType type;
+    uint32_t buffer;
+};
+
+// Cancels a job of the connection. The job is still replied to, with ReplyStatus::Cancelled if the
+// cancellation took effect.
+struct CancelMessage {
+    MessageType type;
+    uint32_t reserved;
+    uint64_t job;
+};
+
+struct SubmitMessage {
+    MessageType type;
+    uint32_t command_count;
+    // Chosen by the client, and returned in the JobDone reply.
+    uint64_t job;
+    Command commands[max_job_commands];
+};
+
+enum class ReplyStatus : int32_t {
+    Ok = 0,
+    Failed = -1,
+    // The daemon had as many jobs, or as much estimated GPU time, queued as it accepts.
+    QueueFull = -2,
+    // The job was queued, but dropped to make room for a job of a tenant with a higher weight.
+    Shed = -3,
+    // The shared buffers of all clients together would exceed the daemon's memory limit.
+    MemoryFull = -4,
+    // The client cancelled the job before it completed.
+    Cancelled = -5,
+    // The job's batch did not complete within the daemon's job timeout. Its results are undefined.
+    TimedOut = -6,
+};
+
+// Reply to RegisterBuffer and Submit. A status other than Ok means the request failed, with a
+// description in `error`. Replies to the jobs of a client arrive in submission order.
+struct ReplyMessage {
+    MessageType type;
+    // The buffer id for BufferRegistered.
+    uint32_t buffer;
+    uint64_t job;
+    ReplyStatus status;
+    // Number of jobs, from all clients, that were submitted to the device together with this one.
+    uint32_t batch_size;
+    // Number of jobs, from all clients, that were queued in the daemon when the reply was sent.
+    uint32_t queued_jobs;
+    char error[100];
+};
+
+#endif
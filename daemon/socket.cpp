@@ -0,0 +1,89 @@
+#include "socket.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+FileDescriptor::~FileDescriptor() {
+    if (this->fd >= 0)
+        close(this->fd);
+}
+
+bool send_packet(int socket, const void* data, size_t size, int fd, int flags) {
+    auto iov = iovec{
+        .iov_base = const_cast<void*>(data),
+        .iov_len = size,
+    };
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    auto msg = msghdr{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &msg, flags | MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && (flags & MSG_DONTWAIT))
+        return false;
+    else if (sent < 0)
+        throw std::system_error(errno, std::generic_category(), "Failed to send packet");
+    return true;
+}
+
+ssize_t receive_packet(int socket, void* data, size_t size, FileDescriptor* fd, int flags) {
+    auto iov = iovec{
+        .iov_base = data,
+        .iov_len = size,
+    };
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    auto msg = msghdr{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &msg, flags | MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && (flags & MSG_DONTWAIT))
+        return -1;
+    else if (received < 0 && errno == ECONNRESET)
+        return 0;
+    else if (received < 0)
+        throw std::system_error(errno, std::generic_category(), "Failed to receive packet");
+
+    // Take ownership of a passed descriptor before anything else, so that it is not leaked.
+    auto passed = FileDescriptor();
+    for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int passed_fd;
+            std::memcpy(&passed_fd, CMSG_DATA(cmsg), sizeof(int));
+            passed = FileDescriptor(passed_fd);
+        }
+    }
+
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+        throw std::runtime_error("Received oversized packet");
+
+    if (fd)
+        *fd = std::move(passed);
+    return received;
+}
@@ -0,0 +1,43 @@
+#ifndef _NIRAH_DAEMON_SOCKET_HPP
+#define _NIRAH_DAEMON_SOCKET_HPP
+
+#include <sys/types.h>
+
+#include <utility>
+#include <cstddef>
+
+// Owns a file descriptor, and closes it when destroyed.
+struct FileDescriptor {
+    int fd = -1;
+
+    FileDescriptor() = default;
+
+    explicit FileDescriptor(int fd):
+        fd(fd) {
+    }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    FileDescriptor(FileDescriptor&& other):
+        fd(std::exchange(other.fd, -1)) {
+    }
+
+    FileDescriptor& operator=(FileDescriptor&& other) {
+        std::swap(this->fd, other.fd);
+        return *this;
+    }
+
+    ~FileDescriptor();
+};
+
+// Sends one packet on a seqpacket socket, passing `fd` along if it is not -1. Returns false if
+// `flags` contains MSG_DONTWAIT and the socket's send buffer is full, and true once it was sent.
+bool send_packet(int socket, const void* data, size_t size, int fd = -1, int flags = 0);
+
+// Receives one packet of at most `size` bytes, and the file descriptor passed along with it, if
+// any, into `fd`. Returns the size of the packet, 0 if the peer hung up, or -1 if `flags` contains
+// MSG_DONTWAIT and no packet is pending. Larger packets are an error.
+ssize_t receive_packet(int socket, void* data, size_t size, FileDescriptor* fd = nullptr, int flags = 0);
+
+#endif
@@ -0,0 +1,122 @@
+#include "aggregate.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <bit>
+
+NIRAH_SHADER(histogram_shared)
+NIRAH_SHADER(histogram_global)
+NIRAH_SHADER(group_by_shared)
+NIRAH_SHADER(group_by_global)
+
+namespace {
+    constexpr uint32_t group_size = 256;
+    // The kernels use grid-stride loops, so that every workgroup processes enough elements
+    // to amortize setting up and merging its private table.
+    constexpr uint32_t max_groups = 512;
+
+    struct Slot {
+        uint32_t key;
+        uint32_t count;
+        uint32_t sum;
+        uint32_t min;
+        uint32_t max;
+    };
+
+    struct Params {
+        uint32_t n;
+        uint32_t size;
+    };
+
+    uint32_t grid_stride_groups(uint32_t n) {
+        return std::clamp(div_ceil(n, group_size), 1u, max_groups);
+    }
+
+    float unorder_float(uint32_t bits) {
+        return std::bit_cast<float>((bits & 0x80000000) ? bits & 0x7FFFFFFF : ~bits);
+    }
+}
+
+void histogram(Context& ctx, BufferView keys, uint32_t n, BufferView bins, uint32_t n_bins) {
+    fill(ctx, {bins.memory, bins.offset, n_bins * sizeof(uint32_t)}, 0);
+    barrier(ctx);
+
+    auto shader = n_bins <= histogram_max_shared_bins ? shaders::histogram_shared : shaders::histogram_global;
+    dispatch_whole(ctx, shader, {ctx.params(Params{n, n_bins}), keys, bins}, grid_stride_groups(n));
+}
+
+GroupByTable create_group_by_table(Context& ctx, uint32_t max_groups) {
+    auto capacity = std::bit_ceil(std::max(max_groups, 1u) * 2);
+    return {
+        .max_groups = max_groups,
+        .capacity = capacity,
+        .slots = create_device_buffer(ctx, capacity * sizeof(Slot)),
+        .overflow = create_device_buffer(ctx, sizeof(uint32_t)),
+    };
+}
+
+void group_by(Context& ctx, const GroupByTable& table, BufferView keys, BufferView values, uint32_t n) {
+    fill(ctx, table.slots, 0);
+    fill(ctx, table.overflow, 0);
+    barrier(ctx);
+
+    auto shader = table.max_groups <= group_by_max_shared_groups ? shaders::group_by_shared : shaders::group_by_global;
+    dispatch_whole(ctx, shader, {ctx.params(Params{n, table.capacity}), keys, values, table.slots, table.overflow}, grid_stride_groups(n));
+}
+
+std::vector<GroupAggregate> read_group_by(const GroupByTable& table) {
+    auto overflow = download_buffer<uint32_t>(table.overflow);
+    if (overflow[0] != 0)
+        throw std::runtime_error("Group-by table overflowed");
+
+    auto result = std::vector<GroupAggregate>();
+    for (const auto& slot : download_buffer<Slot>(table.slots)) {
+        if (slot.count == 0)
+            continue;
+
+        result.push_back({
+            .key = slot.key - 1,
+            .count = slot.count,
+            .sum = std::bit_cast<float>(slot.sum),
+            .min = unorder_float(~slot.min),
+            .max = unorder_float(slot.max),
+        });
+    }
+
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.key < b.key; });
+    return result;
+}
+
+std::vector<uint32_t> histogram_reference(std::span<const uint32_t> keys, uint32_t n_bins) {
+    auto bins = std::vector<uint32_t>(n_bins, 0);
+    for (auto key : keys) {
+        if (key < n_bins)
+            ++bins[key];
+    }
+    return bins;
+}
+
+std::vector<GroupAggregate> group_by_reference(std::span<const uint32_t> keys, std::span<const float> values) {
+    auto groups = std::unordered_map<uint32_t, GroupAggregate>();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] == 0xFFFFFFFF)
+            continue;
+
+        auto [it, inserted] = groups.try_emplace(keys[i], GroupAggregate{keys[i], 0, 0, values[i], values[i]});
+        auto& group = it->second;
+        ++group.count;
+        group.sum += values[i];
+        group.min = std::min(group.min, values[i]);
+        group.max = std::max(group.max, values[i]);
+    }
+
+    auto result = std::vector<GroupAggregate>();
+    result.reserve(groups.size());
+    for (const auto& [key, group] : groups) {
+        result.push_back(group);
+    }
+
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.key < b.key; });
+    return result;
+}
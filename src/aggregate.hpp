@@ -0,0 +1,51 @@
+#ifndef _NIRAH_AGGREGATE_HPP
+#define _NIRAH_AGGREGATE_HPP
+
+#include "context.hpp"
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// Histograms of up to this many bins are privatized per workgroup in LDS.
+constexpr uint32_t histogram_max_shared_bins = 4096;
+
+// Group-by tables of up to this many groups are privatized per workgroup in LDS.
+constexpr uint32_t group_by_max_shared_groups = 512;
+
+struct GroupAggregate {
+    uint32_t key;
+    uint32_t count;
+    float sum;
+    float min;
+    float max;
+};
+
+// Device-side hash table holding the aggregates of a group-by.
+struct GroupByTable {
+    uint32_t max_groups;
+    // Number of slots, a power of 2 of at least twice `max_groups`.
+    uint32_t capacity;
+    Buffer slots;
+    // Number of elements that could not be inserted because the table was full.
+    Buffer overflow;
+};
+
+// Records a histogram of `n` keys in [0, n_bins) into `bins`, which is cleared first.
+// Keys outside of that range are ignored.
+void histogram(Context& ctx, BufferView keys, uint32_t n, BufferView bins, uint32_t n_bins);
+
+GroupByTable create_group_by_table(Context& ctx, uint32_t max_groups);
+
+// Records a clear of the table, followed by a group-by of `n` keys and their values. Key 0xFFFFFFFF
+// is reserved and such elements are ignored.
+void group_by(Context& ctx, const GroupByTable& table, BufferView keys, BufferView values, uint32_t n);
+
+// Reads back the aggregates of every group, sorted by key. Throws if the table overflowed.
+std::vector<GroupAggregate> read_group_by(const GroupByTable& table);
+
+std::vector<uint32_t> histogram_reference(std::span<const uint32_t> keys, uint32_t n_bins);
+
+std::vector<GroupAggregate> group_by_reference(std::span<const uint32_t> keys, std::span<const float> values);
+
+#endif
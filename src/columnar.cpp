@@ -0,0 +1,327 @@
+#include "columnar.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <limits>
+#include <bit>
+
+NIRAH_SHADER(column_filter)
+NIRAH_SHADER(column_project)
+NIRAH_SHADER(column_aggregate)
+
+namespace {
+    constexpr uint32_t group_size = 256;
+    constexpr uint32_t max_aggregate_groups = 512;
+    // Rows per batch of the host implementation.
+    constexpr size_t batch_size = 1024;
+
+    struct FilterParams {
+        double value;
+        uint32_t n_rows;
+        ColumnType type;
+        uint32_t offset;
+        uint32_t nullable;
+        CompareOp op;
+    };
+
+    struct ProjectParams {
+        uint32_t n_rows;
+        ArithOp op;
+        ColumnType lhs_type;
+        uint32_t lhs_offset;
+        uint32_t lhs_nullable;
+        ColumnType rhs_type;
+        uint32_t rhs_offset;
+        uint32_t rhs_nullable;
+        uint32_t rhs_constant;
+        float constant;
+    };
+
+    struct AggregateParams {
+        uint32_t n_rows;
+        ColumnType type;
+        uint32_t offset;
+        uint32_t nullable;
+    };
+
+    struct Partial {
+        uint32_t count;
+        float sum;
+        float min;
+        float max;
+    };
+
+    ColumnType column_type(const ArrowSchema& schema) {
+        auto format = std::string_view(schema.format);
+        if (format == "i")
+            return ColumnType::Int32;
+        if (format == "f")
+            return ColumnType::Float32;
+        throw std::invalid_argument("Unsupported Arrow column format");
+    }
+
+    // Pins the pages containing [data, data + size), and returns a view of the range within them
+    // rounded up to whole words, which the kernels read.
+    BufferView pin(Context& ctx, const void* data, size_t size, std::vector<Unique<Pal::IGpuMemory>>& memory) {
+        auto granularity = ctx.props.gpuMemoryProperties.realMemAllocGranularity;
+        auto address = reinterpret_cast<uintptr_t>(data);
+        auto begin = address / granularity * granularity;
+        auto end = (address + size + granularity - 1) / granularity * granularity;
+
+        memory.push_back(create_pinned_memory(ctx.device, reinterpret_cast<const void*>(begin), end - begin));
+        return {memory.back().ptr, address - begin, std::min<Pal::gpusize>((size + 3) / 4 * 4, end - address)};
+    }
+
+    const DeviceColumn& resolve(const QueryPlan& plan, std::span<const DeviceColumn> inputs, uint32_t index) {
+        if (index < inputs.size())
+            return inputs[index];
+        if (index - inputs.size() < plan.projected.size())
+            return plan.projected[index - inputs.size()];
+        throw std::out_of_range("Query refers to a column that does not exist");
+    }
+
+    // Kernels must be bound to some memory even where they do not read it.
+    BufferView validity_or_values(const DeviceColumn& column) {
+        return column.nullable ? column.validity : column.values;
+    }
+
+    bool compare(double x, CompareOp op, double value) {
+        switch (op) {
+            case CompareOp::Less: return x < value;
+            case CompareOp::LessEqual: return x <= value;
+            case CompareOp::Greater: return x > value;
+            case CompareOp::GreaterEqual: return x >= value;
+            case CompareOp::Equal: return x == value;
+            case CompareOp::NotEqual: return x != value;
+        }
+        return false;
+    }
+
+    float apply(float a, ArithOp op, float b) {
+        switch (op) {
+            case ArithOp::Add: return a + b;
+            case ArithOp::Subtract: return a - b;
+            case ArithOp::Multiply: return a * b;
+            case ArithOp::Divide: return a / b;
+        }
+        return 0;
+    }
+
+    // A batch of a column on the host. Values are kept as doubles, which represent both int32
+    // and float values exactly.
+    struct HostBatch {
+        double values[batch_size];
+        bool valid[batch_size];
+    };
+}
+
+DeviceColumn import_arrow_column(Context& ctx, ArrowColumn column) {
+    auto type = column_type(*column.schema);
+    const auto& array = *column.array;
+    if (array.n_buffers != 2 || array.buffers[1] == nullptr)
+        throw std::invalid_argument("Arrow array is not a primitive array");
+    if (array.offset + array.length > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("Arrow array too large");
+
+    auto result = DeviceColumn{
+        .type = type,
+        .length = static_cast<uint32_t>(array.length),
+        .offset = static_cast<uint32_t>(array.offset),
+        .nullable = array.buffers[0] != nullptr,
+        .values = {},
+        .validity = {},
+        .memory = {},
+    };
+
+    size_t elements = array.offset + array.length;
+    result.values = pin(ctx, array.buffers[1], elements * sizeof(uint32_t), result.memory);
+    if (result.nullable)
+        result.validity = pin(ctx, array.buffers[0], (elements + 7) / 8, result.memory);
+    return result;
+}
+
+QueryPlan create_query_plan(Context& ctx, const Query& query, uint32_t n_rows) {
+    auto plan = QueryPlan{
+        .query = query,
+        .n_rows = n_rows,
+        .groups = std::clamp(div_ceil(n_rows, group_size), 1u, max_aggregate_groups),
+        .selection = create_device_buffer(ctx, div_ceil(n_rows, 32) * sizeof(uint32_t)),
+        .projected = {},
+        .partials = {},
+    };
+
+    for (size_t i = 0; i < query.projections.size(); ++i) {
+        auto values = create_device_buffer(ctx, n_rows * sizeof(float));
+        auto validity = create_device_buffer(ctx, div_ceil(n_rows, 32) * sizeof(uint32_t));
+        auto column = DeviceColumn{
+            .type = ColumnType::Float32,
+            .length = n_rows,
+            .offset = 0,
+            .nullable = true,
+            .values = values,
+            .validity = validity,
+            .memory = {},
+        };
+        column.memory.push_back(std::move(values.memory));
+        column.memory.push_back(std::move(validity.memory));
+        plan.projected.push_back(std::move(column));
+    }
+
+    for (size_t i = 0; i < query.aggregates.size(); ++i) {
+        plan.partials.push_back(create_device_buffer(ctx, plan.groups * sizeof(Partial)));
+    }
+
+    return plan;
+}
+
+void run_query(Context& ctx, const QueryPlan& plan, std::span<const DeviceColumn> inputs) {
+    for (const auto& input : inputs) {
+        if (input.length != plan.n_rows)
+            throw std::invalid_argument("Query input has the wrong number of rows");
+    }
+
+    auto groups = div_ceil(plan.n_rows, group_size);
+
+    fill(ctx, plan.selection, 0xFFFFFFFF);
+    barrier(ctx);
+
+    // Projections may depend on earlier ones, so every projection is followed by a barrier.
+    for (size_t i = 0; i < plan.query.projections.size(); ++i) {
+        const auto& projection = plan.query.projections[i];
+        const auto& lhs = resolve(plan, inputs, projection.lhs);
+        bool constant = projection.rhs == query_constant;
+        const auto& rhs = constant ? lhs : resolve(plan, inputs, projection.rhs);
+        const auto& dst = plan.projected[i];
+
+        auto params = ProjectParams{
+            .n_rows = plan.n_rows,
+            .op = projection.op,
+            .lhs_type = lhs.type,
+            .lhs_offset = lhs.offset,
+            .lhs_nullable = lhs.nullable,
+            .rhs_type = rhs.type,
+            .rhs_offset = rhs.offset,
+            .rhs_nullable = rhs.nullable,
+            .rhs_constant = constant,
+            .constant = projection.constant,
+        };
+        dispatch(
+            ctx,
+            shaders::column_project,
+            {ctx.params(params), lhs.values, validity_or_values(lhs), rhs.values, validity_or_values(rhs), dst.values, dst.validity},
+            groups
+        );
+        barrier(ctx);
+    }
+
+    // Filters AND their result into the selection atomically, so they need no barriers between them.
+    for (const auto& filter : plan.query.filters) {
+        const auto& column = resolve(plan, inputs, filter.column);
+        auto params = FilterParams{
+            .value = filter.value,
+            .n_rows = plan.n_rows,
+            .type = column.type,
+            .offset = column.offset,
+            .nullable = column.nullable,
+            .op = filter.op,
+        };
+        dispatch(ctx, shaders::column_filter, {ctx.params(params), column.values, validity_or_values(column), plan.selection}, groups);
+    }
+    barrier(ctx);
+
+    for (size_t i = 0; i < plan.query.aggregates.size(); ++i) {
+        const auto& column = resolve(plan, inputs, plan.query.aggregates[i]);
+        auto params = AggregateParams{plan.n_rows, column.type, column.offset, column.nullable};
+        dispatch_whole(
+            ctx,
+            shaders::column_aggregate,
+            {ctx.params(params), column.values, validity_or_values(column), plan.selection, plan.partials[i]},
+            plan.groups
+        );
+    }
+}
+
+std::vector<ColumnAggregate> read_query(const QueryPlan& plan) {
+    auto result = std::vector<ColumnAggregate>();
+    for (const auto& buffer : plan.partials) {
+        auto aggregate = ColumnAggregate{0, 0, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+        for (const auto& partial : download_buffer<Partial>(buffer)) {
+            aggregate.count += partial.count;
+            aggregate.sum += partial.sum;
+            aggregate.min = std::min(aggregate.min, partial.min);
+            aggregate.max = std::max(aggregate.max, partial.max);
+        }
+        result.push_back(aggregate);
+    }
+    return result;
+}
+
+std::vector<ColumnAggregate> query_reference(std::span<const ArrowColumn> inputs, const Query& query) {
+    auto n_rows = inputs.empty() ? 0 : static_cast<size_t>(inputs[0].array->length);
+    auto batches = std::vector<HostBatch>(inputs.size() + query.projections.size());
+    bool selected[batch_size];
+
+    auto result = std::vector<ColumnAggregate>(
+        query.aggregates.size(),
+        {0, 0, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()}
+    );
+
+    for (size_t first = 0; first < n_rows; first += batch_size) {
+        size_t count = std::min(batch_size, n_rows - first);
+
+        for (size_t c = 0; c < inputs.size(); ++c) {
+            const auto& array = *inputs[c].array;
+            auto& batch = batches[c];
+            size_t offset = array.offset + first;
+            auto validity = static_cast<const uint8_t*>(array.buffers[0]);
+
+            if (column_type(*inputs[c].schema) == ColumnType::Int32) {
+                auto values = static_cast<const int32_t*>(array.buffers[1]) + offset;
+                std::copy(values, values + count, batch.values);
+            } else {
+                auto values = static_cast<const float*>(array.buffers[1]) + offset;
+                std::copy(values, values + count, batch.values);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                batch.valid[i] = validity == nullptr || (validity[(offset + i) / 8] >> ((offset + i) % 8)) & 1;
+            }
+        }
+
+        for (size_t p = 0; p < query.projections.size(); ++p) {
+            const auto& projection = query.projections[p];
+            const auto& lhs = batches.at(projection.lhs);
+            auto& dst = batches[inputs.size() + p];
+            for (size_t i = 0; i < count; ++i) {
+                bool constant = projection.rhs == query_constant;
+                float b = constant ? projection.constant : static_cast<float>(batches.at(projection.rhs).values[i]);
+                dst.values[i] = apply(static_cast<float>(lhs.values[i]), projection.op, b);
+                dst.valid[i] = lhs.valid[i] && (constant || batches.at(projection.rhs).valid[i]);
+            }
+        }
+
+        std::fill(selected, selected + count, true);
+        for (const auto& filter : query.filters) {
+            const auto& column = batches.at(filter.column);
+            for (size_t i = 0; i < count; ++i) {
+                selected[i] &= column.valid[i] && compare(column.values[i], filter.op, filter.value);
+            }
+        }
+
+        for (size_t a = 0; a < query.aggregates.size(); ++a) {
+            const auto& column = batches.at(query.aggregates[a]);
+            auto& aggregate = result[a];
+            for (size_t i = 0; i < count; ++i) {
+                if (!selected[i] || !column.valid[i])
+                    continue;
+                auto x = static_cast<float>(column.values[i]);
+                ++aggregate.count;
+                aggregate.sum += x;
+                aggregate.min = std::min(aggregate.min, x);
+                aggregate.max = std::max(aggregate.max, x);
+            }
+        }
+    }
+
+    return result;
+}
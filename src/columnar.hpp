@@ -0,0 +1,147 @@
+#ifndef _NIRAH_COLUMNAR_HPP
+#define _NIRAH_COLUMNAR_HPP
+
+#include "context.hpp"
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// Arrow C data interface, see https://arrow.apache.org/docs/format/CDataInterface.html.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif
+
+// Primitive Arrow arrays of int32 (format "i") and float32 (format "f") are supported.
+enum class ColumnType : uint32_t {
+    Int32,
+    Float32,
+};
+
+struct ArrowColumn {
+    const ArrowSchema* schema;
+    const ArrowArray* array;
+};
+
+// A column in the Arrow layout that the device can access: values[offset + row], and bit
+// offset + row of the validity bitmap if the column is nullable.
+struct DeviceColumn {
+    ColumnType type;
+    uint32_t length;
+    uint32_t offset;
+    bool nullable;
+    BufferView values;
+    BufferView validity;
+    // Pinned host memory of imported columns, or device memory of computed ones.
+    std::vector<Unique<Pal::IGpuMemory>> memory;
+};
+
+// Imports an Arrow array without copying it, by pinning the host memory of its buffers. The
+// array must not be released while the column is in use.
+DeviceColumn import_arrow_column(Context& ctx, ArrowColumn column);
+
+enum class CompareOp : uint32_t {
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+};
+
+enum class ArithOp : uint32_t {
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+};
+
+// Use the constant of a projection rather than a column as the right-hand side.
+constexpr uint32_t query_constant = 0xFFFFFFFF;
+
+// Queries refer to columns by index: the input columns, followed by the result of every projection.
+
+// Rows are selected if `column op value` holds, and the column is not null.
+struct Predicate {
+    uint32_t column;
+    CompareOp op;
+    double value;
+};
+
+// A float column lhs op rhs, null where either operand is null.
+struct Projection {
+    uint32_t lhs;
+    ArithOp op;
+    uint32_t rhs;
+    float constant = 0;
+};
+
+// SELECT count, sum, min, max of every aggregated column FROM the inputs WHERE all filters hold.
+struct Query {
+    std::vector<Predicate> filters;
+    std::vector<Projection> projections;
+    std::vector<uint32_t> aggregates;
+};
+
+// Aggregate of the non-null values of a column in the selected rows.
+struct ColumnAggregate {
+    uint64_t count;
+    double sum;
+    float min;
+    float max;
+};
+
+// Device state of a query: the selection, with one bit per row, the projected columns and the
+// partial aggregates of every workgroup.
+struct QueryPlan {
+    Query query;
+    uint32_t n_rows;
+    uint32_t groups;
+    Buffer selection;
+    std::vector<DeviceColumn> projected;
+    std::vector<Buffer> partials;
+};
+
+QueryPlan create_query_plan(Context& ctx, const Query& query, uint32_t n_rows);
+
+// Records the query as a chain of dispatches, one per operator, that only communicate through
+// device memory. All inputs must have n_rows rows.
+void run_query(Context& ctx, const QueryPlan& plan, std::span<const DeviceColumn> inputs);
+
+// Combines the partial aggregates of the last run, in the order of query.aggregates.
+std::vector<ColumnAggregate> read_query(const QueryPlan& plan);
+
+// Executes the query on the host, a batch of rows at a time.
+std::vector<ColumnAggregate> query_reference(std::span<const ArrowColumn> inputs, const Query& query);
+
+#endif
@@ -0,0 +1,589 @@
+#include "context.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+    constexpr Pal::gpusize transient_heap_size = 4 * 1024 * 1024;
+    // Pipeline creation mostly parses the binary and uploads its code, which scales with threads
+    // up to about this many.
+    constexpr uint32_t max_pipeline_threads = 8;
+
+    void init_device(Pal::IDevice* device, const Pal::DeviceProperties& props) {
+        auto finalize_info = Pal::DeviceFinalizeInfo{};
+        // Every compute engine, so that queues of different priority can run side by side, see
+        // create_queue_context. Engines are requested as a mask of engine indices.
+        auto compute_engines = std::min<uint32_t>(props.engineProperties[Pal::EngineTypeCompute].engineCount, 32);
+        finalize_info.requestedEngineCounts[Pal::EngineTypeCompute].engines = compute_engines == 32 ? ~0u : (1u << compute_engines) - 1;
+        // For background transfers, see create_upload_cache.
+        if (props.engineProperties[Pal::EngineTypeDma].engineCount > 0)
+            finalize_info.requestedEngineCounts[Pal::EngineTypeDma].engines = 1;
+        checkResult(device->CommitSettingsAndInit());
+        checkResult(device->Finalize(finalize_info));
+    }
+
+    // Creates the pipelines of the context again, spread over several threads.
+    void recreate_pipelines(Context& ctx) {
+        auto entries = std::vector<CachedPipeline*>();
+        for (auto& [start, cached] : ctx.pipelines) {
+            entries.push_back(&cached);
+        }
+
+        auto threads = std::min<size_t>({entries.size(), std::max(std::thread::hardware_concurrency(), 1u), max_pipeline_threads});
+        auto errors = std::vector<std::exception_ptr>(threads);
+        auto workers = std::vector<std::thread>();
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                try {
+                    for (size_t i = t; i < entries.size(); i += threads) {
+                        entries[i]->pipeline = create_pipeline(ctx.device, entries[i]->binary);
+                    }
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (const auto& error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    TransientHeap create_transient_heap(Pal::IDevice* device) {
+        auto memory = create_buffer(device, transient_heap_size, Pal::VaRange::DescriptorTable, Pal::GpuHeapGartUswc);
+        void* data;
+        checkResult(memory->Map(&data));
+        return {
+            .memory = std::move(memory),
+            .data = static_cast<std::byte*>(data),
+            .capacity = transient_heap_size,
+            .offset = 0,
+        };
+    }
+}
+
+BufferView TransientHeap::alloc(Pal::gpusize size, Pal::gpusize alignment) {
+    auto view = this->try_alloc(size, alignment);
+    if (!view) [[unlikely]]
+        throw std::runtime_error("Transient heap exhausted");
+    return *view;
+}
+
+Expected<BufferView> TransientHeap::try_alloc(Pal::gpusize size, Pal::gpusize alignment) {
+    auto offset = (this->offset + alignment - 1) / alignment * alignment;
+    if (offset + size > this->capacity) [[unlikely]]
+        return Util::Result::ErrorOutOfMemory;
+    this->offset = offset + size;
+    return BufferView{this->memory.ptr, offset, size};
+}
+
+Pal::IPipeline* Context::pipeline(ShaderBinary shader) {
+    return this->try_pipeline(shader).value();
+}
+
+Expected<Pal::IPipeline*> Context::try_pipeline(ShaderBinary shader) {
+    auto it = this->pipelines.find(shader.start);
+    if (it != this->pipelines.end()) [[likely]]
+        return it->second.pipeline.ptr;
+
+    auto pipeline = try_create_pipeline(this->device, shader);
+    if (!pipeline) [[unlikely]]
+        return pipeline.error();
+    it = this->pipelines.emplace(shader.start, CachedPipeline{shader, std::move(*pipeline)}).first;
+    return it->second.pipeline.ptr;
+}
+
+void Context::begin() {
+    checkResult(this->try_begin());
+}
+
+void Context::submit() {
+    checkResult(this->try_submit());
+}
+
+void Context::submit_async() {
+    checkResult(this->try_submit_async());
+}
+
+void Context::wait() {
+    checkResult(this->try_wait());
+}
+
+bool Context::wait_for(std::chrono::nanoseconds timeout) {
+    auto result = this->try_wait(timeout);
+    checkResult(result);
+    return result == Util::Result::Success;
+}
+
+bool Context::discard(std::chrono::nanoseconds timeout) {
+    // The command buffer was ended to submit it, so only the wait is left.
+    if (this->in_flight)
+        return this->wait_for(timeout);
+    checkResult(this->cmd_buf->Reset(nullptr, true));
+    this->transient.reset();
+    return true;
+}
+
+Util::Result Context::try_begin() {
+    return this->cmd_buf->Begin({});
+}
+
+Util::Result Context::try_submit() {
+    auto result = this->try_submit_async();
+    if (result != Util::Result::Success) [[unlikely]]
+        return result;
+    return this->try_wait();
+}
+
+Util::Result Context::try_submit_async() {
+    auto result = this->cmd_buf->End();
+    if (result != Util::Result::Success) [[unlikely]]
+        return result;
+    result = try_submit_cmd_buffer(this->queue.ptr, this->cmd_buf.ptr, this->fence.ptr);
+    this->in_flight = result == Util::Result::Success;
+    return result;
+}
+
+Util::Result Context::try_wait(std::chrono::nanoseconds timeout) {
+    auto result = try_wait_fence(this->device, this->fence.ptr, timeout);
+    if (result == Util::Result::Success) [[likely]] {
+        this->in_flight = false;
+        this->transient.reset();
+    }
+    return result;
+}
+
+Context create_context() {
+    auto platform = create_platform();
+    fmt::print("Platform initialized\n");
+
+    auto* device = select_device(platform.ptr);
+    Pal::DeviceProperties props;
+    checkResult(device->GetProperties(&props));
+    fmt::print("Selected device '{}'\n", props.gpuName);
+
+    init_device(device, props);
+    fmt::print("Device initialized\n");
+
+    auto queue = create_queue(device, props);
+    auto cmda = create_cmd_allocator(device);
+    auto cmd_buf = create_cmd_buffer(device, cmda.ptr);
+    auto fence = create_fence(device);
+    auto transient = create_transient_heap(device);
+
+    return {
+        .platform = std::move(platform),
+        .device = device,
+        .props = props,
+        .queue = std::move(queue),
+        .cmda = std::move(cmda),
+        .cmd_buf = std::move(cmd_buf),
+        .fence = std::move(fence),
+        .in_flight = false,
+        .transient = std::move(transient),
+        .pipelines = {},
+    };
+}
+
+Context create_queue_context(Context& parent, Pal::QueuePriority priority, uint32_t engine_index) {
+    auto queue = create_queue(parent.device, parent.props, Pal::EngineTypeCompute, priority, engine_index);
+    auto cmda = create_cmd_allocator(parent.device);
+    auto cmd_buf = create_cmd_buffer(parent.device, cmda.ptr);
+    auto fence = create_fence(parent.device);
+    auto transient = create_transient_heap(parent.device);
+
+    return {
+        .platform = {},
+        .device = parent.device,
+        .props = parent.props,
+        .queue = std::move(queue),
+        .cmda = std::move(cmda),
+        .cmd_buf = std::move(cmd_buf),
+        .fence = std::move(fence),
+        .in_flight = false,
+        .transient = std::move(transient),
+        .pipelines = {},
+    };
+}
+
+RecoveryStats recover_context(Context& ctx) {
+    if (!ctx.platform.ptr)
+        throw std::invalid_argument("Only contexts from create_context can be recovered");
+
+    auto stats = RecoveryStats{};
+    auto last = std::chrono::steady_clock::now();
+    auto lap = [&] {
+        auto now = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(now - std::exchange(last, now)).count();
+    };
+
+    // Everything on the old device goes before the device is cleaned up, in reverse order of
+    // creation. The binaries of the pipelines stay.
+    for (auto& [start, cached] : ctx.pipelines) {
+        cached.pipeline = {};
+    }
+    if (ctx.slicing)
+        ctx.slicing->timestamps = {};
+    ctx.transient = {};
+    ctx.fence = {};
+    ctx.cmd_buf = {};
+    ctx.cmda = {};
+    ctx.queue = {};
+    stats.teardown = lap();
+
+    // Cleanup undoes CommitSettingsAndInit and Finalize, after which the device may be initialized
+    // again. That fails if the device itself is gone, for example after the driver was reloaded.
+    stats.reused_device = true;
+    try {
+        checkResult(ctx.device->Cleanup());
+        init_device(ctx.device, ctx.props);
+    } catch (const PalError& e) {
+        fmt::print(stderr, "Failed to reinitialize the device in place (error {}), creating a new platform\n", static_cast<int>(e.result));
+        stats.reused_device = false;
+        ctx.device = nullptr;
+        ctx.platform = {};
+        ctx.platform = create_platform();
+        ctx.device = select_device(ctx.platform.ptr);
+        checkResult(ctx.device->GetProperties(&ctx.props));
+        init_device(ctx.device, ctx.props);
+    }
+    stats.device = lap();
+
+    ctx.queue = create_queue(ctx.device, ctx.props);
+    ctx.cmda = create_cmd_allocator(ctx.device);
+    ctx.cmd_buf = create_cmd_buffer(ctx.device, ctx.cmda.ptr);
+    ctx.fence = create_fence(ctx.device);
+    ctx.in_flight = false;
+    ctx.transient = create_transient_heap(ctx.device);
+    if (ctx.slicing)
+        ctx.slicing->timestamps = create_host_buffer(ctx, 2 * sizeof(uint64_t));
+    stats.objects = lap();
+
+    recreate_pipelines(ctx);
+    stats.pipelines = lap();
+    stats.pipeline_count = static_cast<uint32_t>(ctx.pipelines.size());
+    return stats;
+}
+
+QueueRouter create_queue_router(Context& ctx) {
+    auto pick = [&](std::initializer_list<Pal::QueuePriority> priorities) {
+        for (auto priority : priorities) {
+            if (supports_queue_priority(ctx.props, Pal::EngineTypeCompute, priority))
+                return priority;
+        }
+        return Pal::QueuePriority::Normal;
+    };
+
+    auto interactive = pick({Pal::QueuePriority::High, Pal::QueuePriority::Medium});
+    auto bulk = pick({Pal::QueuePriority::Idle});
+    if (interactive == Pal::QueuePriority::Normal)
+        fmt::print("Device does not support high priority compute queues, interactive work uses a normal queue\n");
+
+    auto engines = ctx.props.engineProperties[Pal::EngineTypeCompute].engineCount;
+    return {
+        .interactive = create_queue_context(ctx, interactive, engines > 1 ? 1 : 0),
+        .bulk = create_queue_context(ctx, bulk, engines > 2 ? 2 : 0),
+    };
+}
+
+Buffer create_device_buffer(Context& ctx, Pal::gpusize size) {
+    return try_create_device_buffer(ctx, size).value();
+}
+
+Buffer create_host_buffer(Context& ctx, Pal::gpusize size) {
+    return try_create_host_buffer(ctx, size).value();
+}
+
+Expected<Buffer> try_create_device_buffer(Context& ctx, Pal::gpusize size) {
+    // Pal does not allow empty allocations, but empty buffers are still useful to bind.
+    auto memory = try_create_buffer(ctx.device, std::max<Pal::gpusize>(size, 4));
+    if (!memory) [[unlikely]]
+        return memory.error();
+    return Buffer{std::move(*memory), size};
+}
+
+Expected<Buffer> try_create_host_buffer(Context& ctx, Pal::gpusize size) {
+    auto memory = try_create_buffer(ctx.device, std::max<Pal::gpusize>(size, 4), Pal::VaRange::Default, Pal::GpuHeapGartUswc);
+    if (!memory) [[unlikely]]
+        return memory.error();
+    return Buffer{std::move(*memory), size};
+}
+
+namespace {
+    // Writes the SRDs of `bindings` into a descriptor table in transient memory.
+    void write_table(Context& ctx, BufferView table, std::initializer_list<BufferView> bindings) {
+        // The shader reads the buffer SRDs from the table in reverse binding order.
+        auto infos = std::vector<Pal::BufferViewInfo>();
+        infos.reserve(bindings.size());
+        for (auto it = std::rbegin(bindings); it != std::rend(bindings); ++it) {
+            infos.push_back({
+                .gpuAddr = it->gpu_addr(),
+                .range = it->size,
+                .stride = 0,
+                .swizzledFormat = Pal::UndefinedSwizzledFormat,
+            });
+        }
+        ctx.device->CreateUntypedBufferViewSrds(infos.size(), infos.data(), ctx.transient.data + table.offset);
+    }
+
+    BufferView create_table(Context& ctx, std::initializer_list<BufferView> bindings) {
+        auto table = ctx.transient.alloc(ctx.props.gfxipProperties.srdSizes.bufferView * bindings.size());
+        write_table(ctx, table, bindings);
+        return table;
+    }
+
+    Expected<BufferView> try_create_table(Context& ctx, std::initializer_list<BufferView> bindings) {
+        auto table = ctx.transient.try_alloc(ctx.props.gfxipProperties.srdSizes.bufferView * bindings.size());
+        if (table) [[likely]]
+            write_table(ctx, *table, bindings);
+        return table;
+    }
+
+    void bind(Context& ctx, Pal::IPipeline* pipeline, BufferView table) {
+        alignas(16) uint32_t user_data[1];
+        user_data[0] = table.gpu_addr() & 0xFFFFFFFF;
+
+        ctx.cmd_buf->CmdBindPipeline({
+            .pipelineBindPoint = Pal::PipelineBindPoint::Compute,
+            .pPipeline = pipeline,
+            .apiPsoHash = 1234, // ??
+        });
+        // Shader disassembly shows that SGPR 2 is used for the descriptor table, but apparently that offset is already added here?
+        ctx.cmd_buf->CmdSetUserData(Pal::PipelineBindPoint::Compute, 0, 1, user_data);
+    }
+
+    void bind(Context& ctx, ShaderBinary shader, BufferView table) {
+        bind(ctx, ctx.pipeline(shader), table);
+    }
+
+    void bind(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings) {
+        bind(ctx, shader, create_table(ctx, bindings));
+    }
+
+    // Size of the first slice of a shader whose cost is not known yet.
+    constexpr uint64_t slicing_probe_groups = 64;
+    // Limits how much a slice may grow over the previous one, in case a measurement was too low.
+    constexpr uint64_t slicing_max_growth = 4;
+    // Weight of the latest measurement in DispatchSlicing::group_cost.
+    constexpr double slicing_smoothing = 0.25;
+
+    // Submits the work recorded so far, waits for it until the deadline and continues recording in a
+    // new submission.
+    // Unlike Context::submit, this keeps the transient heap, as the recording may still refer to it.
+    void submit_slice(Context& ctx) {
+        checkResult(ctx.cmd_buf->End());
+        submit_cmd_buffer(ctx.queue.ptr, ctx.cmd_buf.ptr, ctx.fence.ptr);
+        ctx.in_flight = true;
+        auto deadline = ctx.slicing->deadline;
+        auto timeout = deadline == std::chrono::steady_clock::time_point::max()
+            ? std::chrono::nanoseconds::max()
+            : std::chrono::nanoseconds(deadline - std::chrono::steady_clock::now());
+        if (!wait_fence(ctx.device, ctx.fence.ptr, timeout))
+            throw SliceTimeoutError("Slice did not complete in time");
+        ctx.in_flight = false;
+        checkResult(ctx.cmd_buf->Begin({}));
+    }
+
+    bool should_slice(const DispatchSlicing& slicing, ShaderBinary shader, DispatchSize groups) {
+        if (groups.z != 1)
+            return false;
+        auto total = uint64_t{groups.x} * groups.y;
+        auto it = slicing.group_cost.find(shader.start);
+        if (it == slicing.group_cost.end())
+            return total > slicing_probe_groups;
+        return total * it->second > slicing.target;
+    }
+
+    // Dispatches whole rows at a time while a row fits in a slice, and parts of a row otherwise.
+    void dispatch_sliced(Context& ctx, ShaderBinary shader, BufferView table, DispatchSize groups) {
+        auto& slicing = *ctx.slicing;
+        auto before = slicing.timestamps.view(0, sizeof(uint64_t));
+        auto after = slicing.timestamps.view(sizeof(uint64_t), sizeof(uint64_t));
+        submit_slice(ctx);
+
+        auto offset = DispatchSize{0, 0};
+        auto last = slicing_probe_groups;
+        while (offset.y < groups.y) {
+            if (slicing.cancelled && (offset.x != 0 || offset.y != 0) && slicing.cancelled())
+                throw CancelledError("Dispatch cancelled");
+
+            auto it = slicing.group_cost.find(shader.start);
+            auto budget = static_cast<double>(slicing_probe_groups);
+            if (it != slicing.group_cost.end())
+                budget = std::clamp(slicing.target / it->second, 1.0, static_cast<double>(last * slicing_max_growth));
+            auto budget_groups = static_cast<uint64_t>(std::llround(budget));
+
+            auto size = DispatchSize{groups.x - offset.x, 1};
+            if (offset.x == 0 && budget_groups >= groups.x)
+                size.y = std::min<uint64_t>(budget_groups / groups.x, groups.y - offset.y);
+            else
+                size.x = std::min<uint64_t>(budget_groups, size.x);
+
+            write_timestamp(ctx, before);
+            bind(ctx, shader, table);
+            ctx.cmd_buf->CmdDispatchOffset(offset.x, offset.y, 0, size.x, size.y, 1);
+            write_timestamp(ctx, after);
+            submit_slice(ctx);
+
+            uint64_t timestamps[2];
+            read_buffer(slicing.timestamps, timestamps);
+            last = uint64_t{size.x} * size.y;
+            auto cost = static_cast<double>(timestamps[1] - timestamps[0]) / ctx.props.timestampFrequency / last;
+            auto [entry, inserted] = slicing.group_cost.try_emplace(shader.start, cost);
+            if (!inserted)
+                entry->second += slicing_smoothing * (cost - entry->second);
+            ++slicing.slices;
+
+            offset.x += size.x;
+            if (offset.x == groups.x) {
+                offset.x = 0;
+                offset.y += size.y;
+            }
+        }
+    }
+}
+
+void dispatch(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, DispatchSize groups) {
+    if (ctx.slicing && should_slice(*ctx.slicing, shader, groups)) {
+        dispatch_sliced(ctx, shader, create_table(ctx, bindings), groups);
+    } else {
+        dispatch_whole(ctx, shader, bindings, groups);
+    }
+}
+
+Util::Result try_dispatch(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, DispatchSize groups) {
+    auto table = try_create_table(ctx, bindings);
+    if (!table) [[unlikely]]
+        return table.error();
+
+    if (ctx.slicing && should_slice(*ctx.slicing, shader, groups)) {
+        // Every slice is submitted and waited for, which dwarfs the cost of an exception.
+        try {
+            dispatch_sliced(ctx, shader, *table, groups);
+        } catch (const PalError& e) {
+            return e.result;
+        }
+        return Util::Result::Success;
+    }
+
+    auto pipeline = ctx.try_pipeline(shader);
+    if (!pipeline) [[unlikely]]
+        return pipeline.error();
+    bind(ctx, *pipeline, *table);
+    ctx.cmd_buf->CmdDispatch(groups.x, groups.y, groups.z);
+    return Util::Result::Success;
+}
+
+void dispatch_whole(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, DispatchSize groups) {
+    bind(ctx, shader, bindings);
+    ctx.cmd_buf->CmdDispatch(groups.x, groups.y, groups.z);
+}
+
+void dispatch_offset(
+    Context& ctx,
+    ShaderBinary shader,
+    std::initializer_list<BufferView> bindings,
+    DispatchSize offset,
+    DispatchSize groups
+) {
+    bind(ctx, shader, bindings);
+    ctx.cmd_buf->CmdDispatchOffset(offset.x, offset.y, offset.z, groups.x, groups.y, groups.z);
+}
+
+void enable_slicing(Context& ctx, std::chrono::microseconds target) {
+    if (target.count() <= 0)
+        throw std::invalid_argument("Slice target must be positive");
+    auto target_seconds = std::chrono::duration<double>(target).count();
+    if (ctx.slicing) {
+        ctx.slicing->target = target_seconds;
+        return;
+    }
+
+    ctx.slicing = std::make_unique<DispatchSlicing>(DispatchSlicing{
+        .target = target_seconds,
+        .cancelled = {},
+        .deadline = std::chrono::steady_clock::time_point::max(),
+        .group_cost = {},
+        .timestamps = create_host_buffer(ctx, 2 * sizeof(uint64_t)),
+        .slices = 0,
+    });
+}
+
+void disable_slicing(Context& ctx) {
+    ctx.slicing.reset();
+}
+
+void dispatch_indirect(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, BufferView args) {
+    bind(ctx, shader, bindings);
+    ctx.cmd_buf->CmdDispatchIndirect(*args.memory, args.offset);
+}
+
+namespace {
+    void barrier(Context& ctx, Pal::HwPipePoint wait_point, uint32_t dst_cache_mask) {
+        const Pal::HwPipePoint pipe_point = Pal::HwPipePostCs;
+        auto transition = Pal::BarrierTransition{
+            .srcCacheMask = Pal::CoherShader | Pal::CoherCopy,
+            .dstCacheMask = dst_cache_mask,
+        };
+
+        auto info = Pal::BarrierInfo{};
+        info.waitPoint = wait_point;
+        info.pipePointWaitCount = 1;
+        info.pPipePoints = &pipe_point;
+        info.transitionCount = 1;
+        info.pTransitions = &transition;
+        ctx.cmd_buf->CmdBarrier(info);
+    }
+}
+
+void barrier(Context& ctx) {
+    barrier(ctx, Pal::HwPipePreCs, Pal::CoherShader | Pal::CoherCopy);
+}
+
+void indirect_barrier(Context& ctx) {
+    // Indirect arguments are fetched before the dispatch reaches the shader stage.
+    barrier(ctx, Pal::HwPipeTop, Pal::CoherShader | Pal::CoherCopy | Pal::CoherIndirectArgs);
+}
+
+void write_timestamp(Context& ctx, BufferView view) {
+    ctx.cmd_buf->CmdWriteTimestamp(Pal::HwPipeBottom, *view.memory, view.offset);
+}
+
+void fill(Context& ctx, BufferView view, uint32_t value) {
+    ctx.cmd_buf->CmdFillMemory(*view.memory, view.offset, view.size, value);
+}
+
+void update(Context& ctx, BufferView view, std::span<const uint32_t> data) {
+    ctx.cmd_buf->CmdUpdateMemory(*view.memory, view.offset, data.size_bytes(), data.data());
+}
+
+void copy(Context& ctx, BufferView src, BufferView dst) {
+    auto region = Pal::MemoryCopyRegion{
+        .srcOffset = src.offset,
+        .dstOffset = dst.offset,
+        .copySize = src.size,
+    };
+    ctx.cmd_buf->CmdCopyMemory(*src.memory, *dst.memory, 1, &region);
+}
+
+void write_buffer(BufferView view, const void* data) {
+    void* mapped;
+    checkResult(view.memory->Map(&mapped));
+    std::memcpy(static_cast<std::byte*>(mapped) + view.offset, data, view.size);
+    checkResult(view.memory->Unmap());
+}
+
+void read_buffer(BufferView view, void* data) {
+    void* mapped;
+    checkResult(view.memory->Map(&mapped));
+    std::memcpy(data, static_cast<const std::byte*>(mapped) + view.offset, view.size);
+    checkResult(view.memory->Unmap());
+}
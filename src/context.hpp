@@ -0,0 +1,335 @@
+#ifndef _NIRAH_CONTEXT_HPP
+#define _NIRAH_CONTEXT_HPP
+
+#include "core.hpp"
+
+#include <unordered_map>
+#include <initializer_list>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+constexpr uint32_t div_ceil(uint32_t a, uint32_t b) {
+    return (a + b - 1) / b;
+}
+
+// Number of workgroups (or invocations) in each dimension of a dispatch.
+struct DispatchSize {
+    uint32_t x;
+    uint32_t y = 1;
+    uint32_t z = 1;
+};
+
+// Number of workgroups of `group_size` needed to cover `items` in every dimension.
+constexpr DispatchSize grid_size(DispatchSize items, DispatchSize group_size) {
+    return {
+        div_ceil(items.x, group_size.x),
+        div_ceil(items.y, group_size.y),
+        div_ceil(items.z, group_size.z),
+    };
+}
+
+// A range of GPU memory that can be bound to a shader.
+struct BufferView {
+    Pal::IGpuMemory* memory;
+    Pal::gpusize offset;
+    Pal::gpusize size;
+
+    Pal::gpusize gpu_addr() const {
+        return this->memory->Desc().gpuVirtAddr + this->offset;
+    }
+};
+
+struct Buffer {
+    Unique<Pal::IGpuMemory> memory;
+    // The size that was requested; the actual allocation may be larger.
+    Pal::gpusize size;
+
+    BufferView view(Pal::gpusize offset, Pal::gpusize size) const {
+        return {this->memory.ptr, offset, size};
+    }
+
+    operator BufferView() const {
+        return this->view(0, this->size);
+    }
+};
+
+// Linear allocator for data that only lives as long as one submission, such as descriptor tables and
+// kernel parameters. The memory is persistently mapped and lives in the descriptor table va range,
+// so that its addresses may be passed through a single user data entry.
+struct TransientHeap {
+    Unique<Pal::IGpuMemory> memory;
+    std::byte* data;
+    Pal::gpusize capacity;
+    Pal::gpusize offset;
+
+    BufferView alloc(Pal::gpusize size, Pal::gpusize alignment = 64);
+
+    // Like alloc, but fails with ErrorOutOfMemory instead of throwing.
+    Expected<BufferView> try_alloc(Pal::gpusize size, Pal::gpusize alignment = 64);
+
+    void reset() {
+        this->offset = 0;
+    }
+};
+
+// Thrown by a sliced dispatch that was cancelled, see DispatchSlicing::cancelled.
+struct CancelledError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Thrown by a sliced dispatch whose slice did not complete in time, see DispatchSlicing::deadline.
+struct SliceTimeoutError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// State of dispatch slicing, see enable_slicing.
+struct DispatchSlicing {
+    // GPU time that one slice should take, in seconds.
+    double target;
+    // If set, called before every slice but the first. Once it returns true, the dispatch stops
+    // and throws CancelledError, leaving the command buffer ready for further recording; the work
+    // that was recorded before the dispatch has been submitted by then.
+    std::function<bool()> cancelled;
+    // If a slice has not completed by then, the dispatch throws SliceTimeoutError. The slice is
+    // left in flight on the context's fence, and the command buffer is ended, like after
+    // Context::submit_async.
+    std::chrono::steady_clock::time_point deadline;
+    // Moving average of the GPU time per workgroup of each shader that was sliced, in seconds.
+    std::unordered_map<const char*, double> group_cost;
+    // Timestamps before and after the slice in flight.
+    Buffer timestamps;
+    uint64_t slices;
+};
+
+// A pipeline of a context, along with the binary it was created from, to create it again after the
+// device was lost.
+struct CachedPipeline {
+    ShaderBinary binary;
+    Unique<Pal::IPipeline> pipeline;
+};
+
+struct Context {
+    Unique<Pal::IPlatform> platform;
+    Pal::IDevice* device;
+    Pal::DeviceProperties props;
+    Unique<Pal::IQueue> queue;
+    Unique<Pal::ICmdAllocator> cmda;
+    Unique<Pal::ICmdBuffer> cmd_buf;
+    // Signaled when the last submission completes.
+    Unique<Pal::IFence> fence;
+    // Set from a submission until it has been waited for.
+    bool in_flight;
+    TransientHeap transient;
+    std::unordered_map<const char*, CachedPipeline> pipelines;
+    // Set while dispatches are sliced.
+    std::unique_ptr<DispatchSlicing> slicing;
+
+    // Returns the pipeline for a shader, creating it the first time it is requested.
+    Pal::IPipeline* pipeline(ShaderBinary shader);
+
+    Expected<Pal::IPipeline*> try_pipeline(ShaderBinary shader);
+
+    // Copies a kernel parameter block into transient memory, so that it can be bound as a buffer.
+    template <typename T>
+    BufferView params(const T& value) {
+        auto view = this->transient.alloc(sizeof(T));
+        std::memcpy(this->transient.data + view.offset, &value, sizeof(T));
+        return view;
+    }
+
+    // Starts recording into the context's command buffer.
+    void begin();
+
+    // Ends recording, submits the command buffer and waits for it to complete.
+    void submit();
+
+    // Like submit, but returns without waiting, so that the host can prepare other work while the
+    // device runs. The submission must be waited for before recording the next one.
+    void submit_async();
+
+    // Waits for the last submission to complete.
+    void wait();
+
+    // Like wait, but gives up after `timeout` and returns false. The submission must then be
+    // waited for again before recording the next one.
+    bool wait_for(std::chrono::nanoseconds timeout);
+
+    // Abandons the recording after an error, whatever state it was left in, so that the next begin
+    // starts afresh. If a submission is in flight, such as an earlier slice of a sliced dispatch,
+    // waits for it like wait_for instead.
+    bool discard(std::chrono::nanoseconds timeout = std::chrono::nanoseconds::max());
+
+    // Non-throwing versions of the above, for hot paths. try_wait returns Timeout or NotReady if
+    // the submission did not complete in time, see try_wait_fence.
+    Util::Result try_begin();
+
+    Util::Result try_submit();
+
+    Util::Result try_submit_async();
+
+    Util::Result try_wait(std::chrono::nanoseconds timeout = std::chrono::nanoseconds::max());
+};
+
+Context create_context();
+
+// Creates a context that shares the device of `parent`, but submits to its own compute queue of
+// `priority`, on engine `engine_index`. It has its own command buffer, transient heap and pipelines,
+// so it can be used from another thread. `parent` must outlive it.
+Context create_queue_context(Context& parent, Pal::QueuePriority priority, uint32_t engine_index);
+
+// How work is routed to queues, see QueueRouter.
+enum class WorkClass {
+    // Short jobs that someone waits for, which should not queue up behind bulk work.
+    Interactive,
+    // Throughput oriented work, which may be delayed.
+    Bulk,
+};
+
+// Contexts on queues of different priority. Interactive work goes to the highest priority the device
+// supports of High and Medium, and bulk work to Idle if supported; the hardware then runs dispatches
+// of the interactive queue ahead of bulk ones. Falls back to Normal for priorities the device lacks.
+struct QueueRouter {
+    Context interactive;
+    Context bulk;
+};
+
+// Interactive and bulk work use separate compute engines where the device has them.
+QueueRouter create_queue_router(Context& ctx);
+
+inline Context& route(QueueRouter& router, WorkClass work) {
+    return work == WorkClass::Interactive ? router.interactive : router.bulk;
+}
+
+// Time spent in each step of recover_context, in seconds.
+struct RecoveryStats {
+    // Destroying the objects of the context on the lost device.
+    double teardown;
+    // Reinitializing the device, or creating a new platform and device.
+    double device;
+    // Creating the queue, command buffer, fence and transient heap.
+    double objects;
+    double pipelines;
+    // Whether the device could be reinitialized in place.
+    bool reused_device;
+    uint32_t pipeline_count;
+};
+
+// Rebuilds a context whose device was lost, see is_device_lost. The device is cleaned up and
+// initialized again in place, which skips creating the platform and enumerating devices; only if
+// that fails is the platform created again. Every pipeline the context had is recreated from its
+// binary right away, on several threads, so that the first dispatches after recovery do not pay
+// for it. Slicing stays enabled, with the costs measured so far.
+//
+// All other objects on the old device must have been destroyed before: buffers, contexts created
+// with create_queue_context, and the device side of shadow buffers, see release_shadow_buffer.
+// Only contexts from create_context can be recovered.
+RecoveryStats recover_context(Context& ctx);
+
+Buffer create_device_buffer(Context& ctx, Pal::gpusize size);
+
+// Creates a buffer in write-combined host memory, for streaming uploads: the host writes it
+// sequentially, and the device copies it into device memory in a single pass.
+Buffer create_host_buffer(Context& ctx, Pal::gpusize size);
+
+// Like create_device_buffer and create_host_buffer, but return the error instead of throwing, for
+// callers that expect allocations to fail, such as caches that evict and retry under memory pressure.
+Expected<Buffer> try_create_device_buffer(Context& ctx, Pal::gpusize size);
+
+Expected<Buffer> try_create_host_buffer(Context& ctx, Pal::gpusize size);
+
+// Records a dispatch of `groups` workgroups. Bindings are bound in order, starting from binding 0
+// of descriptor set 0.
+void dispatch(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, DispatchSize groups);
+
+inline void dispatch(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, uint32_t groups) {
+    dispatch(ctx, shader, bindings, DispatchSize{groups});
+}
+
+// Like dispatch, but returns the error instead of throwing: ErrorOutOfMemory if the transient heap
+// is exhausted, or the error of creating the pipeline. Sliced dispatches still throw CancelledError
+// when cancelled and SliceTimeoutError past their deadline. The other recording functions below
+// cannot fail.
+Util::Result try_dispatch(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, DispatchSize groups);
+
+// Like dispatch, but never sliced. This is needed for kernels that derive their work from
+// gl_NumWorkGroups, such as grid-stride loops, or that need all of their workgroups at once.
+void dispatch_whole(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, DispatchSize groups);
+
+inline void dispatch_whole(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, uint32_t groups) {
+    dispatch_whole(ctx, shader, bindings, DispatchSize{groups});
+}
+
+// Records a dispatch of `groups` workgroups, whose gl_WorkGroupID starts at `offset` instead of zero.
+// gl_NumWorkGroups is `groups`, not the size of the whole grid.
+void dispatch_offset(
+    Context& ctx,
+    ShaderBinary shader,
+    std::initializer_list<BufferView> bindings,
+    DispatchSize offset,
+    DispatchSize groups
+);
+
+// Makes dispatch split long 1-D and 2-D dispatches into slices of about `target` GPU time, which are
+// submitted one at a time, so that the device is free for other queues between slices. Work on a
+// higher priority queue, such as the interactive queue of a QueueRouter, then waits for at most about
+// one slice. The slice size is derived from the measured cost per workgroup of every shader; the first
+// dispatch of a shader starts with a small slice to measure it. Work recorded before a sliced dispatch
+// is submitted and waited for on its own before the first slice, and dispatch returns once the last
+// slice has completed.
+void enable_slicing(Context& ctx, std::chrono::microseconds target);
+
+void disable_slicing(Context& ctx);
+
+// Records a dispatch whose size is read from `args` when the command processor executes it, as
+// three consecutive uint32 workgroup counts. This lets the device decide how much work follows,
+// without a round trip through the host. A size of zero makes the dispatch a no-op.
+void dispatch_indirect(Context& ctx, ShaderBinary shader, std::initializer_list<BufferView> bindings, BufferView args);
+
+// Makes the results of previous dispatches and transfers visible to the following ones.
+void barrier(Context& ctx);
+
+// Like barrier, but also makes the results visible to the command processor, which reads the
+// arguments of dispatch_indirect.
+void indirect_barrier(Context& ctx);
+
+// Records a write of the 64-bit GPU timestamp to `view` once all previous work has completed. The
+// timestamp counts at DeviceProperties::timestampFrequency.
+void write_timestamp(Context& ctx, BufferView view);
+
+// Records a fill of `view` with a repeated 32-bit value.
+void fill(Context& ctx, BufferView view, uint32_t value);
+
+// Records a write of `data` to the start of `view`. The data is embedded in the command buffer,
+// so this is meant for small amounts of data only.
+void update(Context& ctx, BufferView view, std::span<const uint32_t> data);
+
+// Records a copy of `src` to the start of `dst`.
+void copy(Context& ctx, BufferView src, BufferView dst);
+
+void write_buffer(BufferView view, const void* data);
+
+void read_buffer(BufferView view, void* data);
+
+template <typename T>
+Buffer upload_buffer(Context& ctx, std::span<const T> items) {
+    auto buffer = create_device_buffer(ctx, items.size_bytes());
+    if (!items.empty())
+        write_buffer(buffer, items.data());
+    return buffer;
+}
+
+template <typename T>
+std::vector<T> download_buffer(BufferView view) {
+    auto items = std::vector<T>(view.size / sizeof(T));
+    if (!items.empty())
+        read_buffer({view.memory, view.offset, items.size() * sizeof(T)}, items.data());
+    return items;
+}
+
+#endif
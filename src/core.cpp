@@ -0,0 +1,240 @@
+#include "core.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+void checkResult(Util::Result result) {
+    if (Util::IsErrorResult(result)) [[unlikely]]
+        throw PalError{result};
+}
+
+Unique<Pal::IPlatform> create_platform() {
+    auto create_info = Pal::PlatformCreateInfo{
+        .pSettingsPath = "/etc/amd"
+    };
+
+    return Unique<Pal::IPlatform>(
+        [](Util::Result* result) { return Pal::GetPlatformSize(); },
+        [&](void* mem, Pal::IPlatform** platform) { return Pal::CreatePlatform(create_info, mem, platform); }
+    );
+}
+
+Pal::IDevice* select_device(Pal::IPlatform* platform) {
+    Pal::IDevice* devices[Pal::MaxDevices];
+    uint32_t device_count = 0;
+    checkResult(platform->EnumerateDevices(&device_count, devices));
+
+    if (device_count == 0) {
+        throw std::runtime_error("Platform has no devices");
+    }
+
+    fmt::print("Platform has {} device(s):\n", device_count);
+    for (uint32_t i = 0; i < device_count; ++i) {
+        Pal::DeviceProperties props;
+        checkResult(devices[i]->GetProperties(&props));
+
+        fmt::print("{}\n", props.gpuName);
+        fmt::print("  graphics engines: {}\n", props.engineProperties[Pal::EngineTypeUniversal].engineCount);
+        fmt::print("  compute engines: {}\n", props.engineProperties[Pal::EngineTypeCompute].engineCount);
+        fmt::print("  dma engines: {}\n", props.engineProperties[Pal::EngineTypeDma].engineCount);
+        fmt::print("  max user data entries: {}\n", props.gfxipProperties.maxUserDataEntries);
+        fmt::print("  supports HSA abi: {}\n", props.gfxipProperties.flags.supportHsaAbi ? "true" : "false");
+        fmt::print("  buffer view descriptor size: {}\n", props.gfxipProperties.srdSizes.bufferView);
+    }
+
+    return devices[0];
+}
+
+namespace {
+    Pal::QueueType queue_type(Pal::EngineType engine) {
+        switch (engine) {
+            case Pal::EngineTypeCompute: return Pal::QueueTypeCompute;
+            case Pal::EngineTypeDma: return Pal::QueueTypeDma;
+            default: throw std::invalid_argument("Unsupported engine type");
+        }
+    }
+}
+
+bool supports_queue_priority(const Pal::DeviceProperties& props, Pal::EngineType engine, Pal::QueuePriority priority) {
+    // The QueuePrioritySupport flags are indexed by QueuePriority.
+    return (props.engineProperties[engine].queuePrioritySupport & (1u << static_cast<uint32_t>(priority))) != 0;
+}
+
+Unique<Pal::IQueue> create_queue(
+    Pal::IDevice* device,
+    const Pal::DeviceProperties& props,
+    Pal::EngineType engine,
+    Pal::QueuePriority priority,
+    uint32_t engine_index
+) {
+    auto type = queue_type(engine);
+    auto support = type == Pal::QueueTypeDma ? Pal::SupportQueueTypeDma : Pal::SupportQueueTypeCompute;
+    if (props.engineProperties[engine].engineCount == 0) {
+        throw std::runtime_error(engine == Pal::EngineTypeDma ? "Device has no dma engines" : "Device has no compute engines");
+    } else if ((props.engineProperties[engine].queueSupport & support) == 0) {
+        throw std::runtime_error("Engine does not support its own queue type ???");
+    } else if (engine_index >= props.engineProperties[engine].engineCount) {
+        throw std::invalid_argument("Engine index out of range");
+    } else if (priority != Pal::QueuePriority::Normal && !supports_queue_priority(props, engine, priority)) {
+        throw std::runtime_error("Engine does not support the requested queue priority");
+    }
+
+    auto create_info = Pal::QueueCreateInfo{
+        .queueType = type,
+        .engineType = engine,
+        .engineIndex = engine_index,
+        .priority = priority,
+    };
+
+    return Unique<Pal::IQueue>(
+        [&](Util::Result* result) { return device->GetQueueSize(create_info, result); },
+        [&](void* mem, Pal::IQueue** queue) { return device->CreateQueue(create_info, mem, queue); }
+    );
+}
+
+Unique<Pal::ICmdAllocator> create_cmd_allocator(Pal::IDevice* device) {
+    auto create_info = Pal::CmdAllocatorCreateInfo{};
+    // Values taken from xgl/icd/settings/settings_xgl.json
+    create_info.allocInfo[Pal::CommandDataAlloc] = {
+        .allocHeap = Pal::GpuHeapGartUswc,
+        .allocSize = 2097152,
+        .suballocSize = 65536,
+    };
+    create_info.allocInfo[Pal::EmbeddedDataAlloc] = {
+        .allocHeap = Pal::GpuHeapGartUswc,
+        .allocSize = 131072,
+        .suballocSize = 16384,
+    };
+    create_info.allocInfo[Pal::GpuScratchMemAlloc] = {
+        .allocHeap = Pal::GpuHeapInvisible,
+        .allocSize = 131072,
+        .suballocSize = 16384,
+    };
+
+    return Unique<Pal::ICmdAllocator>(
+        [&](Util::Result* result) { return device->GetCmdAllocatorSize(create_info, result); },
+        [&](void* mem, Pal::ICmdAllocator** cmda) { return device->CreateCmdAllocator(create_info, mem, cmda); }
+    );
+}
+
+Unique<Pal::ICmdBuffer> create_cmd_buffer(Pal::IDevice* device, Pal::ICmdAllocator* cmda, Pal::EngineType engine) {
+    auto create_info = Pal::CmdBufferCreateInfo{
+        .pCmdAllocator = cmda,
+        .queueType = queue_type(engine),
+        .engineType = engine
+    };
+
+    return Unique<Pal::ICmdBuffer>(
+        [&](Util::Result* result) { return device->GetCmdBufferSize(create_info, result); },
+        [&](void* mem, Pal::ICmdBuffer** cmdbuf) { return device->CreateCmdBuffer(create_info, mem, cmdbuf); }
+    );
+}
+
+Unique<Pal::IPipeline> create_pipeline(Pal::IDevice* device, ShaderBinary binary) {
+    return try_create_pipeline(device, binary).value();
+}
+
+Expected<Unique<Pal::IPipeline>> try_create_pipeline(Pal::IDevice* device, ShaderBinary binary) {
+    auto create_info = Pal::ComputePipelineCreateInfo{
+        .pPipelineBinary = binary.start,
+        .pipelineBinarySize = binary.size()
+    };
+
+    return Unique<Pal::IPipeline>::try_create(
+        [&](Util::Result* result) { return device->GetComputePipelineSize(create_info, result); },
+        [&](void* mem, Pal::IPipeline** pipeline) { return device->CreateComputePipeline(create_info, mem, pipeline); }
+    );
+}
+
+Unique<Pal::IGpuMemory> create_buffer(Pal::IDevice* device, Pal::gpusize size, Pal::VaRange va_range, Pal::GpuHeap heap) {
+    return try_create_buffer(device, size, va_range, heap).value();
+}
+
+Expected<Unique<Pal::IGpuMemory>> try_create_buffer(Pal::IDevice* device, Pal::gpusize size, Pal::VaRange va_range, Pal::GpuHeap heap) {
+    auto create_info = Pal::GpuMemoryCreateInfo{
+        .size = size,
+        .alignment = 0, // TODO: better alignment? 0 = allocation granularity
+        .vaRange = va_range,
+        .priority = Pal::GpuMemPriority::Normal,
+        .heapAccess = Pal::GpuHeapAccessExplicit, // Taken from glx, Memory::Create
+        .heapCount = 1,
+        .heaps = {heap},
+    };
+
+    return Unique<Pal::IGpuMemory>::try_create(
+        [&](Util::Result* result) { return device->GetGpuMemorySize(create_info, result); },
+        [&](void* mem, Pal::IGpuMemory** buffer) { return device->CreateGpuMemory(create_info, mem, buffer); }
+    );
+}
+
+Unique<Pal::IGpuMemory> create_pinned_memory(Pal::IDevice* device, const void* data, size_t size) {
+    auto create_info = Pal::PinnedGpuMemoryCreateInfo{
+        .pSysMem = data,
+        .size = size,
+        .vaRange = Pal::VaRange::Default,
+    };
+
+    return Unique<Pal::IGpuMemory>(
+        [&](Util::Result* result) { return device->GetPinnedGpuMemorySize(create_info, result); },
+        [&](void* mem, Pal::IGpuMemory** buffer) { return device->CreatePinnedGpuMemory(create_info, mem, buffer); }
+    );
+}
+
+Unique<Pal::IGpuMemory> create_virtual_memory(Pal::IDevice* device, Pal::gpusize size) {
+    auto create_info = Pal::GpuMemoryCreateInfo{
+        .size = size,
+        .alignment = 0,
+        .vaRange = Pal::VaRange::Default,
+        .priority = Pal::GpuMemPriority::Normal,
+        .heapCount = 0,
+    };
+    create_info.flags.virtualAlloc = 1;
+
+    return Unique<Pal::IGpuMemory>(
+        [&](Util::Result* result) { return device->GetGpuMemorySize(create_info, result); },
+        [&](void* mem, Pal::IGpuMemory** buffer) { return device->CreateGpuMemory(create_info, mem, buffer); }
+    );
+}
+
+Unique<Pal::IFence> create_fence(Pal::IDevice* device) {
+    auto create_info = Pal::FenceCreateInfo{};
+
+    return Unique<Pal::IFence>(
+        [&](Util::Result* result) { return device->GetFenceSize(result); },
+        [&](void* mem, Pal::IFence** fence) { return device->CreateFence(create_info, mem, fence); }
+    );
+}
+
+void submit_cmd_buffer(Pal::IQueue* queue, Pal::ICmdBuffer* cmd_buf, Pal::IFence* fence) {
+    checkResult(try_submit_cmd_buffer(queue, cmd_buf, fence));
+}
+
+Util::Result try_submit_cmd_buffer(Pal::IQueue* queue, Pal::ICmdBuffer* cmd_buf, Pal::IFence* fence) {
+    auto sub_queue_info = Pal::PerSubQueueSubmitInfo{
+        .cmdBufferCount = 1,
+        .ppCmdBuffers = &cmd_buf,
+    };
+
+    return queue->Submit({
+        .pPerSubQueueInfo = &sub_queue_info,
+        .perSubQueueInfoCount = 1,
+        .fenceCount = fence ? 1u : 0u,
+        .ppFences = fence ? &fence : nullptr,
+    });
+}
+
+bool wait_fence(Pal::IDevice* device, Pal::IFence* fence, std::chrono::nanoseconds timeout) {
+    auto result = try_wait_fence(device, fence, timeout);
+    checkResult(result);
+    return result == Util::Result::Success;
+}
+
+Util::Result try_wait_fence(Pal::IDevice* device, Pal::IFence* fence, std::chrono::nanoseconds timeout) {
+    auto result = device->WaitForFences(1, &fence, true, static_cast<uint64_t>(std::max<int64_t>(timeout.count(), 0)));
+    if (result != Util::Result::Success) [[unlikely]]
+        return result;
+    return device->ResetFences(1, &fence);
+}
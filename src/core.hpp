@@ -0,0 +1,249 @@
+#ifndef _NIRAH_CORE_HPP
+#define _NIRAH_CORE_HPP
+
+#include <pal.h>
+#include <palLib.h>
+#include <palPlatform.h>
+#include <palQueue.h>
+#include <palCmdAllocator.h>
+#include <palCmdBuffer.h>
+#include <palPipeline.h>
+#include <palGpuMemory.h>
+#include <palFence.h>
+
+#include <chrono>
+#include <optional>
+#include <utility>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+
+struct PalError {
+    Util::Result result;
+};
+
+void checkResult(Util::Result result);
+
+// Whether the error means that the device was lost, for example after a hang was detected and the
+// GPU was reset. Work in flight is gone, along with the contents of device memory, and the device
+// must be initialized again before further use, see recover_context.
+inline bool is_device_lost(const PalError& error) {
+    return error.result == Util::Result::ErrorDeviceLost;
+}
+
+// The value of an operation that may fail, or the Pal result it failed with, like std::expected
+// (C++23) with the error type fixed. Hot paths where failures are part of normal operation, such as
+// allocation under memory pressure, use the try_ functions that return these instead of throwing;
+// the functions without the prefix wrap them and throw PalError, for setup code.
+template <typename T>
+struct Expected {
+    // Empty if `result` is an error.
+    std::optional<T> stored;
+    Util::Result result;
+
+    Expected(T value):
+        stored(std::move(value)), result(Util::Result::Success) {
+    }
+
+    Expected(Util::Result error):
+        stored(), result(error) {
+    }
+
+    bool has_value() const {
+        return this->stored.has_value();
+    }
+
+    explicit operator bool() const {
+        return this->has_value();
+    }
+
+    Util::Result error() const {
+        return this->result;
+    }
+
+    T& operator*() {
+        return *this->stored;
+    }
+
+    T* operator->() {
+        return &*this->stored;
+    }
+
+    // Returns the value, or throws PalError.
+    T& value() & {
+        if (this->stored) [[likely]]
+            return *this->stored;
+        throw PalError{this->result};
+    }
+
+    T value() && {
+        if (this->stored) [[likely]]
+            return std::move(*this->stored);
+        throw PalError{this->result};
+    }
+};
+
+template <typename PalType>
+struct Unique {
+    PalType* ptr;
+
+    // An empty handle, for objects that are owned elsewhere.
+    Unique():
+        ptr(nullptr) {
+    }
+
+    Unique(const Unique&) = delete;
+    Unique& operator=(const Unique&) = delete;
+
+    template <typename SizeFn, typename CreateFn>
+    Unique(SizeFn size_fn, CreateFn create_fn):
+        Unique(try_create(size_fn, create_fn).value()) {
+    }
+
+    // Like the constructor, but returns the error instead of throwing.
+    template <typename SizeFn, typename CreateFn>
+    static Expected<Unique> try_create(SizeFn size_fn, CreateFn create_fn) {
+        Util::Result result = Util::Result::Success;
+        size_t size = size_fn(&result);
+        if (Util::IsErrorResult(result)) [[unlikely]]
+            return result;
+
+        // Pal types seem to be explicitly aligned to 16 bytes, which malloc should also do.
+        void* memory = malloc(size);
+        if (!memory) [[unlikely]]
+            return Util::Result::ErrorOutOfMemory;
+        PalType* result_ptr;
+        result = create_fn(memory, &result_ptr);
+        if (Util::IsErrorResult(result)) [[unlikely]] {
+            free(memory);
+            return result;
+        }
+
+        // Note, xgl seems to free memory by the result pointer and not by the allocated memory as well,
+        // so it seems that placementAddr is always the same as the result addr.
+        auto unique = Unique();
+        unique.ptr = result_ptr;
+        return unique;
+    }
+
+    Unique(Unique&& other):
+        ptr(std::exchange(other.ptr, nullptr)) {
+    }
+
+    Unique& operator=(Unique&& other) {
+        std::swap(this->ptr, other.ptr);
+        return *this;
+    }
+
+    ~Unique() {
+        if (this->ptr) {
+            this->ptr->Destroy();
+            free(this->ptr);
+        }
+    }
+
+    PalType* operator->() const {
+        return this->ptr;
+    }
+
+    PalType& operator*() const {
+        return *this->ptr;
+    }
+};
+
+// A pipeline binary compiled by amdllpc and linked into the executable, see NIRAH_SHADER.
+struct ShaderBinary {
+    const char* start;
+    const char* end;
+
+    size_t size() const {
+        return static_cast<size_t>(this->end - this->start);
+    }
+};
+
+// Declares `shaders::name`, referring to the binary generated from `shaders/name.comp`
+// by nirah_add_shader in CMakeLists.txt.
+#define NIRAH_SHADER(name) \
+    extern const char name##_elf_start[] asm("_binary_" #name "_elf_start"); \
+    extern const char name##_elf_end[] asm("_binary_" #name "_elf_end"); \
+    namespace shaders { \
+        inline constexpr ShaderBinary name = {name##_elf_start, name##_elf_end}; \
+    }
+
+Unique<Pal::IPlatform> create_platform();
+
+Pal::IDevice* select_device(Pal::IPlatform* platform);
+
+// Whether queues on engines of type `engine` can be created with `priority`.
+bool supports_queue_priority(const Pal::DeviceProperties& props, Pal::EngineType engine, Pal::QueuePriority priority);
+
+// Creates a queue on engine `engine_index` of type `engine`, which must be EngineTypeCompute or
+// EngineTypeDma, and must have been requested when finalizing the device. Queues of higher priority
+// are scheduled ahead of lower priority ones by the hardware, at dispatch granularity.
+Unique<Pal::IQueue> create_queue(
+    Pal::IDevice* device,
+    const Pal::DeviceProperties& props,
+    Pal::EngineType engine = Pal::EngineTypeCompute,
+    Pal::QueuePriority priority = Pal::QueuePriority::Normal,
+    uint32_t engine_index = 0
+);
+
+Unique<Pal::ICmdAllocator> create_cmd_allocator(Pal::IDevice* device);
+
+// Creates a command buffer for queues on engines of type `engine`.
+Unique<Pal::ICmdBuffer> create_cmd_buffer(
+    Pal::IDevice* device,
+    Pal::ICmdAllocator* cmda,
+    Pal::EngineType engine = Pal::EngineTypeCompute
+);
+
+Unique<Pal::IPipeline> create_pipeline(Pal::IDevice* device, ShaderBinary binary);
+
+Expected<Unique<Pal::IPipeline>> try_create_pipeline(Pal::IDevice* device, ShaderBinary binary);
+
+Unique<Pal::IGpuMemory> create_buffer(
+    Pal::IDevice* device,
+    Pal::gpusize size,
+    Pal::VaRange va_range = Pal::VaRange::Default,
+    Pal::GpuHeap heap = Pal::GpuHeapLocal
+);
+
+Expected<Unique<Pal::IGpuMemory>> try_create_buffer(
+    Pal::IDevice* device,
+    Pal::gpusize size,
+    Pal::VaRange va_range = Pal::VaRange::Default,
+    Pal::GpuHeap heap = Pal::GpuHeapLocal
+);
+
+// Makes existing host memory accessible to the device without copying. `data` and `size` must be
+// multiples of the real memory allocation granularity.
+Unique<Pal::IGpuMemory> create_pinned_memory(Pal::IDevice* device, const void* data, size_t size);
+
+// Reserves `size` bytes of GPU virtual address space without backing memory. Physical memory is
+// mapped into it with IQueue::RemapVirtualMemoryPages, in multiples of the virtual memory page size.
+Unique<Pal::IGpuMemory> create_virtual_memory(Pal::IDevice* device, Pal::gpusize size);
+
+Unique<Pal::IFence> create_fence(Pal::IDevice* device);
+
+// Submits `cmd_buf`, and signals `fence` when it completes, if given. The fence must be reset.
+void submit_cmd_buffer(Pal::IQueue* queue, Pal::ICmdBuffer* cmd_buf, Pal::IFence* fence = nullptr);
+
+Util::Result try_submit_cmd_buffer(Pal::IQueue* queue, Pal::ICmdBuffer* cmd_buf, Pal::IFence* fence = nullptr);
+
+// Waits until `fence` is signaled, and resets it. Returns false, leaving the fence as it is, if it
+// is not signaled within `timeout`.
+bool wait_fence(
+    Pal::IDevice* device,
+    Pal::IFence* fence,
+    std::chrono::nanoseconds timeout = std::chrono::nanoseconds::max()
+);
+
+// Like wait_fence, but returns Success once the fence is signaled and reset, Timeout or NotReady if
+// it is not signaled in time, and the error otherwise.
+Util::Result try_wait_fence(
+    Pal::IDevice* device,
+    Pal::IFence* fence,
+    std::chrono::nanoseconds timeout = std::chrono::nanoseconds::max()
+);
+
+#endif
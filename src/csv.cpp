@@ -0,0 +1,335 @@
+#include "csv.hpp"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <limits>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <bit>
+
+NIRAH_SHADER(csv_count)
+NIRAH_SHADER(csv_scan)
+NIRAH_SHADER(csv_index)
+NIRAH_SHADER(csv_parse)
+
+namespace {
+    constexpr uint32_t group_size = 256;
+    // Text words processed by a workgroup of csv_count and csv_index.
+    constexpr uint32_t block_words = group_size * 4;
+    constexpr int max_digits = 9;
+    constexpr int max_pow10 = 37;
+
+    struct Pow10Table {
+        float pow10[max_pow10 + 1];
+        float neg_pow10[max_pow10 + 1];
+    };
+
+    struct CountParams {
+        uint32_t n_bytes;
+        uint32_t delimiter;
+    };
+
+    struct ScanParams {
+        uint32_t n_blocks;
+    };
+
+    struct ParseParams {
+        uint32_t n_fields;
+        uint32_t n_columns;
+        uint32_t n_rows;
+        Pow10Table table;
+    };
+
+    // Correctly rounded powers of ten, shared by the device and the CPU parser so that both
+    // round in the same way.
+    const Pow10Table& pow10_table() {
+        static const Pow10Table table = [] {
+            auto table = Pow10Table{};
+            for (int i = 0; i <= max_pow10; ++i) {
+                table.pow10[i] = std::strtof(("1e" + std::to_string(i)).c_str(), nullptr);
+                table.neg_pow10[i] = std::strtof(("1e-" + std::to_string(i)).c_str(), nullptr);
+            }
+            return table;
+        }();
+        return table;
+    }
+
+    std::string_view skip_header(std::string_view text, CsvFormat format) {
+        if (!format.header)
+            return text;
+        auto end = text.find('\n');
+        return end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+    }
+
+    uint32_t count_columns(std::string_view text, CsvFormat format) {
+        auto line = text.substr(0, text.find('\n'));
+        return static_cast<uint32_t>(std::count(line.begin(), line.end(), format.delimiter)) + 1;
+    }
+
+    bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    bool is_digit(char c) {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    float scale(float value, int exponent, const Pow10Table& table) {
+        if (exponent > max_pow10) {
+            value *= table.pow10[max_pow10];
+            exponent = std::min(exponent - max_pow10, max_pow10);
+        } else if (exponent < -max_pow10) {
+            value *= table.neg_pow10[max_pow10];
+            exponent = std::max(exponent + max_pow10, -max_pow10);
+        }
+        return exponent >= 0 ? value * table.pow10[exponent] : value * table.neg_pow10[-exponent];
+    }
+
+    // The same algorithm as parse() in shaders/csv_parse.comp.
+    float parse_field(const char* begin, const char* end, const Pow10Table& table) {
+        constexpr float nan = std::numeric_limits<float>::quiet_NaN();
+
+        while (begin < end && is_space(*begin)) {
+            ++begin;
+        }
+        while (end > begin && is_space(end[-1])) {
+            --end;
+        }
+
+        bool negative = false;
+        if (begin < end && (*begin == '-' || *begin == '+')) {
+            negative = *begin == '-';
+            ++begin;
+        }
+
+        uint32_t mantissa = 0;
+        int digits = 0;
+        int significant = 0;
+        int exponent = 0;
+        for (; begin < end && is_digit(*begin); ++begin) {
+            ++digits;
+            if (significant < max_digits) {
+                mantissa = mantissa * 10 + (*begin - '0');
+                significant += mantissa != 0;
+            } else {
+                ++exponent;
+            }
+        }
+        if (begin < end && *begin == '.') {
+            for (++begin; begin < end && is_digit(*begin); ++begin) {
+                ++digits;
+                if (significant < max_digits) {
+                    mantissa = mantissa * 10 + (*begin - '0');
+                    significant += mantissa != 0;
+                    --exponent;
+                }
+            }
+        }
+        if (digits != 0 && begin < end && (*begin | 32) == 'e') {
+            ++begin;
+            bool negative_exponent = false;
+            if (begin < end && (*begin == '-' || *begin == '+')) {
+                negative_exponent = *begin == '-';
+                ++begin;
+            }
+            if (begin == end)
+                return nan;
+
+            int value = 0;
+            for (; begin < end && is_digit(*begin); ++begin) {
+                value = std::min(value * 10 + (*begin - '0'), 1000);
+            }
+            exponent += negative_exponent ? -value : value;
+        }
+
+        if (digits == 0 || begin != end)
+            return nan;
+
+        float value = mantissa == 0 ? 0 : scale(static_cast<float>(mantissa), exponent, table);
+        return negative ? -value : value;
+    }
+
+    // Bit mask of the bytes of `block` that are equal to `a` or `b`.
+    uint32_t match_mask(const char* block, char a, char b) {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        auto matches = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(a)), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(b)));
+        return static_cast<uint32_t>(_mm_movemask_epi8(matches));
+    }
+
+    size_t count_lines(std::string_view text) {
+        size_t lines = 0;
+        size_t i = 0;
+        for (; i + 16 <= text.size(); i += 16) {
+            lines += std::popcount(match_mask(&text[i], '\n', '\n'));
+        }
+        lines += std::count(text.begin() + i, text.end(), '\n');
+        return lines;
+    }
+
+    // Parses the whole lines of `chunk` into rows starting at `first_row`. Returns false if a line
+    // does not have n_columns fields.
+    bool parse_chunk(std::string_view chunk, CsvFormat format, uint32_t first_row, CsvColumns& result) {
+        const auto& table = pow10_table();
+        uint32_t row = first_row;
+        uint32_t column = 0;
+        size_t field_begin = 0;
+        bool ok = true;
+
+        auto terminate = [&](size_t end) {
+            if (column < result.n_columns) {
+                auto value = parse_field(chunk.data() + field_begin, chunk.data() + end, table);
+                result.values[size_t{column} * result.n_rows + row] = value;
+            }
+            ++column;
+            field_begin = end + 1;
+
+            if (end == chunk.size() || chunk[end] == '\n') {
+                ok &= column == result.n_columns;
+                column = 0;
+                ++row;
+            }
+        };
+
+        size_t i = 0;
+        for (; i + 16 <= chunk.size(); i += 16) {
+            for (auto mask = match_mask(&chunk[i], format.delimiter, '\n'); mask != 0; mask &= mask - 1) {
+                terminate(i + std::countr_zero(mask));
+            }
+        }
+        for (; i < chunk.size(); ++i) {
+            if (chunk[i] == format.delimiter || chunk[i] == '\n')
+                terminate(i);
+        }
+        // The last line of the text need not be terminated.
+        if (field_begin < chunk.size())
+            terminate(chunk.size());
+
+        return ok;
+    }
+}
+
+CsvTable ingest_csv(Context& ctx, std::string_view text, CsvFormat format) {
+    if (text.size() >= csv_min_gpu_bytes && text.size() < csv_max_gpu_bytes)
+        return ingest_csv_gpu(ctx, text, format);
+
+    auto columns = parse_csv(text, format);
+    return {
+        .n_rows = columns.n_rows,
+        .n_columns = columns.n_columns,
+        .values = upload_buffer<float>(ctx, columns.values),
+    };
+}
+
+CsvTable ingest_csv_gpu(Context& ctx, std::string_view text, CsvFormat format) {
+    if (text.size() >= csv_max_gpu_bytes)
+        throw std::invalid_argument("Text too large for GPU CSV ingestion");
+
+    auto n_columns = count_columns(text, format);
+    auto body = skip_header(text, format);
+    if (body.empty())
+        return {.n_rows = 0, .n_columns = n_columns, .values = create_device_buffer(ctx, 0)};
+
+    // Terminate the last line, so that every field ends with a terminator.
+    bool terminated = body.back() == '\n';
+    auto n_bytes = static_cast<uint32_t>(body.size() + (terminated ? 0 : 1));
+    auto n_words = div_ceil(n_bytes, 4);
+    auto n_blocks = div_ceil(n_words, block_words);
+
+    auto staging = create_host_buffer(ctx, n_words * 4);
+    write_buffer(staging.view(0, body.size()), body.data());
+    if (!terminated)
+        write_buffer(staging.view(body.size(), 1), "\n");
+
+    auto device_text = create_device_buffer(ctx, n_words * 4);
+    auto block_counts = create_device_buffer(ctx, n_blocks * sizeof(uint32_t));
+    auto total = create_device_buffer(ctx, sizeof(uint32_t));
+    auto count_params = CountParams{n_bytes, static_cast<unsigned char>(format.delimiter)};
+
+    ctx.begin();
+    copy(ctx, staging, device_text);
+    barrier(ctx);
+    dispatch(ctx, shaders::csv_count, {ctx.params(count_params), device_text, block_counts}, n_blocks);
+    barrier(ctx);
+    dispatch(ctx, shaders::csv_scan, {ctx.params(ScanParams{n_blocks}), block_counts, total}, 1);
+    ctx.submit();
+
+    // The number of fields determines the size of the output, so it is read back before parsing.
+    auto n_fields = download_buffer<uint32_t>(total)[0];
+    if (n_fields % n_columns != 0)
+        throw std::runtime_error("Malformed CSV: lines have different numbers of fields");
+
+    auto n_rows = n_fields / n_columns;
+    auto field_ends = create_device_buffer(ctx, n_fields * sizeof(uint32_t));
+    auto values = create_device_buffer(ctx, n_fields * sizeof(float));
+    auto parse_params = ParseParams{n_fields, n_columns, n_rows, pow10_table()};
+
+    ctx.begin();
+    dispatch(ctx, shaders::csv_index, {ctx.params(count_params), device_text, block_counts, field_ends}, n_blocks);
+    barrier(ctx);
+    dispatch(ctx, shaders::csv_parse, {ctx.params(parse_params), device_text, field_ends, values}, div_ceil(n_fields, group_size));
+    ctx.submit();
+
+    return {.n_rows = n_rows, .n_columns = n_columns, .values = std::move(values)};
+}
+
+CsvColumns parse_csv(std::string_view text, CsvFormat format, uint32_t threads) {
+    auto n_columns = count_columns(text, format);
+    auto body = skip_header(text, format);
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Split the text into a chunk of whole lines per thread.
+    auto bounds = std::vector<size_t>{0};
+    for (uint32_t t = 1; t < threads; ++t) {
+        auto split = std::max(body.size() * t / threads, bounds.back());
+        auto newline = body.find('\n', split);
+        bounds.push_back(newline == std::string_view::npos ? body.size() : newline + 1);
+    }
+    bounds.push_back(body.size());
+
+    auto chunk = [&](uint32_t t) {
+        return body.substr(bounds[t], bounds[t + 1] - bounds[t]);
+    };
+
+    auto run = [&](auto f) {
+        auto workers = std::vector<std::thread>();
+        for (uint32_t t = 0; t < threads; ++t) {
+            workers.emplace_back(f, t);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    };
+
+    // Count the lines of every chunk, to find the first row of each.
+    auto first_rows = std::vector<uint32_t>(threads + 1, 0);
+    run([&](uint32_t t) {
+        first_rows[t + 1] = static_cast<uint32_t>(count_lines(chunk(t)));
+    });
+    if (!body.empty() && body.back() != '\n')
+        ++first_rows.back();
+    for (uint32_t t = 0; t < threads; ++t) {
+        first_rows[t + 1] += first_rows[t];
+    }
+
+    auto result = CsvColumns{
+        .n_rows = first_rows.back(),
+        .n_columns = n_columns,
+        .values = std::vector<float>(size_t{first_rows.back()} * n_columns),
+    };
+
+    auto ok = std::atomic<bool>(true);
+    run([&](uint32_t t) {
+        if (!parse_chunk(chunk(t), format, first_rows[t], result))
+            ok = false;
+    });
+    if (!ok)
+        throw std::runtime_error("Malformed CSV: lines have different numbers of fields");
+
+    return result;
+}
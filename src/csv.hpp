@@ -0,0 +1,55 @@
+#ifndef _NIRAH_CSV_HPP
+#define _NIRAH_CSV_HPP
+
+#include "context.hpp"
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// Ingestion of delimited text with a fixed number of numeric fields per line. Fields are not
+// quoted, and every line, including the last one, has the same number of fields. Numbers are
+// parsed to the same float by the device and the CPU parser, see shaders/csv_parse.comp.
+struct CsvFormat {
+    char delimiter = ',';
+    // Skip the first line.
+    bool header = false;
+};
+
+// Texts smaller than this are parsed on the CPU, as the round trips of GPU ingestion dominate.
+constexpr size_t csv_min_gpu_bytes = 1 << 20;
+// The device indexes bytes with 32-bit offsets.
+constexpr size_t csv_max_gpu_bytes = size_t{1} << 31;
+
+struct CsvTable {
+    uint32_t n_rows;
+    uint32_t n_columns;
+    // Column-major.
+    Buffer values;
+
+    BufferView column(uint32_t index) const {
+        return this->values.view(Pal::gpusize{index} * this->n_rows * sizeof(float), this->n_rows * sizeof(float));
+    }
+};
+
+struct CsvColumns {
+    uint32_t n_rows;
+    uint32_t n_columns;
+    // Column-major.
+    std::vector<float> values;
+};
+
+// Parses `text` into device columns. The text is uploaded through a host staging buffer, after
+// which the device finds the field terminators, computes the offset of every field with a prefix
+// scan, and parses all fields in parallel. Submits, and waits for the result. Falls back to the
+// CPU parser for texts outside [csv_min_gpu_bytes, csv_max_gpu_bytes).
+CsvTable ingest_csv(Context& ctx, std::string_view text, CsvFormat format = {});
+
+// Ingestion on the device only.
+CsvTable ingest_csv_gpu(Context& ctx, std::string_view text, CsvFormat format = {});
+
+// Parses `text` on `threads` threads (all hardware threads if 0), scanning for terminators 16
+// bytes at a time with SSE2.
+CsvColumns parse_csv(std::string_view text, CsvFormat format = {}, uint32_t threads = 0);
+
+#endif
@@ -0,0 +1,103 @@
+#include "device_vector.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    Pal::gpusize round_up(Pal::gpusize size, Pal::gpusize alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // Granularity of chunks: whole virtual memory pages of whole physical allocations.
+    Pal::gpusize chunk_granularity(const Context& ctx) {
+        const auto& memory = ctx.props.gpuMemoryProperties;
+        return std::max(memory.virtualMemPageSize, memory.realMemAllocGranularity);
+    }
+}
+
+DeviceVector create_device_vector(Context& ctx, uint32_t element_size, uint32_t max_size, uint32_t initial_capacity) {
+    if (element_size == 0 || max_size == 0)
+        throw std::invalid_argument("Device vector must be able to hold at least one element");
+
+    auto size = round_up(Pal::gpusize{element_size} * max_size, ctx.props.gpuMemoryProperties.virtualMemAllocGranularity);
+    auto vector = DeviceVector{
+        .element_size = element_size,
+        .max_size = max_size,
+        .reservation = create_virtual_memory(ctx.device, size),
+        .chunks = {},
+        .committed = 0,
+        .count = create_device_buffer(ctx, sizeof(uint32_t)),
+        .staging = {},
+    };
+    if (initial_capacity != 0)
+        reserve(ctx, vector, initial_capacity);
+    return vector;
+}
+
+void reserve(Context& ctx, DeviceVector& vector, uint32_t capacity) {
+    if (capacity > vector.max_size)
+        throw std::length_error("Device vector capacity exceeds its reservation");
+
+    auto needed = Pal::gpusize{capacity} * vector.element_size;
+    if (needed <= vector.committed)
+        return;
+
+    auto reserved = vector.reservation->Desc().size;
+    auto size = round_up(std::max(needed - vector.committed, vector.committed), chunk_granularity(ctx));
+    size = std::min(size, reserved - vector.committed);
+
+    auto chunk = create_buffer(ctx.device, size);
+    auto range = Pal::VirtualMemoryRemapRange{
+        .pRealGpuMem = chunk.ptr,
+        .realStartOffset = 0,
+        .pVirtualGpuMem = vector.reservation.ptr,
+        .virtualStartOffset = vector.committed,
+        .size = size,
+        .virtualAccessMode = Pal::VirtualGpuMemAccessMode::NoAccess,
+    };
+    checkResult(ctx.queue->RemapVirtualMemoryPages(1, &range, false, nullptr));
+
+    vector.chunks.push_back(std::move(chunk));
+    vector.committed += size;
+}
+
+void clear(Context& ctx, const DeviceVector& vector) {
+    fill(ctx, vector.count, 0);
+}
+
+uint32_t read_size(const DeviceVector& vector) {
+    return download_buffer<uint32_t>(vector.count)[0];
+}
+
+void read_elements(Context& ctx, DeviceVector& vector, uint32_t n, void* data) {
+    if (n > vector.capacity())
+        throw std::out_of_range("Reading past the capacity of a device vector");
+    if (n == 0)
+        return;
+
+    // Grows at least twofold, like the vector, but never past its committed memory.
+    auto size = Pal::gpusize{n} * vector.element_size;
+    if (!vector.staging.memory.ptr || vector.staging.size < size) {
+        auto staging_size = std::min(std::max(size, 2 * vector.staging.size), vector.committed);
+        vector.staging = {};
+        vector.staging = Buffer{
+            .memory = create_buffer(ctx.device, staging_size, Pal::VaRange::Default, Pal::GpuHeapGartCacheable),
+            .size = staging_size,
+        };
+    }
+
+    auto staging = vector.staging.view(0, size);
+    ctx.begin();
+    copy(ctx, {vector.reservation.ptr, 0, size}, staging);
+    ctx.submit();
+    read_buffer(staging, data);
+}
+
+bool grow_to_fit(Context& ctx, DeviceVector& vector) {
+    auto size = read_size(vector);
+    if (size <= vector.capacity())
+        return false;
+
+    reserve(ctx, vector, size);
+    return true;
+}
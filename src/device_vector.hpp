@@ -0,0 +1,70 @@
+#ifndef _NIRAH_DEVICE_VECTOR_HPP
+#define _NIRAH_DEVICE_VECTOR_HPP
+
+#include "context.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+
+// An array in device memory that can grow without moving. The virtual address range for the
+// largest size it may ever have is reserved up front, and physical memory is mapped into it in
+// chunks as it grows, so that existing elements stay where they are and are never copied, and
+// views of the vector remain valid.
+//
+// Kernels append to it through `count`: every append reserves indices with an atomicAdd, and
+// only writes the elements whose index is below the capacity the kernel was given, but keeps
+// counting past it. After the kernel, `count` is the size the vector needed, and grow_to_fit
+// makes it that large, after which the producing work can be repeated.
+struct DeviceVector {
+    uint32_t element_size;
+    uint32_t max_size;
+    Unique<Pal::IGpuMemory> reservation;
+    // Physical memory mapped consecutively from the start of the reservation.
+    std::vector<Unique<Pal::IGpuMemory>> chunks;
+    Pal::gpusize committed;
+    // Number of elements appended, which may exceed the capacity.
+    Buffer count;
+    // Host memory that read_elements copies through, grown as needed.
+    Buffer staging;
+
+    // Number of elements that fit in committed memory.
+    uint32_t capacity() const {
+        return static_cast<uint32_t>(std::min<Pal::gpusize>(this->committed / this->element_size, this->max_size));
+    }
+
+    operator BufferView() const {
+        return {this->reservation.ptr, 0, this->committed};
+    }
+};
+
+DeviceVector create_device_vector(Context& ctx, uint32_t element_size, uint32_t max_size, uint32_t initial_capacity = 0);
+
+// Commits memory for at least `capacity` elements, at least doubling the committed memory to
+// keep the number of chunks logarithmic. Pages are mapped by the context's queue, so they are
+// in place for every command buffer submitted afterwards, including the one being recorded.
+void reserve(Context& ctx, DeviceVector& vector, uint32_t capacity);
+
+// Records setting the size to zero. Memory stays committed.
+void clear(Context& ctx, const DeviceVector& vector);
+
+// Number of elements appended since the last clear, which may exceed the capacity.
+uint32_t read_size(const DeviceVector& vector);
+
+// Copies the first `n` elements to `data`. Virtual memory cannot be mapped, so this goes through
+// a staging buffer in cached host memory, which the vector keeps for later reads. Submits the
+// context's command buffer.
+void read_elements(Context& ctx, DeviceVector& vector, uint32_t n, void* data);
+
+template <typename T>
+std::vector<T> read_elements(Context& ctx, DeviceVector& vector, uint32_t n) {
+    auto items = std::vector<T>(n);
+    read_elements(ctx, vector, n, items.data());
+    return items;
+}
+
+// Grows the vector to its size, if appends overflowed it. Returns whether it grew, in which case
+// the elements past the old capacity were dropped, and the appends need to be repeated.
+bool grow_to_fit(Context& ctx, DeviceVector& vector);
+
+#endif
@@ -0,0 +1,201 @@
+#include "fft.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <numbers>
+#include <bit>
+
+NIRAH_SHADER(fft)
+
+namespace {
+    struct Params {
+        uint32_t n;
+        uint32_t count;
+        uint32_t inner;
+        float direction;
+        float scale;
+        uint32_t twiddle_n;
+        uint32_t src_stride;
+        uint32_t src_inner_stride;
+        uint32_t src_outer_stride;
+        uint32_t dst_stride;
+        uint32_t dst_inner_stride;
+        uint32_t dst_outer_stride;
+    };
+
+    // Transform t of a pass starts at (t / inner) * outer_stride + (t % inner) * inner_stride,
+    // and its elements are `stride` apart.
+    struct FftLayout {
+        uint32_t stride;
+        uint32_t inner_stride;
+        uint32_t outer_stride;
+    };
+
+    // Records `count` transforms of size n <= fft_max_lds_size.
+    void fft_pass(
+        Context& ctx,
+        BufferView src,
+        BufferView dst,
+        uint32_t n,
+        uint32_t count,
+        uint32_t inner,
+        FftLayout src_layout,
+        FftLayout dst_layout,
+        FftDirection direction,
+        float scale,
+        uint32_t twiddle_n = 0
+    ) {
+        auto params = Params{
+            .n = n,
+            .count = count,
+            .inner = inner,
+            .direction = direction == FftDirection::Forward ? -1.f : 1.f,
+            .scale = scale,
+            .twiddle_n = twiddle_n,
+            .src_stride = src_layout.stride,
+            .src_inner_stride = src_layout.inner_stride,
+            .src_outer_stride = src_layout.outer_stride,
+            .dst_stride = dst_layout.stride,
+            .dst_inner_stride = dst_layout.inner_stride,
+            .dst_outer_stride = dst_layout.outer_stride,
+        };
+        dispatch(ctx, shaders::fft, {ctx.params(params), src, dst}, div_ceil(count, fft_max_lds_size / n));
+    }
+
+    void check_size(uint32_t n, uint32_t max_size) {
+        if (!std::has_single_bit(n) || n > max_size)
+            throw std::invalid_argument("Unsupported FFT size");
+    }
+
+    void fft_reference_strided(Complex* data, uint32_t n, size_t stride, FftDirection direction) {
+        // Load in bit-reversed order.
+        auto x = std::vector<std::complex<double>>(n);
+        int bits = std::countr_zero(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t j = 0;
+            for (int bit = 0; bit < bits; ++bit) {
+                j |= ((i >> bit) & 1) << (bits - 1 - bit);
+            }
+            x[j] = data[i * stride];
+        }
+
+        double sign = direction == FftDirection::Forward ? -1 : 1;
+        for (uint32_t len = 2; len <= n; len *= 2) {
+            auto w_len = std::polar(1.0, sign * 2 * std::numbers::pi / len);
+            for (uint32_t start = 0; start < n; start += len) {
+                auto w = std::complex<double>(1);
+                for (uint32_t k = 0; k < len / 2; ++k) {
+                    auto a = x[start + k];
+                    auto b = x[start + k + len / 2] * w;
+                    x[start + k] = a + b;
+                    x[start + k + len / 2] = a - b;
+                    w *= w_len;
+                }
+            }
+        }
+
+        for (uint32_t i = 0; i < n; ++i) {
+            data[i * stride] = Complex(x[i]);
+        }
+    }
+}
+
+FftPlan create_fft_plan(Context& ctx, uint32_t n, uint32_t batch) {
+    check_size(n, fft_max_size);
+    if (n <= fft_max_lds_size)
+        return {.width = n, .height = 1, .batch = batch, .n1 = 0, .n2 = 0, .scratch = create_device_buffer(ctx, 0)};
+
+    // Split as evenly as possible, so that both passes transform several sequences per workgroup.
+    uint32_t n1 = 1u << (std::countr_zero(n) / 2);
+    return {
+        .width = n,
+        .height = 1,
+        .batch = batch,
+        .n1 = n1,
+        .n2 = n / n1,
+        .scratch = create_device_buffer(ctx, Pal::gpusize{n} * batch * sizeof(Complex)),
+    };
+}
+
+FftPlan create_fft_plan_2d(Context& ctx, uint32_t width, uint32_t height, uint32_t batch) {
+    check_size(width, fft_max_lds_size);
+    check_size(height, fft_max_lds_size);
+    return {.width = width, .height = height, .batch = batch, .n1 = 0, .n2 = 0, .scratch = create_device_buffer(ctx, 0)};
+}
+
+const FftPlan& FftPlanCache::plan(Context& ctx, uint32_t n, uint32_t batch) {
+    auto key = std::tuple{n, 1u, batch};
+    auto it = this->plans.find(key);
+    if (it == this->plans.end())
+        it = this->plans.emplace(key, create_fft_plan(ctx, n, batch)).first;
+    return it->second;
+}
+
+const FftPlan& FftPlanCache::plan_2d(Context& ctx, uint32_t width, uint32_t height, uint32_t batch) {
+    auto key = std::tuple{width, height, batch};
+    auto it = this->plans.find(key);
+    if (it == this->plans.end())
+        it = this->plans.emplace(key, create_fft_plan_2d(ctx, width, height, batch)).first;
+    return it->second;
+}
+
+void fft(Context& ctx, const FftPlan& plan, BufferView src, BufferView dst, FftDirection direction) {
+    uint32_t size = plan.width * plan.height;
+    float scale = direction == FftDirection::Inverse ? 1.f / size : 1.f;
+
+    if (plan.height > 1) {
+        // Rows, and then columns in place. Column transforms read and write neighbouring columns together.
+        auto rows = FftLayout{1, 0, plan.width};
+        auto cols = FftLayout{plan.width, 1, size};
+        fft_pass(ctx, src, dst, plan.width, plan.height * plan.batch, 1, rows, rows, direction, 1);
+        barrier(ctx);
+        fft_pass(ctx, dst, dst, plan.height, plan.width * plan.batch, plan.width, cols, cols, direction, scale);
+    } else if (plan.n1 == 0) {
+        auto layout = FftLayout{1, 0, size};
+        fft_pass(ctx, src, dst, size, plan.batch, 1, layout, layout, direction, scale);
+    } else {
+        // Four-step: with x[n2 + n1 * N2] and X[k1 + k2 * N1], first do N2 transforms of size N1 over n1
+        // and multiply by the twiddle factors w^(n2 * k1), then N1 transforms of size N2 over n2, whose
+        // result is written transposed.
+        auto columns = FftLayout{plan.n2, 1, size};
+        fft_pass(ctx, src, plan.scratch, plan.n1, plan.n2 * plan.batch, plan.n2, columns, columns, direction, 1, size);
+        barrier(ctx);
+        auto rows = FftLayout{1, plan.n2, size};
+        auto transposed = FftLayout{plan.n1, 1, size};
+        fft_pass(ctx, plan.scratch, dst, plan.n2, plan.n1 * plan.batch, plan.n1, rows, transposed, direction, scale);
+    }
+}
+
+std::vector<Complex> fft_reference(std::span<const Complex> src, uint32_t n, uint32_t batch, FftDirection direction) {
+    auto dst = std::vector<Complex>(src.begin(), src.begin() + size_t{n} * batch);
+    for (uint32_t b = 0; b < batch; ++b) {
+        fft_reference_strided(&dst[size_t{b} * n], n, 1, direction);
+    }
+
+    if (direction == FftDirection::Inverse) {
+        for (auto& x : dst) {
+            x /= static_cast<float>(n);
+        }
+    }
+    return dst;
+}
+
+std::vector<Complex> fft2d_reference(std::span<const Complex> src, uint32_t width, uint32_t height, uint32_t batch, FftDirection direction) {
+    size_t size = size_t{width} * height;
+    auto dst = std::vector<Complex>(src.begin(), src.begin() + size * batch);
+    for (uint32_t b = 0; b < batch; ++b) {
+        for (uint32_t y = 0; y < height; ++y) {
+            fft_reference_strided(&dst[b * size + y * width], width, 1, direction);
+        }
+        for (uint32_t x = 0; x < width; ++x) {
+            fft_reference_strided(&dst[b * size + x], height, width, direction);
+        }
+    }
+
+    if (direction == FftDirection::Inverse) {
+        for (auto& x : dst) {
+            x /= static_cast<float>(size);
+        }
+    }
+    return dst;
+}
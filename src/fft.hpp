@@ -0,0 +1,63 @@
+#ifndef _NIRAH_FFT_HPP
+#define _NIRAH_FFT_HPP
+
+#include "context.hpp"
+
+#include <complex>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// Largest transform that is done in LDS in a single pass. Longer 1-D transforms are decomposed
+// into two passes of at most this size, 2-D transforms are limited to it in both dimensions.
+constexpr uint32_t fft_max_lds_size = 4096;
+constexpr uint32_t fft_max_size = fft_max_lds_size * fft_max_lds_size;
+
+// Complex numbers are stored as interleaved pairs of floats, transforms of a batch are densely packed.
+using Complex = std::complex<float>;
+
+enum class FftDirection {
+    Forward,
+    // Normalized by 1 / (number of elements of a transform).
+    Inverse,
+};
+
+// Batched transforms of a power-of-two size.
+struct FftPlan {
+    uint32_t width;
+    // 1 for 1-D transforms.
+    uint32_t height;
+    uint32_t batch;
+
+    // Factors width = n1 * n2 of the four-step decomposition of 1-D transforms longer than
+    // fft_max_lds_size, 0 otherwise.
+    uint32_t n1;
+    uint32_t n2;
+    Buffer scratch;
+};
+
+FftPlan create_fft_plan(Context& ctx, uint32_t n, uint32_t batch);
+
+FftPlan create_fft_plan_2d(Context& ctx, uint32_t width, uint32_t height, uint32_t batch);
+
+// Plans for every shape that has been requested, so that scratch memory is only allocated once
+// for repeated transforms of the same shape.
+struct FftPlanCache {
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, FftPlan> plans;
+
+    const FftPlan& plan(Context& ctx, uint32_t n, uint32_t batch);
+
+    const FftPlan& plan_2d(Context& ctx, uint32_t width, uint32_t height, uint32_t batch);
+};
+
+// Records the transforms of `plan` from `src` to `dst`, which may be the same buffer.
+void fft(Context& ctx, const FftPlan& plan, BufferView src, BufferView dst, FftDirection direction);
+
+// Radix-2 transforms in double precision.
+std::vector<Complex> fft_reference(std::span<const Complex> src, uint32_t n, uint32_t batch, FftDirection direction);
+
+std::vector<Complex> fft2d_reference(std::span<const Complex> src, uint32_t width, uint32_t height, uint32_t batch, FftDirection direction);
+
+#endif
@@ -0,0 +1,336 @@
+#include "graph.hpp"
+
+#include <algorithm>
+#include <array>
+#include <queue>
+#include <stdexcept>
+#include <bit>
+
+NIRAH_SHADER(bfs_push)
+NIRAH_SHADER(bfs_pull)
+NIRAH_SHADER(bfs_control)
+NIRAH_SHADER(sssp_relax)
+NIRAH_SHADER(sssp_split)
+NIRAH_SHADER(sssp_control)
+
+namespace {
+    constexpr uint32_t infinity_bits = 0x7F800000;
+
+    struct BfsParams {
+        uint32_t vertices;
+        uint32_t edges;
+        float alpha;
+        float beta;
+    };
+
+    // Mirrors the State buffer of the bfs_* shaders.
+    struct BfsState {
+        std::array<uint32_t, 4> push_args;
+        std::array<uint32_t, 4> pull_args;
+        uint32_t level;
+        uint32_t frontier;
+        uint32_t next;
+        uint32_t next_edges;
+        uint32_t explored_edges;
+        uint32_t direction;
+        uint32_t pull_levels;
+        uint32_t active;
+    };
+
+    struct SsspParams {
+        uint32_t vertices;
+        float delta;
+    };
+
+    // Mirrors the State buffer of the sssp_* shaders.
+    struct SsspState {
+        std::array<uint32_t, 4> relax_args;
+        std::array<uint32_t, 4> split_args;
+        uint32_t step;
+        uint32_t near_phase;
+        uint32_t far_phase;
+        uint32_t near_count;
+        uint32_t near_next;
+        uint32_t far_count;
+        uint32_t far_next;
+        float threshold;
+        uint32_t far_min;
+        uint32_t far_min_next;
+        uint32_t active;
+        uint32_t buckets;
+    };
+
+    template <typename T>
+    void update_state(Context& ctx, BufferView view, const T& state) {
+        auto words = std::bit_cast<std::array<uint32_t, sizeof(T) / sizeof(uint32_t)>>(state);
+        update(ctx, view, words);
+    }
+
+    template <typename T>
+    T read_state(BufferView view) {
+        T state;
+        read_buffer(view, &state);
+        return state;
+    }
+
+    // Offsets of the indirect dispatch arguments within the state buffers.
+    BufferView first_args(const Buffer& state) {
+        return state.view(0, 3 * sizeof(uint32_t));
+    }
+
+    BufferView second_args(const Buffer& state) {
+        return state.view(4 * sizeof(uint32_t), 3 * sizeof(uint32_t));
+    }
+}
+
+GpuGraph upload_graph(Context& ctx, const CsrMatrix& adjacency) {
+    if (adjacency.rows != adjacency.cols)
+        throw std::invalid_argument("Adjacency matrix must be square");
+
+    return {
+        .vertices = adjacency.rows,
+        .edges = adjacency.nnz(),
+        .offsets = upload_buffer<uint32_t>(ctx, adjacency.row_offsets),
+        .targets = upload_buffer<uint32_t>(ctx, adjacency.col_indices),
+        .weights = upload_buffer<float>(ctx, adjacency.values),
+    };
+}
+
+CsrMatrix reverse_graph(const CsrMatrix& adjacency) {
+    auto reverse = CsrMatrix{
+        .rows = adjacency.cols,
+        .cols = adjacency.rows,
+        .row_offsets = std::vector<uint32_t>(adjacency.cols + 1),
+        .col_indices = std::vector<uint32_t>(adjacency.nnz()),
+        .values = std::vector<float>(adjacency.nnz()),
+    };
+
+    for (uint32_t e = 0; e < adjacency.nnz(); ++e) {
+        ++reverse.row_offsets[adjacency.col_indices[e] + 1];
+    }
+    for (uint32_t v = 0; v < reverse.rows; ++v) {
+        reverse.row_offsets[v + 1] += reverse.row_offsets[v];
+    }
+
+    // Edges are visited in order of their source, so every reversed row ends up sorted.
+    auto fill = std::vector<uint32_t>(reverse.row_offsets.begin(), reverse.row_offsets.end() - 1);
+    for (uint32_t u = 0; u < adjacency.rows; ++u) {
+        for (uint32_t e = adjacency.row_offsets[u]; e < adjacency.row_offsets[u + 1]; ++e) {
+            auto slot = fill[adjacency.col_indices[e]]++;
+            reverse.col_indices[slot] = u;
+            reverse.values[slot] = adjacency.values[e];
+        }
+    }
+
+    return reverse;
+}
+
+BfsPlan create_bfs_plan(Context& ctx, uint32_t vertices) {
+    return {
+        .vertices = vertices,
+        .depths = create_device_buffer(ctx, vertices * sizeof(uint32_t)),
+        .queues = create_device_buffer(ctx, 2 * Pal::gpusize{vertices} * sizeof(uint32_t)),
+        .state = create_device_buffer(ctx, sizeof(BfsState)),
+    };
+}
+
+BfsStats bfs(Context& ctx, const BfsPlan& plan, const GpuGraph& out_edges, const GpuGraph& in_edges, uint32_t source,
+    const BfsOptions& options) {
+    if (out_edges.vertices != plan.vertices || in_edges.vertices != plan.vertices)
+        throw std::invalid_argument("Graph does not match the BFS plan");
+    if (source >= plan.vertices)
+        throw std::invalid_argument("BFS source out of range");
+    if (options.levels_per_submission == 0)
+        throw std::invalid_argument("At least one level per submission is required");
+
+    auto params = BfsParams{
+        .vertices = plan.vertices,
+        .edges = out_edges.edges,
+        .alpha = options.alpha,
+        .beta = options.beta,
+    };
+    auto state = BfsState{
+        .push_args = {1, 1, 1, 0},
+        .pull_args = {0, 1, 1, 0},
+        .level = 0,
+        .frontier = 1,
+        .next = 0,
+        .next_edges = 0,
+        .explored_edges = 0,
+        .direction = 0,
+        .pull_levels = 0,
+        .active = 1,
+    };
+
+    ctx.begin();
+    fill(ctx, plan.depths, bfs_unreached);
+    barrier(ctx);
+    update(ctx, plan.depths.view(source * sizeof(uint32_t), sizeof(uint32_t)), std::array{0u});
+    update(ctx, plan.queues.view(0, sizeof(uint32_t)), std::array{source});
+    update_state(ctx, plan.state, state);
+    indirect_barrier(ctx);
+
+    uint32_t submissions = 0;
+    while (true) {
+        auto params_view = ctx.params(params);
+        for (uint32_t i = 0; i < options.levels_per_submission; ++i) {
+            // Only one of these does any work; the other has zero workgroups.
+            dispatch_indirect(ctx, shaders::bfs_push,
+                {params_view, out_edges.offsets, out_edges.targets, plan.depths, plan.queues, plan.state},
+                first_args(plan.state));
+            dispatch_indirect(ctx, shaders::bfs_pull,
+                {params_view, in_edges.offsets, in_edges.targets, plan.depths, plan.queues, plan.state, out_edges.offsets},
+                second_args(plan.state));
+            barrier(ctx);
+            dispatch(ctx, shaders::bfs_control, {params_view, plan.state}, 1);
+            indirect_barrier(ctx);
+        }
+        ctx.submit();
+        ++submissions;
+
+        state = read_state<BfsState>(plan.state);
+        if (!state.active)
+            break;
+        ctx.begin();
+    }
+
+    return {
+        .levels = state.level,
+        .pull_levels = state.pull_levels,
+        .submissions = submissions,
+    };
+}
+
+std::vector<uint32_t> read_bfs_depths(const BfsPlan& plan) {
+    return download_buffer<uint32_t>(plan.depths);
+}
+
+SsspPlan create_sssp_plan(Context& ctx, uint32_t vertices) {
+    auto size = Pal::gpusize{vertices} * sizeof(uint32_t);
+    return {
+        .vertices = vertices,
+        .distances = create_device_buffer(ctx, size),
+        .near = create_device_buffer(ctx, 2 * size),
+        .far = create_device_buffer(ctx, 2 * size),
+        .near_marks = create_device_buffer(ctx, size),
+        .in_far = create_device_buffer(ctx, size),
+        .state = create_device_buffer(ctx, sizeof(SsspState)),
+    };
+}
+
+SsspStats sssp(Context& ctx, const SsspPlan& plan, const GpuGraph& graph, uint32_t source, const SsspOptions& options) {
+    if (graph.vertices != plan.vertices)
+        throw std::invalid_argument("Graph does not match the SSSP plan");
+    if (source >= plan.vertices)
+        throw std::invalid_argument("SSSP source out of range");
+    if (!(options.delta > 0))
+        throw std::invalid_argument("SSSP bucket width must be positive");
+    if (options.steps_per_submission == 0)
+        throw std::invalid_argument("At least one step per submission is required");
+
+    auto params = SsspParams{
+        .vertices = plan.vertices,
+        .delta = options.delta,
+    };
+    auto state = SsspState{
+        .relax_args = {1, 1, 1, 0},
+        .split_args = {0, 1, 1, 0},
+        .step = 0,
+        .near_phase = 0,
+        .far_phase = 0,
+        .near_count = 1,
+        .near_next = 0,
+        .far_count = 0,
+        .far_next = 0,
+        .threshold = options.delta,
+        .far_min = infinity_bits,
+        .far_min_next = infinity_bits,
+        .active = 1,
+        .buckets = 1,
+    };
+
+    ctx.begin();
+    fill(ctx, plan.distances, infinity_bits);
+    fill(ctx, plan.near_marks, 0xFFFFFFFF);
+    fill(ctx, plan.in_far, 0);
+    barrier(ctx);
+    update(ctx, plan.distances.view(source * sizeof(uint32_t), sizeof(uint32_t)), std::array{0u});
+    update(ctx, plan.near.view(0, sizeof(uint32_t)), std::array{source});
+    update_state(ctx, plan.state, state);
+    indirect_barrier(ctx);
+
+    uint32_t submissions = 0;
+    while (true) {
+        auto params_view = ctx.params(params);
+        for (uint32_t i = 0; i < options.steps_per_submission; ++i) {
+            dispatch_indirect(ctx, shaders::sssp_relax,
+                {params_view, graph.offsets, graph.targets, graph.weights, plan.distances, plan.near, plan.far,
+                    plan.near_marks, plan.in_far, plan.state},
+                first_args(plan.state));
+            dispatch_indirect(ctx, shaders::sssp_split,
+                {params_view, plan.distances, plan.near, plan.far, plan.near_marks, plan.in_far, plan.state},
+                second_args(plan.state));
+            barrier(ctx);
+            dispatch(ctx, shaders::sssp_control, {params_view, plan.state}, 1);
+            indirect_barrier(ctx);
+        }
+        ctx.submit();
+        ++submissions;
+
+        state = read_state<SsspState>(plan.state);
+        if (!state.active)
+            break;
+        ctx.begin();
+    }
+
+    return {
+        .steps = state.step,
+        .buckets = state.buckets,
+        .submissions = submissions,
+    };
+}
+
+std::vector<float> read_sssp_distances(const SsspPlan& plan) {
+    return download_buffer<float>(plan.distances);
+}
+
+std::vector<uint32_t> bfs_reference(const CsrMatrix& adjacency, uint32_t source) {
+    auto depths = std::vector<uint32_t>(adjacency.rows, bfs_unreached);
+    auto queue = std::vector<uint32_t>{source};
+    depths[source] = 0;
+    for (size_t i = 0; i < queue.size(); ++i) {
+        auto u = queue[i];
+        for (uint32_t e = adjacency.row_offsets[u]; e < adjacency.row_offsets[u + 1]; ++e) {
+            auto v = adjacency.col_indices[e];
+            if (depths[v] == bfs_unreached) {
+                depths[v] = depths[u] + 1;
+                queue.push_back(v);
+            }
+        }
+    }
+    return depths;
+}
+
+std::vector<float> sssp_reference(const CsrMatrix& adjacency, uint32_t source) {
+    using Entry = std::pair<float, uint32_t>;
+    auto distances = std::vector<float>(adjacency.rows, std::numeric_limits<float>::infinity());
+    auto heap = std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>();
+    distances[source] = 0;
+    heap.push({0, source});
+    while (!heap.empty()) {
+        auto [d, u] = heap.top();
+        heap.pop();
+        if (d > distances[u])
+            continue;
+        for (uint32_t e = adjacency.row_offsets[u]; e < adjacency.row_offsets[u + 1]; ++e) {
+            // Summed in fp32 like on the device, so that the results are identical.
+            float dv = d + adjacency.values[e];
+            auto v = adjacency.col_indices[e];
+            if (dv < distances[v]) {
+                distances[v] = dv;
+                heap.push({dv, v});
+            }
+        }
+    }
+    return distances;
+}
@@ -0,0 +1,108 @@
+#ifndef _NIRAH_GRAPH_HPP
+#define _NIRAH_GRAPH_HPP
+
+#include "context.hpp"
+#include "spmv.hpp"
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+// Graph traversals on the device. Graphs are stored as the CSR adjacency matrices of spmv.hpp:
+// row u holds the edges out of vertex u, and values are the edge weights.
+//
+// Both traversals advance through levels (or buckets) without the host: after every step, a
+// single-invocation control kernel decides how many workgroups the next step needs and writes
+// them to the arguments of indirect dispatches. A fixed number of steps is recorded per
+// submission, and the host only reads back whether the traversal has finished in between.
+
+constexpr uint32_t bfs_unreached = std::numeric_limits<uint32_t>::max();
+
+struct GpuGraph {
+    uint32_t vertices;
+    uint32_t edges;
+    Buffer offsets;
+    Buffer targets;
+    Buffer weights;
+};
+
+GpuGraph upload_graph(Context& ctx, const CsrMatrix& adjacency);
+
+// The graph with every edge reversed, i.e. the transposed adjacency matrix.
+CsrMatrix reverse_graph(const CsrMatrix& adjacency);
+
+struct BfsOptions {
+    // Switch from push to pull steps when the edges out of the frontier exceed 1 / alpha of the
+    // unexplored edges, and back when the frontier has fewer than 1 / beta of the vertices. An
+    // alpha of 0 only uses push steps.
+    float alpha = 15;
+    float beta = 18;
+    uint32_t levels_per_submission = 16;
+};
+
+struct BfsPlan {
+    uint32_t vertices;
+    Buffer depths;
+    // Current and next frontier queue.
+    Buffer queues;
+    Buffer state;
+};
+
+struct BfsStats {
+    // Number of non-empty levels, i.e. the largest depth + 1.
+    uint32_t levels;
+    uint32_t pull_levels;
+    uint32_t submissions;
+};
+
+BfsPlan create_bfs_plan(Context& ctx, uint32_t vertices);
+
+// Runs a level-synchronous breadth-first search from `source`. `in_edges` is the reverse of
+// `out_edges`, used by pull steps; for undirected graphs, pass the same graph twice. Submits
+// the context's command buffer.
+BfsStats bfs(Context& ctx, const BfsPlan& plan, const GpuGraph& out_edges, const GpuGraph& in_edges, uint32_t source,
+    const BfsOptions& options = {});
+
+// Depth of every vertex, or bfs_unreached.
+std::vector<uint32_t> read_bfs_depths(const BfsPlan& plan);
+
+struct SsspOptions {
+    // Bucket width. Small buckets do less redundant relaxation, large buckets expose more
+    // parallelism per step; a bucket that holds a few times the number of vertices a step can
+    // process in parallel is a good start.
+    float delta;
+    uint32_t steps_per_submission = 32;
+};
+
+struct SsspPlan {
+    uint32_t vertices;
+    Buffer distances;
+    // Current and next near queue, and current and next far pile.
+    Buffer near;
+    Buffer far;
+    Buffer near_marks;
+    Buffer in_far;
+    Buffer state;
+};
+
+struct SsspStats {
+    uint32_t steps;
+    uint32_t buckets;
+    uint32_t submissions;
+};
+
+SsspPlan create_sssp_plan(Context& ctx, uint32_t vertices);
+
+// Runs delta-stepping single-source shortest paths from `source`. Weights must not be negative.
+// Submits the context's command buffer.
+SsspStats sssp(Context& ctx, const SsspPlan& plan, const GpuGraph& graph, uint32_t source, const SsspOptions& options);
+
+// Distance to every vertex, or infinity.
+std::vector<float> read_sssp_distances(const SsspPlan& plan);
+
+std::vector<uint32_t> bfs_reference(const CsrMatrix& adjacency, uint32_t source);
+
+// Dijkstra's algorithm.
+std::vector<float> sssp_reference(const CsrMatrix& adjacency, uint32_t source);
+
+#endif
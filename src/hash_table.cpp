@@ -0,0 +1,112 @@
+#include "hash_table.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <bit>
+#include <cmath>
+
+NIRAH_SHADER(hash_build)
+NIRAH_SHADER(hash_probe)
+
+namespace {
+    constexpr uint32_t group_size = 256;
+}
+
+GpuHashTable create_hash_table(Context& ctx, uint32_t max_keys, HashTableConfig config) {
+    if (config.load_factor <= 0 || config.load_factor >= 1)
+        throw std::invalid_argument("Hash table load factor must be in (0, 1)");
+
+    // Always keep at least one empty slot, so that probe sequences terminate.
+    auto min_capacity = static_cast<uint32_t>(std::ceil(max_keys / config.load_factor)) + 1;
+    auto capacity = std::bit_ceil(min_capacity);
+    return {
+        .capacity = capacity,
+        .slots = create_device_buffer(ctx, Pal::gpusize{capacity} * 2 * sizeof(uint32_t)),
+        .overflow = create_device_buffer(ctx, sizeof(uint32_t)),
+    };
+}
+
+JoinOutput create_join_output(Context& ctx, uint32_t max_matches, uint32_t initial_matches) {
+    return {
+        .matches = create_device_vector(ctx, sizeof(JoinMatch), max_matches, initial_matches),
+    };
+}
+
+bool grow_join_output(Context& ctx, JoinOutput& output) {
+    return grow_to_fit(ctx, output.matches);
+}
+
+void hash_table_build(Context& ctx, const GpuHashTable& table, BufferView keys, uint32_t n) {
+    fill(ctx, table.slots, 0xFFFFFFFF);
+    fill(ctx, table.overflow, 0);
+    barrier(ctx);
+
+    struct {
+        uint32_t n;
+        uint32_t capacity;
+    } params = {n, table.capacity};
+
+    dispatch(ctx, shaders::hash_build, {ctx.params(params), keys, table.slots, table.overflow}, div_ceil(n, group_size));
+}
+
+void hash_table_probe(Context& ctx, const GpuHashTable& table, BufferView keys, uint32_t n, const JoinOutput& output) {
+    clear(ctx, output.matches);
+    barrier(ctx);
+
+    struct {
+        uint32_t n;
+        uint32_t capacity;
+        uint32_t out_capacity;
+    } params = {n, table.capacity, output.matches.capacity()};
+
+    dispatch(ctx, shaders::hash_probe, {ctx.params(params), keys, table.slots, output.matches, output.matches.count},
+        div_ceil(n, group_size));
+}
+
+void hash_join(
+    Context& ctx,
+    const GpuHashTable& table,
+    BufferView build_keys,
+    uint32_t n_build,
+    BufferView probe_keys,
+    uint32_t n_probe,
+    const JoinOutput& output
+) {
+    hash_table_build(ctx, table, build_keys, n_build);
+    barrier(ctx);
+    hash_table_probe(ctx, table, probe_keys, n_probe, output);
+}
+
+std::vector<JoinMatch> read_join(Context& ctx, const GpuHashTable& table, JoinOutput& output) {
+    if (download_buffer<uint32_t>(table.overflow)[0] != 0)
+        throw std::runtime_error("Hash table overflowed");
+
+    auto count = read_size(output.matches);
+    if (count > output.matches.capacity())
+        throw std::runtime_error("Join output overflowed");
+
+    auto matches = read_elements<JoinMatch>(ctx, output.matches, count);
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+std::vector<JoinMatch> hash_join_reference(std::span<const uint32_t> build_keys, std::span<const uint32_t> probe_keys) {
+    auto rows = std::unordered_multimap<uint32_t, uint32_t>();
+    rows.reserve(build_keys.size());
+    for (uint32_t i = 0; i < build_keys.size(); ++i) {
+        if (build_keys[i] != 0xFFFFFFFF)
+            rows.emplace(build_keys[i], i);
+    }
+
+    auto matches = std::vector<JoinMatch>();
+    for (uint32_t i = 0; i < probe_keys.size(); ++i) {
+        auto [first, last] = rows.equal_range(probe_keys[i]);
+        for (auto it = first; it != last; ++it) {
+            matches.push_back({i, it->second});
+        }
+    }
+
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
@@ -0,0 +1,77 @@
+#ifndef _NIRAH_HASH_TABLE_HPP
+#define _NIRAH_HASH_TABLE_HPP
+
+#include "context.hpp"
+#include "device_vector.hpp"
+
+#include <vector>
+#include <span>
+#include <compare>
+#include <cstdint>
+
+struct HashTableConfig {
+    // Maximum fraction of slots that is occupied when the table holds `max_keys` keys.
+    // Lower load factors mean shorter probe sequences, at the cost of memory.
+    float load_factor = 0.5f;
+};
+
+// Open-addressing hash table with linear probing in device memory, mapping 32-bit keys to
+// the row index they were inserted from. Key 0xFFFFFFFF is reserved.
+struct GpuHashTable {
+    // Number of slots, a power of 2.
+    uint32_t capacity;
+    // (key, value) pairs.
+    Buffer slots;
+    // Number of keys that could not be inserted because the table was full.
+    Buffer overflow;
+};
+
+struct JoinMatch {
+    uint32_t probe_row;
+    uint32_t build_row;
+
+    friend auto operator<=>(const JoinMatch&, const JoinMatch&) = default;
+};
+
+struct JoinOutput {
+    // JoinMatch per match, in no particular order. Its size is the total number of matches of the
+    // last probe, which may exceed its capacity.
+    DeviceVector matches;
+};
+
+GpuHashTable create_hash_table(Context& ctx, uint32_t max_keys, HashTableConfig config = {});
+
+// Reserves address space for `max_matches`, but only commits memory for `initial_matches`;
+// see grow_join_output.
+JoinOutput create_join_output(Context& ctx, uint32_t max_matches, uint32_t initial_matches);
+
+// Grows the output to fit all matches of the last probe, without moving the ones that fit.
+// Returns whether it grew, in which case the probe has to be repeated.
+bool grow_join_output(Context& ctx, JoinOutput& output);
+
+// Records a clear of the table, followed by the insertion of `n` keys, with their index as value.
+// Duplicate keys are inserted separately.
+void hash_table_build(Context& ctx, const GpuHashTable& table, BufferView keys, uint32_t n);
+
+// Records a probe of the table with `n` keys, writing every match to `output`.
+void hash_table_probe(Context& ctx, const GpuHashTable& table, BufferView keys, uint32_t n, const JoinOutput& output);
+
+// Records an inner equi-join of `build_keys` and `probe_keys`: builds the table from `build_keys`
+// and probes it with `probe_keys`.
+void hash_join(
+    Context& ctx,
+    const GpuHashTable& table,
+    BufferView build_keys,
+    uint32_t n_build,
+    BufferView probe_keys,
+    uint32_t n_probe,
+    const JoinOutput& output
+);
+
+// Reads back the matches, sorted by probe row and then build row. Throws if the table
+// or output overflowed.
+std::vector<JoinMatch> read_join(Context& ctx, const GpuHashTable& table, JoinOutput& output);
+
+std::vector<JoinMatch> hash_join_reference(std::span<const uint32_t> build_keys, std::span<const uint32_t> probe_keys);
+
+#endif
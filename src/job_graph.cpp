@@ -0,0 +1,112 @@
+#include "job_graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+ResourceId JobGraph::add_input(BufferView view) {
+    this->resources.push_back({
+        .view = view,
+        .version = 0,
+        .input = true,
+        .producer = std::nullopt,
+    });
+    return static_cast<ResourceId>(this->resources.size() - 1);
+}
+
+ResourceId JobGraph::add_buffer(Context& ctx, Pal::gpusize size) {
+    this->buffers.push_back(create_device_buffer(ctx, size));
+    this->resources.push_back({
+        .view = this->buffers.back(),
+        .version = 0,
+        .input = false,
+        .producer = std::nullopt,
+    });
+    return static_cast<ResourceId>(this->resources.size() - 1);
+}
+
+JobId JobGraph::add_job(
+    std::string name,
+    std::initializer_list<ResourceId> inputs,
+    std::initializer_list<ResourceId> outputs,
+    std::function<void(Context&)> record
+) {
+    for (auto id : inputs) {
+        const auto& resource = this->resources.at(id);
+        if (!resource.input && !resource.producer)
+            throw std::invalid_argument("Job reads a buffer that no earlier job writes");
+    }
+
+    for (auto id : outputs) {
+        const auto& resource = this->resources.at(id);
+        if (resource.input)
+            throw std::invalid_argument("Job writes a graph input");
+        if (resource.producer)
+            throw std::invalid_argument("Job writes a buffer that another job already writes");
+    }
+
+    auto job = static_cast<JobId>(this->jobs.size());
+    for (auto id : outputs) {
+        this->resources[id].producer = job;
+    }
+
+    this->jobs.push_back({
+        .name = std::move(name),
+        .inputs = inputs,
+        .outputs = outputs,
+        .record = std::move(record),
+        .seen = std::nullopt,
+    });
+    return job;
+}
+
+void JobGraph::touch(ResourceId input) {
+    auto& resource = this->resources.at(input);
+    if (!resource.input)
+        throw std::invalid_argument("Only graph inputs can be touched");
+    ++resource.version;
+}
+
+void JobGraph::invalidate() {
+    for (auto& job : this->jobs) {
+        job.seen.reset();
+    }
+}
+
+JobGraphStats run_jobs(Context& ctx, JobGraph& graph) {
+    auto stats = JobGraphStats{0, 0};
+    // Resources written since the last barrier.
+    auto pending = std::vector<bool>(graph.resources.size(), false);
+
+    for (auto& job : graph.jobs) {
+        bool changed = !job.seen;
+        for (size_t i = 0; !changed && i < job.inputs.size(); ++i) {
+            changed = (*job.seen)[i] != graph.resources[job.inputs[i]].version;
+        }
+
+        if (!changed) {
+            ++stats.skipped;
+            continue;
+        }
+
+        bool depends = std::any_of(job.inputs.begin(), job.inputs.end(), [&](ResourceId id) { return pending[id]; });
+        if (depends) {
+            barrier(ctx);
+            std::fill(pending.begin(), pending.end(), false);
+        }
+
+        job.record(ctx);
+        ++stats.recorded;
+
+        auto& seen = job.seen.emplace(job.inputs.size());
+        for (size_t i = 0; i < job.inputs.size(); ++i) {
+            seen[i] = graph.resources[job.inputs[i]].version;
+        }
+
+        for (auto id : job.outputs) {
+            ++graph.resources[id].version;
+            pending[id] = true;
+        }
+    }
+
+    return stats;
+}
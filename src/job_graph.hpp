@@ -0,0 +1,84 @@
+#ifndef _NIRAH_JOB_GRAPH_HPP
+#define _NIRAH_JOB_GRAPH_HPP
+
+#include "context.hpp"
+
+#include <functional>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// A pipeline of jobs, each of which records some dispatches that read one set of resources and
+// write another. Every resource has a version that is bumped when its contents change: by the
+// host for inputs, and by running the job that writes it for intermediates. A job is only recorded
+// again when one of its inputs has a different version than the last time it ran, so after some
+// inputs change, only the jobs that transitively depend on them run. Intermediate buffers are
+// owned by the graph and stay resident between runs, so skipped jobs keep their results.
+
+using ResourceId = uint32_t;
+using JobId = uint32_t;
+
+struct JobGraph {
+    struct Resource {
+        BufferView view;
+        uint64_t version;
+        // Whether this is written by the host rather than by a job.
+        bool input;
+        std::optional<JobId> producer;
+    };
+
+    struct Job {
+        std::string name;
+        std::vector<ResourceId> inputs;
+        std::vector<ResourceId> outputs;
+        std::function<void(Context&)> record;
+        // Versions of the inputs when the job last ran, or none if it has not run since it was added
+        // or the graph was invalidated. Jobs without inputs run once.
+        std::optional<std::vector<uint64_t>> seen;
+    };
+
+    std::vector<Buffer> buffers;
+    std::vector<Resource> resources;
+    std::vector<Job> jobs;
+
+    // Adds a resource that is written by the host, such as a shadow buffer.
+    ResourceId add_input(BufferView view);
+
+    // Allocates a device buffer for the output of a job.
+    ResourceId add_buffer(Context& ctx, Pal::gpusize size);
+
+    // Adds a job that reads `inputs` and writes `outputs` when recorded. Inputs must be graph inputs
+    // or outputs of earlier jobs, so jobs are added in dependency order, and every buffer is written
+    // by at most one job.
+    JobId add_job(
+        std::string name,
+        std::initializer_list<ResourceId> inputs,
+        std::initializer_list<ResourceId> outputs,
+        std::function<void(Context&)> record
+    );
+
+    BufferView view(ResourceId resource) const {
+        return this->resources.at(resource).view;
+    }
+
+    // Marks the contents of an input as changed. If the new contents are uploaded in the same
+    // recording as the run, for example by flushing a shadow buffer, that needs a barrier first.
+    void touch(ResourceId input);
+
+    // Forgets which versions every job has seen, so that the next run records all of them.
+    void invalidate();
+};
+
+struct JobGraphStats {
+    uint32_t recorded;
+    uint32_t skipped;
+};
+
+// Records every job whose inputs changed since it last ran, in dependency order, with a barrier
+// before each job that reads something written earlier in the same run. The versions are updated
+// as the jobs are recorded, so the recording must be submitted.
+JobGraphStats run_jobs(Context& ctx, JobGraph& graph);
+
+#endif
@@ -0,0 +1,81 @@
+#include "monte_carlo.hpp"
+
+#include <numeric>
+#include <stdexcept>
+#include <cmath>
+
+NIRAH_SHADER(mc_pi)
+NIRAH_SHADER(mc_option)
+
+namespace {
+    constexpr uint32_t group_size = 256;
+    constexpr uint32_t blocks_per_invocation = 64;
+
+    struct Params {
+        uint32_t n_blocks;
+        uint32_t blocks_per_invocation;
+        uint32_t seed_lo;
+        uint32_t seed_hi;
+        uint32_t counter_lo;
+        uint32_t counter_hi;
+    };
+
+    Params stream_params(const MonteCarloPlan& plan, RandomStream& stream) {
+        if (stream.generator != RngGenerator::Philox4x32)
+            throw std::invalid_argument("Monte Carlo pipelines only support Philox4x32");
+
+        auto params = Params{
+            .n_blocks = plan.blocks,
+            .blocks_per_invocation = blocks_per_invocation,
+            .seed_lo = static_cast<uint32_t>(stream.seed),
+            .seed_hi = static_cast<uint32_t>(stream.seed >> 32),
+            .counter_lo = static_cast<uint32_t>(stream.counter),
+            .counter_hi = static_cast<uint32_t>(stream.counter >> 32),
+        };
+        stream.counter += plan.blocks;
+        return params;
+    }
+}
+
+MonteCarloPlan create_monte_carlo_plan(Context& ctx, uint32_t blocks) {
+    uint32_t groups = div_ceil(div_ceil(blocks, blocks_per_invocation), group_size);
+    return {
+        .blocks = blocks,
+        .groups = groups,
+        .partials = create_device_buffer(ctx, groups * sizeof(uint32_t)),
+    };
+}
+
+void monte_carlo_pi(Context& ctx, const MonteCarloPlan& plan, RandomStream& stream) {
+    dispatch(ctx, shaders::mc_pi, {ctx.params(stream_params(plan, stream)), plan.partials}, plan.groups);
+}
+
+double read_monte_carlo_pi(const MonteCarloPlan& plan) {
+    auto partials = download_buffer<uint32_t>(plan.partials);
+    auto inside = std::accumulate(partials.begin(), partials.end(), uint64_t{0});
+    return 4.0 * inside / (2.0 * plan.blocks);
+}
+
+void monte_carlo_option(Context& ctx, const MonteCarloPlan& plan, RandomStream& stream, const EuropeanOption& option) {
+    struct {
+        Params stream;
+        EuropeanOption option;
+    } params = {stream_params(plan, stream), option};
+
+    dispatch(ctx, shaders::mc_option, {ctx.params(params), plan.partials}, plan.groups);
+}
+
+double read_monte_carlo_option(const MonteCarloPlan& plan, const EuropeanOption& option) {
+    auto partials = download_buffer<float>(plan.partials);
+    auto payoff = std::accumulate(partials.begin(), partials.end(), 0.0);
+    return std::exp(-option.rate * option.maturity) * payoff / (4.0 * plan.blocks);
+}
+
+double black_scholes_call(const EuropeanOption& option) {
+    auto normal_cdf = [](double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); };
+    double sqrt_t = std::sqrt(option.maturity);
+    double d1 = (std::log(option.spot / option.strike) + (option.rate + 0.5 * option.volatility * option.volatility) * option.maturity)
+        / (option.volatility * sqrt_t);
+    double d2 = d1 - option.volatility * sqrt_t;
+    return option.spot * normal_cdf(d1) - option.strike * std::exp(-option.rate * option.maturity) * normal_cdf(d2);
+}
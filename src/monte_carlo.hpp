@@ -0,0 +1,43 @@
+#ifndef _NIRAH_MONTE_CARLO_HPP
+#define _NIRAH_MONTE_CARLO_HPP
+
+#include "context.hpp"
+#include "random.hpp"
+
+#include <cstdint>
+
+// Sample Monte Carlo pipelines built on the Philox4x32 generator of random.hpp. Random numbers
+// are generated and consumed in the same kernel, and only a partial result per workgroup is
+// read back.
+
+struct EuropeanOption {
+    float spot;
+    float strike;
+    float rate;
+    float volatility;
+    float maturity;
+};
+
+struct MonteCarloPlan {
+    // Number of Philox blocks of 4 random numbers.
+    uint32_t blocks;
+    uint32_t groups;
+    Buffer partials;
+};
+
+MonteCarloPlan create_monte_carlo_plan(Context& ctx, uint32_t blocks);
+
+// Records an estimation of pi from 2 points per block, and advances the stream.
+void monte_carlo_pi(Context& ctx, const MonteCarloPlan& plan, RandomStream& stream);
+
+double read_monte_carlo_pi(const MonteCarloPlan& plan);
+
+// Records the pricing of a European call option from 4 paths per block, and advances the stream.
+void monte_carlo_option(Context& ctx, const MonteCarloPlan& plan, RandomStream& stream, const EuropeanOption& option);
+
+double read_monte_carlo_option(const MonteCarloPlan& plan, const EuropeanOption& option);
+
+// Closed-form Black-Scholes price of a European call option.
+double black_scholes_call(const EuropeanOption& option);
+
+#endif
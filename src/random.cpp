@@ -0,0 +1,191 @@
+#include "random.hpp"
+
+#include <bit>
+#include <cmath>
+
+NIRAH_SHADER(rng_fill)
+
+namespace {
+    constexpr uint32_t group_size = 64;
+
+    enum Distribution : uint32_t {
+        DISTRIBUTION_BITS,
+        DISTRIBUTION_UNIFORM,
+        DISTRIBUTION_NORMAL,
+        DISTRIBUTION_EXPONENTIAL,
+    };
+
+    struct Params {
+        uint32_t n;
+        uint32_t generator;
+        uint32_t distribution;
+        uint32_t seed_lo;
+        uint32_t seed_hi;
+        uint32_t counter_lo;
+        uint32_t counter_hi;
+        float a;
+        float b;
+    };
+
+    void fill_random(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream, Distribution distribution, float a, float b) {
+        auto params = Params{
+            .n = n,
+            .generator = static_cast<uint32_t>(stream.generator),
+            .distribution = distribution,
+            .seed_lo = static_cast<uint32_t>(stream.seed),
+            .seed_hi = static_cast<uint32_t>(stream.seed >> 32),
+            .counter_lo = static_cast<uint32_t>(stream.counter),
+            .counter_hi = static_cast<uint32_t>(stream.counter >> 32),
+            .a = a,
+            .b = b,
+        };
+
+        uint32_t blocks = div_ceil(n, 4);
+        dispatch(ctx, shaders::rng_fill, {ctx.params(params), dst}, div_ceil(blocks, group_size));
+        stream.counter += blocks;
+    }
+
+    std::array<uint32_t, 4> next_block(RandomStream& stream) {
+        auto ctr = std::array<uint32_t, 4>{static_cast<uint32_t>(stream.counter), static_cast<uint32_t>(stream.counter >> 32), 0, 0};
+        auto seed_lo = static_cast<uint32_t>(stream.seed);
+        auto seed_hi = static_cast<uint32_t>(stream.seed >> 32);
+        ++stream.counter;
+
+        if (stream.generator == RngGenerator::Philox4x32)
+            return philox4x32(ctr, {seed_lo, seed_hi});
+        else
+            return threefry4x32(ctr, {seed_lo, seed_hi, 0, 0});
+    }
+
+    // Same as to_unit in rng_fill.comp.
+    float to_unit(uint32_t bits) {
+        return static_cast<float>((bits >> 8) | 1) * (1.f / 16777216.f);
+    }
+
+    template <typename F>
+    std::vector<float> generate(RandomStream stream, uint32_t n, F transform) {
+        auto result = std::vector<float>();
+        result.reserve(n + 3);
+        while (result.size() < n) {
+            auto values = transform(next_block(stream));
+            result.insert(result.end(), values.begin(), values.end());
+        }
+        result.resize(n);
+        return result;
+    }
+
+    uint32_t rotl(uint32_t x, uint32_t r) {
+        return (x << r) | (x >> (32 - r));
+    }
+}
+
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key) {
+    for (uint32_t round = 0; round < 10; ++round) {
+        uint64_t product0 = uint64_t{0xD2511F53} * ctr[0];
+        uint64_t product1 = uint64_t{0xCD9E8D57} * ctr[2];
+        ctr = {
+            static_cast<uint32_t>(product1 >> 32) ^ ctr[1] ^ key[0],
+            static_cast<uint32_t>(product1),
+            static_cast<uint32_t>(product0 >> 32) ^ ctr[3] ^ key[1],
+            static_cast<uint32_t>(product0),
+        };
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+    }
+    return ctr;
+}
+
+std::array<uint32_t, 4> threefry4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 4> key) {
+    constexpr uint32_t rotations[16] = {10, 26, 11, 21, 13, 27, 23, 5, 6, 20, 17, 11, 25, 10, 18, 20};
+    const uint32_t ks[5] = {key[0], key[1], key[2], key[3], 0x1BD11BDA ^ key[0] ^ key[1] ^ key[2] ^ key[3]};
+
+    auto x = ctr;
+    for (size_t i = 0; i < 4; ++i) {
+        x[i] += ks[i];
+    }
+
+    for (uint32_t round = 0; round < 20; ++round) {
+        uint32_t r0 = rotations[(round % 8) * 2];
+        uint32_t r1 = rotations[(round % 8) * 2 + 1];
+        if (round % 2 == 0) {
+            x[0] += x[1]; x[1] = rotl(x[1], r0) ^ x[0];
+            x[2] += x[3]; x[3] = rotl(x[3], r1) ^ x[2];
+        } else {
+            x[0] += x[3]; x[3] = rotl(x[3], r0) ^ x[0];
+            x[2] += x[1]; x[1] = rotl(x[1], r1) ^ x[2];
+        }
+
+        if (round % 4 == 3) {
+            uint32_t s = round / 4 + 1;
+            for (uint32_t i = 0; i < 4; ++i) {
+                x[i] += ks[(s + i) % 5];
+            }
+            x[3] += s;
+        }
+    }
+    return x;
+}
+
+void random_bits(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream) {
+    fill_random(ctx, dst, n, stream, DISTRIBUTION_BITS, 0, 0);
+}
+
+void random_uniform(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream, float lo, float hi) {
+    fill_random(ctx, dst, n, stream, DISTRIBUTION_UNIFORM, lo, hi);
+}
+
+void random_normal(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream, float mean, float stddev) {
+    fill_random(ctx, dst, n, stream, DISTRIBUTION_NORMAL, mean, stddev);
+}
+
+void random_exponential(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream, float rate) {
+    fill_random(ctx, dst, n, stream, DISTRIBUTION_EXPONENTIAL, rate, 0);
+}
+
+std::vector<uint32_t> random_bits_reference(RandomStream stream, uint32_t n) {
+    auto result = std::vector<uint32_t>();
+    result.reserve(n + 3);
+    while (result.size() < n) {
+        auto bits = next_block(stream);
+        result.insert(result.end(), bits.begin(), bits.end());
+    }
+    result.resize(n);
+    return result;
+}
+
+std::vector<float> random_uniform_reference(RandomStream stream, uint32_t n, float lo, float hi) {
+    // Keep the operations separate, so that they are not contracted into an fma,
+    // just like the precise qualifier in rng_fill.comp.
+    float range = hi - lo;
+    return generate(stream, n, [&](std::array<uint32_t, 4> bits) {
+        auto values = std::array<float, 4>();
+        for (size_t i = 0; i < 4; ++i) {
+            volatile float scaled = to_unit(bits[i]) * range;
+            values[i] = lo + scaled;
+        }
+        return values;
+    });
+}
+
+std::vector<float> random_normal_reference(RandomStream stream, uint32_t n, float mean, float stddev) {
+    return generate(stream, n, [&](std::array<uint32_t, 4> bits) {
+        auto values = std::array<float, 4>();
+        for (size_t i = 0; i < 4; i += 2) {
+            float r = std::sqrt(-2.f * std::log(to_unit(bits[i])));
+            float theta = 6.28318530718f * to_unit(bits[i + 1]);
+            values[i] = mean + stddev * (r * std::cos(theta));
+            values[i + 1] = mean + stddev * (r * std::sin(theta));
+        }
+        return values;
+    });
+}
+
+std::vector<float> random_exponential_reference(RandomStream stream, uint32_t n, float rate) {
+    return generate(stream, n, [&](std::array<uint32_t, 4> bits) {
+        auto values = std::array<float, 4>();
+        for (size_t i = 0; i < 4; ++i) {
+            values[i] = -std::log(to_unit(bits[i])) / rate;
+        }
+        return values;
+    });
+}
@@ -0,0 +1,54 @@
+#ifndef _NIRAH_RANDOM_HPP
+#define _NIRAH_RANDOM_HPP
+
+#include "context.hpp"
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+enum class RngGenerator : uint32_t {
+    Philox4x32,
+    Threefry4x32,
+};
+
+// A stream of random numbers from a counter-based generator. Every block of 4 numbers is
+// the encryption of its 64-bit index with the seed as key, so streams with different seeds are
+// independent, and any part of a stream can be generated without generating what comes before.
+struct RandomStream {
+    RngGenerator generator = RngGenerator::Philox4x32;
+    uint64_t seed;
+    // Index of the next block of 4 numbers, advanced by every fill.
+    uint64_t counter = 0;
+};
+
+// Philox4x32-10 and Threefry4x32-20, as in Random123.
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key);
+
+std::array<uint32_t, 4> threefry4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 4> key);
+
+// Record a fill of the first n elements of `dst` with the next numbers of the stream, and advance
+// the stream past them. Numbers are generated on the device and never cross PCIe.
+void random_bits(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream);
+
+// Uniform floats in [lo, hi).
+void random_uniform(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream, float lo = 0, float hi = 1);
+
+// Normally distributed floats, by the Box-Muller transform.
+void random_normal(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream, float mean = 0, float stddev = 1);
+
+// Exponentially distributed floats.
+void random_exponential(Context& ctx, BufferView dst, uint32_t n, RandomStream& stream, float rate = 1);
+
+// CPU implementations, generating the same numbers as the device from the same stream.
+// random_bits_reference and random_uniform_reference are bit-exact, the others involve
+// transcendental functions and match to within a few ulp.
+std::vector<uint32_t> random_bits_reference(RandomStream stream, uint32_t n);
+
+std::vector<float> random_uniform_reference(RandomStream stream, uint32_t n, float lo = 0, float hi = 1);
+
+std::vector<float> random_normal_reference(RandomStream stream, uint32_t n, float mean = 0, float stddev = 1);
+
+std::vector<float> random_exponential_reference(RandomStream stream, uint32_t n, float rate = 1);
+
+#endif
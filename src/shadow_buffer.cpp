@@ -0,0 +1,125 @@
+#include "shadow_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+void ShadowBuffer::mark_dirty(Pal::gpusize offset, Pal::gpusize size) {
+    if (offset > this->size || size > this->size - offset)
+        throw std::out_of_range("Dirty range outside of the shadow buffer");
+    if (size == 0)
+        return;
+
+    auto start = offset;
+    auto end = offset + size;
+
+    // Absorb every range that overlaps or touches [start, end).
+    auto it = this->dirty.upper_bound(start);
+    if (it != this->dirty.begin() && std::prev(it)->second >= start)
+        --it;
+    while (it != this->dirty.end() && it->first <= end) {
+        start = std::min(start, it->first);
+        end = std::max(end, it->second);
+        it = this->dirty.erase(it);
+    }
+    this->dirty.emplace(start, end);
+}
+
+void ShadowBuffer::write(Pal::gpusize offset, const void* data, Pal::gpusize size) {
+    this->mark_dirty(offset, size);
+    if (size > 0)
+        std::memcpy(this->shadow.get() + offset, data, size);
+}
+
+namespace {
+    Pal::gpusize pinned_size(const Context& ctx, Pal::gpusize size) {
+        auto granularity = ctx.props.gpuMemoryProperties.realMemAllocGranularity;
+        return std::max<Pal::gpusize>((size + granularity - 1) / granularity * granularity, granularity);
+    }
+
+    // Fills write whole 32-bit words, so the device side is allocated and cleared in whole words.
+    Pal::gpusize word_size(Pal::gpusize size) {
+        return (size + 3) / 4 * 4;
+    }
+
+    Buffer create_device_side(Context& ctx, Pal::gpusize size) {
+        auto buffer = create_device_buffer(ctx, word_size(size));
+        buffer.size = size;
+        return buffer;
+    }
+}
+
+ShadowBuffer create_shadow_buffer(Context& ctx, Pal::gpusize size) {
+    auto granularity = ctx.props.gpuMemoryProperties.realMemAllocGranularity;
+    auto padded = pinned_size(ctx, size);
+
+    auto* shadow = static_cast<std::byte*>(std::aligned_alloc(granularity, padded));
+    if (!shadow)
+        throw std::bad_alloc();
+    auto owned = std::unique_ptr<std::byte, decltype(&std::free)>(shadow, &std::free);
+    std::memset(shadow, 0, padded);
+
+    auto buffer = ShadowBuffer{
+        .size = size,
+        .shadow = std::move(owned),
+        .pinned = create_pinned_memory(ctx.device, shadow, padded),
+        .device = create_device_side(ctx, size),
+        .dirty = {},
+    };
+
+    ctx.begin();
+    fill(ctx, buffer.device.view(0, word_size(size)), 0);
+    ctx.submit();
+    return buffer;
+}
+
+UploadStats flush(Context& ctx, ShadowBuffer& buffer, Pal::gpusize merge_gap) {
+    auto regions = std::vector<Pal::MemoryCopyRegion>();
+    Pal::gpusize bytes = 0;
+    for (auto [start, end] : buffer.dirty) {
+        if (!regions.empty()) {
+            auto& last = regions.back();
+            if (start - (last.srcOffset + last.copySize) < merge_gap) {
+                bytes += end - (last.srcOffset + last.copySize);
+                last.copySize = end - last.srcOffset;
+                continue;
+            }
+        }
+        regions.push_back({
+            .srcOffset = start,
+            .dstOffset = start,
+            .copySize = end - start,
+        });
+        bytes += end - start;
+    }
+    buffer.dirty.clear();
+
+    if (!regions.empty())
+        ctx.cmd_buf->CmdCopyMemory(*buffer.pinned, *buffer.device.memory, regions.size(), regions.data());
+    return {
+        .regions = static_cast<uint32_t>(regions.size()),
+        .bytes = bytes,
+    };
+}
+
+void release_shadow_buffer(ShadowBuffer& buffer) {
+    buffer.device = {};
+    buffer.pinned = {};
+}
+
+void restore_shadow_buffers(Context& ctx, std::span<ShadowBuffer* const> buffers) {
+    for (auto* buffer : buffers) {
+        buffer->pinned = create_pinned_memory(ctx.device, buffer->shadow.get(), pinned_size(ctx, buffer->size));
+        buffer->device = create_device_side(ctx, buffer->size);
+        buffer->dirty.clear();
+    }
+
+    ctx.begin();
+    for (auto* buffer : buffers) {
+        if (buffer->size > 0)
+            copy(ctx, {buffer->pinned.ptr, 0, buffer->size}, buffer->device);
+    }
+    ctx.submit();
+}
@@ -0,0 +1,67 @@
+#ifndef _NIRAH_SHADOW_BUFFER_HPP
+#define _NIRAH_SHADOW_BUFFER_HPP
+
+#include "context.hpp"
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <span>
+
+// A persistent device buffer with a copy in host memory, for large inputs of which only small
+// parts change between jobs. Writes go to the host copy and record which ranges they touched,
+// and flush uploads only those ranges. The host copy is pinned, so the device copies straight
+// from it, without a staging buffer.
+
+struct ShadowBuffer {
+    Pal::gpusize size;
+    // Page-aligned, so that it can be pinned.
+    std::unique_ptr<std::byte, decltype(&std::free)> shadow;
+    Unique<Pal::IGpuMemory> pinned;
+    Buffer device;
+    // Disjoint dirty ranges, as start -> end. Touching ranges are merged.
+    std::map<Pal::gpusize, Pal::gpusize> dirty;
+
+    // Reading the host copy is free; changes made through this span must be marked dirty.
+    std::span<std::byte> data() {
+        return {this->shadow.get(), this->size};
+    }
+
+    void mark_dirty(Pal::gpusize offset, Pal::gpusize size);
+
+    // Copies `size` bytes to the host copy at `offset`, and marks them dirty.
+    void write(Pal::gpusize offset, const void* data, Pal::gpusize size);
+
+    template <typename T>
+    void write(Pal::gpusize index, std::span<const T> items) {
+        this->write(index * sizeof(T), items.data(), items.size_bytes());
+    }
+
+    operator BufferView() const {
+        return this->device;
+    }
+};
+
+struct UploadStats {
+    uint32_t regions;
+    Pal::gpusize bytes;
+};
+
+// The initial contents are zero, on both sides.
+ShadowBuffer create_shadow_buffer(Context& ctx, Pal::gpusize size);
+
+// Records the upload of all dirty ranges as a single copy command, and clears them. Ranges closer
+// than `merge_gap` are uploaded as one region, including the gap, which is cheaper than another
+// region for small gaps. The host copy must not change until the submission completes.
+UploadStats flush(Context& ctx, ShadowBuffer& buffer, Pal::gpusize merge_gap = 4096);
+
+// Destroys the device side of the buffer, after the device was lost and before recover_context.
+// The host copy stays.
+void release_shadow_buffer(ShadowBuffer& buffer);
+
+// Creates the device side of released buffers again, and uploads their host copies in one
+// submission. Device copies then match the host copies, including ranges that were not flushed,
+// so anything the device wrote into them since the last download is lost.
+void restore_shadow_buffers(Context& ctx, std::span<ShadowBuffer* const> buffers);
+
+#endif
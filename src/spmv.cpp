@@ -0,0 +1,210 @@
+#include "spmv.hpp"
+
+#include <algorithm>
+
+NIRAH_SHADER(spmv_csr_scalar)
+NIRAH_SHADER(spmv_csr_vector)
+NIRAH_SHADER(spmv_csr_long)
+NIRAH_SHADER(spmv_ell)
+NIRAH_SHADER(spmv_sell)
+
+namespace {
+    constexpr uint32_t group_size = 64;
+
+    uint32_t row_length(const CsrMatrix& a, uint32_t row) {
+        return a.row_offsets[row + 1] - a.row_offsets[row];
+    }
+}
+
+EllMatrix csr_to_ell(const CsrMatrix& a) {
+    uint32_t width = 0;
+    for (uint32_t row = 0; row < a.rows; ++row) {
+        width = std::max(width, row_length(a, row));
+    }
+
+    auto ell = EllMatrix{
+        .rows = a.rows,
+        .cols = a.cols,
+        .width = width,
+        .col_indices = std::vector<uint32_t>(size_t{width} * a.rows, 0),
+        .values = std::vector<float>(size_t{width} * a.rows, 0),
+    };
+
+    for (uint32_t row = 0; row < a.rows; ++row) {
+        for (uint32_t k = 0; k < row_length(a, row); ++k) {
+            auto i = a.row_offsets[row] + k;
+            ell.col_indices[size_t{k} * a.rows + row] = a.col_indices[i];
+            ell.values[size_t{k} * a.rows + row] = a.values[i];
+        }
+    }
+
+    return ell;
+}
+
+SlicedEllMatrix csr_to_sliced_ell(const CsrMatrix& a) {
+    constexpr auto slice_size = SlicedEllMatrix::slice_size;
+
+    auto sell = SlicedEllMatrix{
+        .rows = a.rows,
+        .cols = a.cols,
+        .slice_offsets = {0},
+        .col_indices = {},
+        .values = {},
+    };
+
+    for (uint32_t slice = 0; slice < sell.slices(); ++slice) {
+        uint32_t first = slice * slice_size;
+        uint32_t last = std::min(first + slice_size, a.rows);
+
+        uint32_t width = 0;
+        for (uint32_t row = first; row < last; ++row) {
+            width = std::max(width, row_length(a, row));
+        }
+
+        auto base = sell.col_indices.size();
+        sell.col_indices.resize(base + width * slice_size, 0);
+        sell.values.resize(base + width * slice_size, 0);
+
+        for (uint32_t row = first; row < last; ++row) {
+            for (uint32_t k = 0; k < row_length(a, row); ++k) {
+                auto i = a.row_offsets[row] + k;
+                auto j = base + k * slice_size + (row - first);
+                sell.col_indices[j] = a.col_indices[i];
+                sell.values[j] = a.values[i];
+            }
+        }
+
+        sell.slice_offsets.push_back(sell.col_indices.size());
+    }
+
+    return sell;
+}
+
+std::vector<float> spmv_reference(const CsrMatrix& a, std::span<const float> x) {
+    auto y = std::vector<float>(a.rows);
+    for (uint32_t row = 0; row < a.rows; ++row) {
+        float sum = 0;
+        for (uint32_t i = a.row_offsets[row]; i < a.row_offsets[row + 1]; ++i) {
+            sum += a.values[i] * x[a.col_indices[i]];
+        }
+        y[row] = sum;
+    }
+    return y;
+}
+
+std::vector<float> spmv_reference(const EllMatrix& a, std::span<const float> x) {
+    auto y = std::vector<float>(a.rows);
+    for (uint32_t row = 0; row < a.rows; ++row) {
+        float sum = 0;
+        for (uint32_t k = 0; k < a.width; ++k) {
+            auto i = size_t{k} * a.rows + row;
+            sum += a.values[i] * x[a.col_indices[i]];
+        }
+        y[row] = sum;
+    }
+    return y;
+}
+
+std::vector<float> spmv_reference(const SlicedEllMatrix& a, std::span<const float> x) {
+    constexpr auto slice_size = SlicedEllMatrix::slice_size;
+
+    auto y = std::vector<float>(a.rows);
+    for (uint32_t row = 0; row < a.rows; ++row) {
+        uint32_t slice = row / slice_size;
+        float sum = 0;
+        for (uint32_t i = a.slice_offsets[slice] + row % slice_size; i < a.slice_offsets[slice + 1]; i += slice_size) {
+            sum += a.values[i] * x[a.col_indices[i]];
+        }
+        y[row] = sum;
+    }
+    return y;
+}
+
+GpuCsrMatrix upload_csr(Context& ctx, const CsrMatrix& a, CsrBinning binning) {
+    auto bins = std::array<std::vector<uint32_t>, CSR_BIN_MAX>();
+    for (uint32_t row = 0; row < a.rows; ++row) {
+        auto length = row_length(a, row);
+        if (length < binning.vector_threshold)
+            bins[CSR_BIN_SCALAR].push_back(row);
+        else if (length < binning.long_threshold)
+            bins[CSR_BIN_VECTOR].push_back(row);
+        else
+            bins[CSR_BIN_LONG].push_back(row);
+    }
+
+    auto bin_rows = std::vector<uint32_t>();
+    bin_rows.reserve(a.rows);
+    auto bin_sizes = std::array<uint32_t, CSR_BIN_MAX>();
+    for (size_t i = 0; i < CSR_BIN_MAX; ++i) {
+        bin_rows.insert(bin_rows.end(), bins[i].begin(), bins[i].end());
+        bin_sizes[i] = bins[i].size();
+    }
+
+    return {
+        .rows = a.rows,
+        .cols = a.cols,
+        .row_offsets = upload_buffer<uint32_t>(ctx, a.row_offsets),
+        .col_indices = upload_buffer<uint32_t>(ctx, a.col_indices),
+        .values = upload_buffer<float>(ctx, a.values),
+        .bin_rows = upload_buffer<uint32_t>(ctx, bin_rows),
+        .bin_sizes = bin_sizes,
+    };
+}
+
+GpuEllMatrix upload_ell(Context& ctx, const EllMatrix& a) {
+    return {
+        .rows = a.rows,
+        .cols = a.cols,
+        .width = a.width,
+        .col_indices = upload_buffer<uint32_t>(ctx, a.col_indices),
+        .values = upload_buffer<float>(ctx, a.values),
+    };
+}
+
+GpuSlicedEllMatrix upload_sliced_ell(Context& ctx, const SlicedEllMatrix& a) {
+    return {
+        .rows = a.rows,
+        .cols = a.cols,
+        .slice_offsets = upload_buffer<uint32_t>(ctx, a.slice_offsets),
+        .col_indices = upload_buffer<uint32_t>(ctx, a.col_indices),
+        .values = upload_buffer<float>(ctx, a.values),
+    };
+}
+
+void spmv(Context& ctx, const GpuCsrMatrix& a, BufferView x, BufferView y) {
+    Pal::gpusize bin_offset = 0;
+    for (size_t bin = 0; bin < CSR_BIN_MAX; ++bin) {
+        uint32_t n_rows = a.bin_sizes[bin];
+        if (n_rows == 0)
+            continue;
+
+        auto rows = a.bin_rows.view(bin_offset, n_rows * sizeof(uint32_t));
+        bin_offset += rows.size;
+
+        auto bindings = {ctx.params(n_rows), rows, BufferView(a.row_offsets), BufferView(a.col_indices), BufferView(a.values), x, y};
+        switch (bin) {
+            case CSR_BIN_SCALAR:
+                dispatch(ctx, shaders::spmv_csr_scalar, bindings, div_ceil(n_rows, group_size));
+                break;
+            case CSR_BIN_VECTOR:
+                dispatch(ctx, shaders::spmv_csr_vector, bindings, n_rows);
+                break;
+            case CSR_BIN_LONG:
+                dispatch(ctx, shaders::spmv_csr_long, bindings, n_rows);
+                break;
+        }
+    }
+}
+
+void spmv(Context& ctx, const GpuEllMatrix& a, BufferView x, BufferView y) {
+    struct {
+        uint32_t n_rows;
+        uint32_t width;
+    } params = {a.rows, a.width};
+
+    dispatch(ctx, shaders::spmv_ell, {ctx.params(params), a.col_indices, a.values, x, y}, div_ceil(a.rows, group_size));
+}
+
+void spmv(Context& ctx, const GpuSlicedEllMatrix& a, BufferView x, BufferView y) {
+    dispatch(ctx, shaders::spmv_sell, {ctx.params(a.rows), a.slice_offsets, a.col_indices, a.values, x, y}, div_ceil(a.rows, group_size));
+}
@@ -0,0 +1,120 @@
+#ifndef _NIRAH_SPMV_HPP
+#define _NIRAH_SPMV_HPP
+
+#include "context.hpp"
+
+#include <array>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+struct CsrMatrix {
+    uint32_t rows;
+    uint32_t cols;
+    // rows + 1 entries, row i spans [row_offsets[i], row_offsets[i + 1]).
+    std::vector<uint32_t> row_offsets;
+    std::vector<uint32_t> col_indices;
+    std::vector<float> values;
+
+    uint32_t nnz() const {
+        return this->row_offsets.back();
+    }
+};
+
+// ELL matrix, with entries stored column-major: entry k of row i is at k * rows + i.
+// Rows shorter than `width` are padded with entries of column 0 and value 0.
+struct EllMatrix {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t width;
+    std::vector<uint32_t> col_indices;
+    std::vector<float> values;
+};
+
+// Sliced ELL matrix: rows are grouped into slices of `slice_size`, each of which is stored as
+// a separate column-major ELL block padded to the longest row in that slice.
+struct SlicedEllMatrix {
+    constexpr static const uint32_t slice_size = 64;
+
+    uint32_t rows;
+    uint32_t cols;
+    // slices + 1 entries, the block of slice s spans [slice_offsets[s], slice_offsets[s + 1]).
+    std::vector<uint32_t> slice_offsets;
+    std::vector<uint32_t> col_indices;
+    std::vector<float> values;
+
+    uint32_t slices() const {
+        return div_ceil(this->rows, slice_size);
+    }
+};
+
+EllMatrix csr_to_ell(const CsrMatrix& a);
+
+SlicedEllMatrix csr_to_sliced_ell(const CsrMatrix& a);
+
+// CPU reference implementations of y = A * x.
+std::vector<float> spmv_reference(const CsrMatrix& a, std::span<const float> x);
+
+std::vector<float> spmv_reference(const EllMatrix& a, std::span<const float> x);
+
+std::vector<float> spmv_reference(const SlicedEllMatrix& a, std::span<const float> x);
+
+// CSR rows are binned by their number of nonzeros, and every bin is processed by a kernel
+// that suits the row length:
+// - rows with fewer than `vector_threshold` nonzeros are processed by a single invocation.
+// - rows with fewer than `long_threshold` nonzeros are processed by a single wave.
+// - longer rows are processed by a workgroup of 4 waves.
+struct CsrBinning {
+    uint32_t vector_threshold = 32;
+    uint32_t long_threshold = 4096;
+};
+
+enum CsrBin {
+    CSR_BIN_SCALAR,
+    CSR_BIN_VECTOR,
+    CSR_BIN_LONG,
+    CSR_BIN_MAX,
+};
+
+struct GpuCsrMatrix {
+    uint32_t rows;
+    uint32_t cols;
+    Buffer row_offsets;
+    Buffer col_indices;
+    Buffer values;
+    // Row indices of every bin, stored consecutively in bin order.
+    Buffer bin_rows;
+    std::array<uint32_t, CSR_BIN_MAX> bin_sizes;
+};
+
+struct GpuEllMatrix {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t width;
+    Buffer col_indices;
+    Buffer values;
+};
+
+struct GpuSlicedEllMatrix {
+    uint32_t rows;
+    uint32_t cols;
+    Buffer slice_offsets;
+    Buffer col_indices;
+    Buffer values;
+};
+
+GpuCsrMatrix upload_csr(Context& ctx, const CsrMatrix& a, CsrBinning binning = {});
+
+GpuEllMatrix upload_ell(Context& ctx, const EllMatrix& a);
+
+GpuSlicedEllMatrix upload_sliced_ell(Context& ctx, const SlicedEllMatrix& a);
+
+// Record y = A * x into the context's command buffer. `x` must hold at least `cols` floats and
+// `y` at least `rows` floats.
+void spmv(Context& ctx, const GpuCsrMatrix& a, BufferView x, BufferView y);
+
+void spmv(Context& ctx, const GpuEllMatrix& a, BufferView x, BufferView y);
+
+void spmv(Context& ctx, const GpuSlicedEllMatrix& a, BufferView x, BufferView y);
+
+#endif
@@ -0,0 +1,167 @@
+#include "stencil.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+NIRAH_SHADER(conv2d_naive)
+NIRAH_SHADER(conv2d_tiled)
+NIRAH_SHADER(stencil3d_naive)
+NIRAH_SHADER(stencil3d_tiled)
+
+namespace {
+    constexpr uint32_t max_filter_size = (2 * conv_max_radius + 1) * (2 * conv_max_radius + 1);
+
+    constexpr auto conv_naive_group_size = DispatchSize{16, 16};
+    constexpr auto stencil_naive_group_size = DispatchSize{8, 8, 4};
+
+    struct ConvParams {
+        uint32_t width;
+        uint32_t height;
+        uint32_t radius_x;
+        uint32_t radius_y;
+        uint32_t tile_x;
+        uint32_t tile_y;
+        float weights[max_filter_size];
+    };
+
+    struct StencilParams {
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        uint32_t tile_x;
+        uint32_t tile_y;
+        uint32_t tile_z;
+        float center;
+        float neighbor;
+    };
+
+    ConvParams conv_params(uint32_t width, uint32_t height, std::span<const float> filter, uint32_t radius_x, uint32_t radius_y, TileShape tile) {
+        if (radius_x > conv_max_radius || radius_y > conv_max_radius)
+            throw std::invalid_argument("Convolution filter radius too large");
+        if (filter.size() != (2 * radius_x + 1) * (2 * radius_y + 1))
+            throw std::invalid_argument("Convolution filter size does not match radius");
+        if (tile.x * tile.y != stencil_group_size || tile.z != 1)
+            throw std::invalid_argument("Invalid convolution tile shape");
+
+        auto params = ConvParams{width, height, radius_x, radius_y, tile.x, tile.y, {}};
+        std::copy(filter.begin(), filter.end(), params.weights);
+        return params;
+    }
+
+    void check_tile(TileShape tile) {
+        if (tile.x * tile.y * tile.z != stencil_group_size)
+            throw std::invalid_argument("Invalid stencil tile shape");
+    }
+
+    uint32_t clamp_index(int64_t i, uint32_t size) {
+        return static_cast<uint32_t>(std::clamp<int64_t>(i, 0, size - 1));
+    }
+}
+
+void convolve2d_naive(
+    Context& ctx,
+    BufferView src,
+    BufferView dst,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter,
+    uint32_t radius_x,
+    uint32_t radius_y
+) {
+    auto params = conv_params(width, height, filter, radius_x, radius_y, conv_naive_group_size);
+    dispatch(ctx, shaders::conv2d_naive, {ctx.params(params), src, dst}, grid_size({width, height}, conv_naive_group_size));
+}
+
+void convolve2d(
+    Context& ctx,
+    BufferView src,
+    BufferView dst,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter,
+    uint32_t radius_x,
+    uint32_t radius_y,
+    TileShape tile
+) {
+    auto params = conv_params(width, height, filter, radius_x, radius_y, tile);
+    dispatch(ctx, shaders::conv2d_tiled, {ctx.params(params), src, dst}, grid_size({width, height}, tile));
+}
+
+void convolve2d_separable(
+    Context& ctx,
+    BufferView src,
+    BufferView tmp,
+    BufferView dst,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter_x,
+    std::span<const float> filter_y,
+    uint32_t radius,
+    TileShape row_tile,
+    TileShape col_tile
+) {
+    convolve2d(ctx, src, tmp, width, height, filter_x, radius, 0, row_tile);
+    barrier(ctx);
+    convolve2d(ctx, tmp, dst, width, height, filter_y, 0, radius, col_tile);
+}
+
+void stencil3d_naive(Context& ctx, BufferView src, BufferView dst, DispatchSize size, float center, float neighbor) {
+    auto params = StencilParams{size.x, size.y, size.z, 0, 0, 0, center, neighbor};
+    dispatch(ctx, shaders::stencil3d_naive, {ctx.params(params), src, dst}, grid_size(size, stencil_naive_group_size));
+}
+
+void stencil3d(Context& ctx, BufferView src, BufferView dst, DispatchSize size, float center, float neighbor, TileShape tile) {
+    check_tile(tile);
+    auto params = StencilParams{size.x, size.y, size.z, tile.x, tile.y, tile.z, center, neighbor};
+    dispatch(ctx, shaders::stencil3d_tiled, {ctx.params(params), src, dst}, grid_size(size, tile));
+}
+
+std::vector<float> convolve2d_reference(
+    std::span<const float> src,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter,
+    uint32_t radius_x,
+    uint32_t radius_y
+) {
+    auto dst = std::vector<float>(size_t{width} * height);
+    uint32_t filter_width = 2 * radius_x + 1;
+    uint32_t filter_height = 2 * radius_y + 1;
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            float sum = 0;
+            for (uint32_t dy = 0; dy < filter_height; ++dy) {
+                for (uint32_t dx = 0; dx < filter_width; ++dx) {
+                    auto sx = clamp_index(int64_t{x} + dx - radius_x, width);
+                    auto sy = clamp_index(int64_t{y} + dy - radius_y, height);
+                    sum += filter[dy * filter_width + dx] * src[size_t{sy} * width + sx];
+                }
+            }
+            dst[size_t{y} * width + x] = sum;
+        }
+    }
+
+    return dst;
+}
+
+std::vector<float> stencil3d_reference(std::span<const float> src, DispatchSize size, float center, float neighbor) {
+    auto dst = std::vector<float>(size_t{size.x} * size.y * size.z);
+    auto at = [&](int64_t x, int64_t y, int64_t z) {
+        return src[(size_t{clamp_index(z, size.z)} * size.y + clamp_index(y, size.y)) * size.x + clamp_index(x, size.x)];
+    };
+
+    for (int64_t z = 0; z < size.z; ++z) {
+        for (int64_t y = 0; y < size.y; ++y) {
+            for (int64_t x = 0; x < size.x; ++x) {
+                float neighbors =
+                    at(x - 1, y, z) + at(x + 1, y, z) +
+                    at(x, y - 1, z) + at(x, y + 1, z) +
+                    at(x, y, z - 1) + at(x, y, z + 1);
+                dst[(z * size.y + y) * size.x + x] = center * at(x, y, z) + neighbor * neighbors;
+            }
+        }
+    }
+
+    return dst;
+}
@@ -0,0 +1,83 @@
+#ifndef _NIRAH_STENCIL_HPP
+#define _NIRAH_STENCIL_HPP
+
+#include "context.hpp"
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// Largest filter radius supported by the convolution kernels.
+constexpr uint32_t conv_max_radius = 8;
+
+// Number of invocations in a workgroup of the tiled kernels. The product of the dimensions of
+// a tile shape must equal this.
+constexpr uint32_t stencil_group_size = 256;
+
+// Shape of the part of the output that a workgroup of a tiled kernel computes.
+using TileShape = DispatchSize;
+
+// 2-D images and 3-D volumes are stored as densely packed floats, x-major.
+// All kernels clamp reads outside of the image to the edge.
+
+// Records a 2-D convolution (correlation) of `src` with a (2 * radius_x + 1) x (2 * radius_y + 1)
+// filter, given in row-major order, reading directly from global memory.
+void convolve2d_naive(
+    Context& ctx,
+    BufferView src,
+    BufferView dst,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter,
+    uint32_t radius_x,
+    uint32_t radius_y
+);
+
+// Like convolve2d_naive, but every workgroup loads its tile and halo into LDS first.
+void convolve2d(
+    Context& ctx,
+    BufferView src,
+    BufferView dst,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter,
+    uint32_t radius_x,
+    uint32_t radius_y,
+    TileShape tile = {16, 16}
+);
+
+// Records a convolution with the separable filter filter_y * filter_x^T, both of 2 * radius + 1
+// elements, as a horizontal pass into `tmp` followed by a vertical pass into `dst`.
+void convolve2d_separable(
+    Context& ctx,
+    BufferView src,
+    BufferView tmp,
+    BufferView dst,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter_x,
+    std::span<const float> filter_y,
+    uint32_t radius,
+    TileShape row_tile = {64, 4},
+    TileShape col_tile = {16, 16}
+);
+
+// Records a 7-point stencil over a width x height x depth volume:
+// dst = center * src + neighbor * (sum of the 6 face neighbours in src), reading directly from global memory.
+void stencil3d_naive(Context& ctx, BufferView src, BufferView dst, DispatchSize size, float center, float neighbor);
+
+// Like stencil3d_naive, but every workgroup loads its tile and halo into LDS first.
+void stencil3d(Context& ctx, BufferView src, BufferView dst, DispatchSize size, float center, float neighbor, TileShape tile = {16, 4, 4});
+
+std::vector<float> convolve2d_reference(
+    std::span<const float> src,
+    uint32_t width,
+    uint32_t height,
+    std::span<const float> filter,
+    uint32_t radius_x,
+    uint32_t radius_y
+);
+
+std::vector<float> stencil3d_reference(std::span<const float> src, DispatchSize size, float center, float neighbor);
+
+#endif
@@ -0,0 +1,278 @@
+#include "suballocator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+    // Moves are submitted in batches of about this many bytes, which bounds how far a pass can
+    // overshoot its budget.
+    constexpr Pal::gpusize max_batch_bytes = 32 * 1024 * 1024;
+
+    Pal::gpusize round_up(Pal::gpusize size, Pal::gpusize alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    struct Range {
+        uint32_t block;
+        Pal::gpusize offset;
+    };
+
+    // Smallest free range of the block that fits `size`, optionally only below `limit`.
+    std::optional<Pal::gpusize> best_fit(const Suballocator::Block& block, Pal::gpusize size, Pal::gpusize limit) {
+        std::optional<Pal::gpusize> best;
+        Pal::gpusize best_size = 0;
+        for (auto [offset, free_size] : block.free) {
+            if (offset + size > limit)
+                break;
+            if (free_size >= size && (!best || free_size < best_size)) {
+                best = offset;
+                best_size = free_size;
+            }
+        }
+        return best;
+    }
+
+    void take_range(Suballocator::Block& block, Pal::gpusize offset, Pal::gpusize size) {
+        auto it = block.free.find(offset);
+        auto remaining = it->second - size;
+        block.free.erase(it);
+        if (remaining != 0)
+            block.free.emplace(offset + size, remaining);
+        block.used += size;
+    }
+
+    void free_range(Suballocator::Block& block, Pal::gpusize offset, Pal::gpusize size) {
+        block.used -= size;
+        auto it = block.free.emplace(offset, size).first;
+
+        auto next = std::next(it);
+        if (next != block.free.end() && offset + it->second == next->first) {
+            it->second += next->second;
+            block.free.erase(next);
+        }
+        if (it != block.free.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second == offset) {
+                prev->second += it->second;
+                block.free.erase(it);
+            }
+        }
+    }
+
+    uint32_t release_empty_blocks(Suballocator& heap) {
+        uint32_t released = 0;
+        for (auto& block : heap.blocks) {
+            if (block.size != 0 && block.used == 0) {
+                auto memory = std::move(block.memory);
+                heap.committed -= block.size;
+                block.size = 0;
+                block.free.clear();
+                ++released;
+            }
+        }
+        return released;
+    }
+}
+
+Suballocation Suballocator::allocate(Context& ctx, Pal::gpusize size) {
+    auto rounded = round_up(std::max<Pal::gpusize>(size, 1), this->config.alignment);
+
+    std::optional<Range> range;
+    Pal::gpusize range_size = 0;
+    for (uint32_t i = 0; i < this->blocks.size(); ++i) {
+        auto offset = best_fit(this->blocks[i], rounded, this->blocks[i].size);
+        if (offset && (!range || this->blocks[i].free.at(*offset) < range_size)) {
+            range = Range{i, *offset};
+            range_size = this->blocks[i].free.at(*offset);
+        }
+    }
+
+    if (!range) {
+        auto block_size = std::max(this->config.block_size, rounded);
+        if (this->config.max_committed != 0 && this->committed + block_size > this->config.max_committed)
+            throw std::runtime_error("Suballocator out of memory");
+
+        auto slot = std::find_if(this->blocks.begin(), this->blocks.end(), [](const Block& block) { return block.size == 0; });
+        if (slot == this->blocks.end())
+            slot = this->blocks.insert(slot, Block{create_buffer(ctx.device, block_size), 0, 0, {}});
+        else
+            slot->memory = create_buffer(ctx.device, block_size);
+        slot->size = block_size;
+        slot->used = 0;
+        slot->free = {{0, block_size}};
+        this->committed += block_size;
+        range = Range{static_cast<uint32_t>(slot - this->blocks.begin()), 0};
+    }
+
+    take_range(this->blocks[range->block], range->offset, rounded);
+
+    auto entry = Entry{
+        .block = range->block,
+        .offset = range->offset,
+        .size = size,
+        .live = true,
+    };
+    if (this->free_entries.empty()) {
+        this->entries.push_back(entry);
+        return {static_cast<uint32_t>(this->entries.size() - 1)};
+    }
+    auto id = this->free_entries.back();
+    this->free_entries.pop_back();
+    this->entries[id] = entry;
+    return {id};
+}
+
+void Suballocator::release(Suballocation allocation) {
+    auto& entry = this->entries.at(allocation.id);
+    if (!entry.live)
+        throw std::invalid_argument("Suballocation released twice");
+
+    free_range(this->blocks[entry.block], entry.offset, round_up(std::max<Pal::gpusize>(entry.size, 1), this->config.alignment));
+    entry.live = false;
+    this->free_entries.push_back(allocation.id);
+}
+
+BufferView Suballocator::view(Suballocation allocation) const {
+    const auto& entry = this->entries.at(allocation.id);
+    return {this->blocks[entry.block].memory.ptr, entry.offset, entry.size};
+}
+
+Suballocator create_suballocator(SuballocatorConfig config) {
+    if (config.alignment == 0 || config.block_size < config.alignment)
+        throw std::invalid_argument("Invalid suballocator configuration");
+
+    return {
+        .config = config,
+        .blocks = {},
+        .entries = {},
+        .free_entries = {},
+        .committed = 0,
+        .generation = 0,
+    };
+}
+
+FragmentationStats fragmentation_stats(const Suballocator& heap) {
+    auto stats = FragmentationStats{};
+    Pal::gpusize free = 0;
+    for (const auto& block : heap.blocks) {
+        if (block.size == 0)
+            continue;
+        ++stats.blocks;
+        stats.used += block.used;
+        for (auto [offset, size] : block.free) {
+            ++stats.free_ranges;
+            free += size;
+            stats.largest_free = std::max(stats.largest_free, size);
+        }
+    }
+    stats.allocations = static_cast<uint32_t>(heap.entries.size() - heap.free_entries.size());
+    stats.committed = heap.committed;
+    stats.fragmentation = free == 0 ? 0 : 1 - static_cast<double>(stats.largest_free) / free;
+    return stats;
+}
+
+DefragmentStats defragment(Context& ctx, Suballocator& heap, double budget) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&] {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    auto stats = DefragmentStats{};
+    stats.blocks_released = release_empty_blocks(heap);
+
+    while (true) {
+        if (elapsed() >= budget)
+            break;
+
+        // Blocks from least to most used. Allocations only move to blocks later in this order, or
+        // to lower offsets within their block, so that passes converge.
+        auto order = std::vector<uint32_t>();
+        for (uint32_t i = 0; i < heap.blocks.size(); ++i) {
+            if (heap.blocks[i].size != 0)
+                order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return heap.blocks[a].used < heap.blocks[b].used;
+        });
+
+        auto by_block = std::vector<std::vector<uint32_t>>(heap.blocks.size());
+        for (uint32_t id = 0; id < heap.entries.size(); ++id) {
+            if (heap.entries[id].live)
+                by_block[heap.entries[id].block].push_back(id);
+        }
+
+        struct Move {
+            uint32_t id;
+            Range from;
+            Range to;
+            Pal::gpusize size;
+        };
+        auto moves = std::vector<Move>();
+        Pal::gpusize batch_bytes = 0;
+
+        for (size_t rank = 0; rank < order.size() && batch_bytes < max_batch_bytes; ++rank) {
+            auto source = order[rank];
+            // Highest offsets first, so that in-block moves leave the free space at the end.
+            auto& ids = by_block[source];
+            std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+                return heap.entries[a].offset > heap.entries[b].offset;
+            });
+
+            for (auto id : ids) {
+                if (batch_bytes >= max_batch_bytes)
+                    break;
+
+                const auto& entry = heap.entries[id];
+                auto size = round_up(std::max<Pal::gpusize>(entry.size, 1), heap.config.alignment);
+
+                std::optional<Range> target;
+                for (size_t other = order.size(); other-- > rank + 1 && !target;) {
+                    auto& block = heap.blocks[order[other]];
+                    if (auto offset = best_fit(block, size, block.size))
+                        target = Range{order[other], *offset};
+                }
+                if (!target) {
+                    if (auto offset = best_fit(heap.blocks[source], size, entry.offset))
+                        target = Range{source, *offset};
+                }
+                if (!target)
+                    continue;
+
+                // The old range is only freed once the batch has been copied, so that no copy of
+                // this batch writes to the source of another.
+                take_range(heap.blocks[target->block], target->offset, size);
+                moves.push_back({id, {entry.block, entry.offset}, *target, size});
+                batch_bytes += size;
+            }
+        }
+
+        if (moves.empty()) {
+            stats.complete = true;
+            break;
+        }
+
+        ctx.begin();
+        for (const auto& move : moves) {
+            copy(ctx, {heap.blocks[move.from.block].memory.ptr, move.from.offset, move.size},
+                {heap.blocks[move.to.block].memory.ptr, move.to.offset, move.size});
+        }
+        ctx.submit();
+        ++stats.submissions;
+
+        for (const auto& move : moves) {
+            free_range(heap.blocks[move.from.block], move.from.offset, move.size);
+            heap.entries[move.id].block = move.to.block;
+            heap.entries[move.id].offset = move.to.offset;
+        }
+        ++heap.generation;
+        stats.moves += moves.size();
+        stats.bytes_moved += batch_bytes;
+        stats.blocks_released += release_empty_blocks(heap);
+    }
+
+    stats.seconds = elapsed();
+    return stats;
+}
@@ -0,0 +1,93 @@
+#ifndef _NIRAH_SUBALLOCATOR_HPP
+#define _NIRAH_SUBALLOCATOR_HPP
+
+#include "context.hpp"
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+// Suballocates buffers from large blocks of device memory, which is much cheaper than a PAL
+// allocation per buffer. Allocations are referred to by handle rather than by address, so that
+// defragment can move them: views are resolved from handles when recording, and `generation`
+// changes whenever an allocation moved, which tells holders of cached views or descriptors
+// that they must resolve them again.
+
+struct SuballocatorConfig {
+    Pal::gpusize block_size = 64 * 1024 * 1024;
+    Pal::gpusize alignment = 256;
+    // Limit on the memory of all blocks together, or 0 for no limit.
+    Pal::gpusize max_committed = 0;
+};
+
+struct Suballocation {
+    uint32_t id;
+};
+
+struct Suballocator {
+    struct Block {
+        Unique<Pal::IGpuMemory> memory;
+        Pal::gpusize size;
+        Pal::gpusize used;
+        // Free ranges by offset, coalesced with their neighbours.
+        std::map<Pal::gpusize, Pal::gpusize> free;
+    };
+
+    struct Entry {
+        uint32_t block;
+        Pal::gpusize offset;
+        Pal::gpusize size;
+        bool live;
+    };
+
+    SuballocatorConfig config;
+    // Released blocks leave an empty slot behind, so that block indices stay valid.
+    std::vector<Block> blocks;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> free_entries;
+    Pal::gpusize committed;
+    uint64_t generation;
+
+    // Throws if no free range fits and no new block may be created.
+    Suballocation allocate(Context& ctx, Pal::gpusize size);
+
+    void release(Suballocation allocation);
+
+    BufferView view(Suballocation allocation) const;
+};
+
+Suballocator create_suballocator(SuballocatorConfig config = {});
+
+struct FragmentationStats {
+    uint32_t blocks;
+    uint32_t allocations;
+    Pal::gpusize committed;
+    Pal::gpusize used;
+    uint32_t free_ranges;
+    Pal::gpusize largest_free;
+    // 1 - largest free range / free memory: 0 if all free memory is in one range, and close
+    // to 1 if it is scattered over many small ones.
+    double fragmentation;
+};
+
+FragmentationStats fragmentation_stats(const Suballocator& heap);
+
+struct DefragmentStats {
+    uint32_t moves;
+    Pal::gpusize bytes_moved;
+    uint32_t blocks_released;
+    uint32_t submissions;
+    double seconds;
+    // Whether the heap is as compact as this defragmenter can make it.
+    bool complete;
+};
+
+// Runs one incremental defragmentation pass, meant for when the device is otherwise idle: empties
+// the least used blocks by copying their allocations into free ranges of fuller blocks, or into
+// lower offsets of the same block, on the device. Memory of emptied blocks is returned to PAL.
+// Moves are submitted in batches, and no new batch is started after `budget` seconds, so a pass
+// takes at most about one batch longer than that. Submits, so it must not be called while the
+// context is recording.
+DefragmentStats defragment(Context& ctx, Suballocator& heap, double budget);
+
+#endif
@@ -0,0 +1,206 @@
+#include "tensor.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <bit>
+
+NIRAH_SHADER(axpby_f32)
+NIRAH_SHADER(axpby_f16)
+NIRAH_SHADER(axpby_f16_packed)
+NIRAH_SHADER(axpby_i8)
+NIRAH_SHADER(gemm_f32)
+NIRAH_SHADER(gemm_f16)
+NIRAH_SHADER(gemm_f16_packed)
+NIRAH_SHADER(gemm_i8)
+NIRAH_SHADER(quantize)
+NIRAH_SHADER(dequantize)
+
+namespace {
+    constexpr uint32_t group_size = 256;
+    constexpr uint32_t gemm_tile = 64;
+
+    struct AxpbyParams {
+        uint32_t n;
+        float alpha;
+        float beta;
+        float x_scale;
+        int32_t x_zero_point;
+        float y_scale;
+        int32_t y_zero_point;
+    };
+
+    struct GemmParams {
+        uint32_t m;
+        uint32_t n;
+        uint32_t k;
+        uint32_t k_words;
+        float alpha;
+        float scale;
+        int32_t a_zero_point;
+        int32_t b_zero_point;
+    };
+
+    struct QuantizeParams {
+        uint32_t n;
+        ElementType type;
+        float scale;
+        int32_t zero_point;
+    };
+
+    uint32_t words(ElementType type, uint32_t n) {
+        return div_ceil(n, elements_per_word(type));
+    }
+
+    QuantizeParams quantize_params(ElementType type, Quantization quantization, uint32_t n) {
+        if (type == ElementType::F32)
+            throw std::invalid_argument("Quantization requires an fp16 or int8 tensor");
+        return {n, type, quantization.scale, quantization.zero_point};
+    }
+}
+
+bool use_packed_fp16(const Context& ctx) {
+    return ctx.props.gfxipProperties.flags.supportDoubleRate16BitInstructions;
+}
+
+void axpby(Context& ctx, float alpha, TensorView x, float beta, TensorView y, uint32_t n) {
+    if (x.type != y.type)
+        throw std::invalid_argument("axpby operands must have the same element type");
+
+    auto params = AxpbyParams{
+        .n = n,
+        .alpha = alpha,
+        .beta = beta,
+        .x_scale = x.quantization.scale,
+        .x_zero_point = x.quantization.zero_point,
+        .y_scale = y.quantization.scale,
+        .y_zero_point = y.quantization.zero_point,
+    };
+
+    ShaderBinary shader;
+    switch (x.type) {
+        case ElementType::F32: shader = shaders::axpby_f32; break;
+        case ElementType::F16: shader = use_packed_fp16(ctx) ? shaders::axpby_f16_packed : shaders::axpby_f16; break;
+        case ElementType::I8: shader = shaders::axpby_i8; break;
+    }
+    dispatch(ctx, shader, {ctx.params(params), x.view, y.view}, div_ceil(words(x.type, n), group_size));
+}
+
+void gemm(Context& ctx, TensorView a, TensorView b, BufferView c, GemmShape shape, float alpha) {
+    if (a.type != b.type)
+        throw std::invalid_argument("gemm operands must have the same element type");
+    if (shape.k % elements_per_word(a.type) != 0)
+        throw std::invalid_argument("gemm k must be a multiple of the elements per word");
+
+    auto params = GemmParams{
+        .m = shape.m,
+        .n = shape.n,
+        .k = shape.k,
+        .k_words = shape.k / elements_per_word(a.type),
+        .alpha = alpha,
+        .scale = a.quantization.scale * b.quantization.scale,
+        .a_zero_point = a.quantization.zero_point,
+        .b_zero_point = b.quantization.zero_point,
+    };
+
+    ShaderBinary shader;
+    switch (a.type) {
+        case ElementType::F32: shader = shaders::gemm_f32; break;
+        case ElementType::F16: shader = use_packed_fp16(ctx) ? shaders::gemm_f16_packed : shaders::gemm_f16; break;
+        case ElementType::I8: shader = shaders::gemm_i8; break;
+    }
+    dispatch(ctx, shader, {ctx.params(params), a.view, b.view, c}, grid_size({shape.n, shape.m}, {gemm_tile, gemm_tile}));
+}
+
+void quantize(Context& ctx, BufferView src, TensorView dst, uint32_t n) {
+    auto params = quantize_params(dst.type, dst.quantization, n);
+    dispatch(ctx, shaders::quantize, {ctx.params(params), src, dst.view}, div_ceil(words(dst.type, n), group_size));
+}
+
+void dequantize(Context& ctx, TensorView src, BufferView dst, uint32_t n) {
+    auto params = quantize_params(src.type, src.quantization, n);
+    dispatch(ctx, shaders::dequantize, {ctx.params(params), src.view, dst}, div_ceil(words(src.type, n), group_size));
+}
+
+uint16_t float_to_half(float value) {
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude > 0x7F800000)
+        return sign | 0x7E00;
+    // Values that round to infinity.
+    if (magnitude >= 0x477FF000)
+        return sign | 0x7C00;
+
+    if (magnitude < 0x38800000) {
+        // Subnormal or zero: shift the mantissa with its implicit bit into place, rounding to nearest even.
+        int shift = 126 - static_cast<int>(magnitude >> 23);
+        if (shift > 24)
+            return sign;
+        uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        uint32_t result = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t half_way = 1u << (shift - 1);
+        if (remainder > half_way || (remainder == half_way && (result & 1)))
+            ++result;
+        return sign | result;
+    }
+
+    // Normal: rebias the exponent and round the mantissa to nearest even. A carry out of the
+    // mantissa correctly increments the exponent.
+    uint32_t result = magnitude - 0x38000000;
+    result += 0xFFF + ((result >> 13) & 1);
+    return sign | (result >> 13);
+}
+
+float half_to_float(uint16_t value) {
+    uint32_t sign = uint32_t{value & 0x8000u} << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+
+    if (exponent == 0) {
+        float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 0x1F)
+        return std::bit_cast<float>(sign | 0x7F800000 | (mantissa << 13));
+    return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+std::vector<uint16_t> quantize_f16_reference(std::span<const float> src) {
+    auto dst = std::vector<uint16_t>(src.size());
+    std::transform(src.begin(), src.end(), dst.begin(), float_to_half);
+    return dst;
+}
+
+std::vector<int8_t> quantize_i8_reference(std::span<const float> src, Quantization quantization) {
+    auto dst = std::vector<int8_t>(src.size());
+    std::transform(src.begin(), src.end(), dst.begin(), [&](float x) {
+        auto q = static_cast<int32_t>(std::nearbyint(x / quantization.scale)) + quantization.zero_point;
+        return static_cast<int8_t>(std::clamp(q, -128, 127));
+    });
+    return dst;
+}
+
+std::vector<float> dequantize_i8_reference(std::span<const int8_t> src, Quantization quantization) {
+    auto dst = std::vector<float>(src.size());
+    std::transform(src.begin(), src.end(), dst.begin(), [&](int8_t q) {
+        return quantization.scale * static_cast<float>(q - quantization.zero_point);
+    });
+    return dst;
+}
+
+std::vector<float> gemm_reference(std::span<const float> a, std::span<const float> b, GemmShape shape) {
+    auto c = std::vector<float>(size_t{shape.m} * shape.n);
+    for (uint32_t i = 0; i < shape.m; ++i) {
+        for (uint32_t j = 0; j < shape.n; ++j) {
+            double sum = 0;
+            for (uint32_t l = 0; l < shape.k; ++l) {
+                sum += double{a[size_t{i} * shape.k + l]} * b[size_t{j} * shape.k + l];
+            }
+            c[size_t{i} * shape.n + j] = static_cast<float>(sum);
+        }
+    }
+    return c;
+}
@@ -0,0 +1,81 @@
+#ifndef _NIRAH_TENSOR_HPP
+#define _NIRAH_TENSOR_HPP
+
+#include "context.hpp"
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// fp16 elements are packed two per 32-bit word and int8 elements four per word, in little-endian
+// order. Operations select their kernel by the element type of their operands.
+enum class ElementType : uint32_t {
+    F32,
+    F16,
+    I8,
+};
+
+constexpr uint32_t elements_per_word(ElementType type) {
+    switch (type) {
+        case ElementType::F32: return 1;
+        case ElementType::F16: return 2;
+        case ElementType::I8: return 4;
+    }
+    return 1;
+}
+
+// Affine quantization of int8 elements: real = scale * (q - zero_point).
+struct Quantization {
+    float scale = 1;
+    int32_t zero_point = 0;
+};
+
+// A buffer of elements of some type.
+struct TensorView {
+    BufferView view;
+    ElementType type;
+    Quantization quantization = {};
+};
+
+// Row-major m x k matrix A times the transpose of row-major n x k matrix B, so that both operands
+// are read along k.
+struct GemmShape {
+    uint32_t m;
+    uint32_t n;
+    uint32_t k;
+};
+
+// Whether fp16 kernels use packed fp16 arithmetic. Without double rate fp16 instructions, converting
+// to fp32 is as fast and more accurate, so packed math is only used on devices that have them.
+bool use_packed_fp16(const Context& ctx);
+
+// Records y = alpha * x + beta * y for n elements. x and y must have the same element type; int8
+// results are quantized with the quantization of y.
+void axpby(Context& ctx, float alpha, TensorView x, float beta, TensorView y, uint32_t n);
+
+// Records C = alpha * A * B^T into an fp32 matrix C of m x n elements. A and B must have the same
+// element type, and for packed types k must be a multiple of the number of elements per word.
+// int8 products are accumulated in int32 and dequantized once.
+void gemm(Context& ctx, TensorView a, TensorView b, BufferView c, GemmShape shape, float alpha = 1);
+
+// Records the conversion of n fp32 elements to fp16 or int8 elements of `dst`.
+void quantize(Context& ctx, BufferView src, TensorView dst, uint32_t n);
+
+// Records the conversion of n fp16 or int8 elements to fp32.
+void dequantize(Context& ctx, TensorView src, BufferView dst, uint32_t n);
+
+// Conversions with round to nearest even, as done by the device.
+uint16_t float_to_half(float value);
+
+float half_to_float(uint16_t value);
+
+std::vector<uint16_t> quantize_f16_reference(std::span<const float> src);
+
+std::vector<int8_t> quantize_i8_reference(std::span<const float> src, Quantization quantization);
+
+std::vector<float> dequantize_i8_reference(std::span<const int8_t> src, Quantization quantization);
+
+// C = A * B^T, accumulated in double precision.
+std::vector<float> gemm_reference(std::span<const float> a, std::span<const float> b, GemmShape shape);
+
+#endif
@@ -0,0 +1,217 @@
+#include "topk.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+NIRAH_SHADER(topk_radix_histogram)
+NIRAH_SHADER(topk_radix_select)
+NIRAH_SHADER(topk_radix_gather)
+NIRAH_SHADER(topk_bitonic)
+
+namespace {
+    constexpr uint32_t group_size = 256;
+    constexpr uint32_t max_histogram_groups = 512;
+    // Size of the LDS tile of the bitonic kernel, see topk_bitonic.comp.
+    constexpr uint32_t tile = 1024;
+    // The first bitonic pass is spread over about this many workgroups.
+    constexpr uint32_t bitonic_groups = 1024;
+
+    struct BitonicParams {
+        uint32_t n;
+        uint32_t k;
+        uint32_t segment_length;
+        uint32_t has_indices;
+    };
+
+    uint32_t bitonic_segment_length(uint32_t n) {
+        return std::max(tile, div_ceil(n, bitonic_groups));
+    }
+
+    bool descending(const TopKEntry& a, const TopKEntry& b) {
+        return a.value != b.value ? a.value > b.value : a.index < b.index;
+    }
+
+    void check_k(const TopKPlan& plan, uint32_t n) {
+        if (n > plan.n)
+            throw std::invalid_argument("Top-k input is larger than the plan");
+        if (plan.k > n)
+            throw std::invalid_argument("Top-k k is larger than the input");
+    }
+}
+
+TopKPlan create_topk_plan(Context& ctx, uint32_t n, uint32_t k, uint32_t segments) {
+    if (segments > 1 && k > topk_max_bitonic_k)
+        throw std::invalid_argument("Segmented top-k only supports small k");
+
+    // The first bitonic pass produces the most candidates.
+    Pal::gpusize scratch_entries = 0;
+    if (segments == 1 && k <= topk_max_bitonic_k)
+        scratch_entries = Pal::gpusize{div_ceil(n, bitonic_segment_length(n))} * k;
+
+    Pal::gpusize out_entries = Pal::gpusize{k} * segments;
+    return {
+        .n = n,
+        .k = k,
+        .segments = segments,
+        .values = create_device_buffer(ctx, out_entries * sizeof(float)),
+        .indices = create_device_buffer(ctx, out_entries * sizeof(uint32_t)),
+        .state = create_device_buffer(ctx, 3 * sizeof(uint32_t)),
+        .histogram = create_device_buffer(ctx, 256 * sizeof(uint32_t)),
+        .counters = create_device_buffer(ctx, 2 * sizeof(uint32_t)),
+        .scratch_values = {
+            create_device_buffer(ctx, scratch_entries * sizeof(float)),
+            create_device_buffer(ctx, scratch_entries * sizeof(float)),
+        },
+        .scratch_indices = {
+            create_device_buffer(ctx, scratch_entries * sizeof(uint32_t)),
+            create_device_buffer(ctx, scratch_entries * sizeof(uint32_t)),
+        },
+    };
+}
+
+void topk(Context& ctx, const TopKPlan& plan, BufferView values, uint32_t n) {
+    if (plan.k <= topk_max_bitonic_k)
+        topk_bitonic(ctx, plan, values, n);
+    else
+        topk_radix(ctx, plan, values, n);
+}
+
+void topk_radix(Context& ctx, const TopKPlan& plan, BufferView values, uint32_t n) {
+    check_k(plan, n);
+
+    fill(ctx, plan.state, 0);
+    fill(ctx, plan.counters, 0);
+
+    for (uint32_t pass = 0; pass < 4; ++pass) {
+        uint32_t shift = 24 - pass * 8;
+
+        fill(ctx, plan.histogram, 0);
+        barrier(ctx);
+
+        struct {
+            uint32_t n;
+            uint32_t shift;
+        } histogram_params = {n, shift};
+
+        auto groups = std::clamp(div_ceil(n, group_size), 1u, max_histogram_groups);
+        dispatch_whole(ctx, shaders::topk_radix_histogram, {ctx.params(histogram_params), plan.state, values, plan.histogram}, groups);
+        barrier(ctx);
+
+        struct {
+            uint32_t k;
+            uint32_t shift;
+            uint32_t first_pass;
+        } select_params = {plan.k, shift, pass == 0};
+
+        dispatch(ctx, shaders::topk_radix_select, {ctx.params(select_params), plan.state, plan.histogram}, 1);
+        barrier(ctx);
+    }
+
+    struct {
+        uint32_t n;
+        uint32_t k;
+    } gather_params = {n, plan.k};
+
+    dispatch(
+        ctx,
+        shaders::topk_radix_gather,
+        {ctx.params(gather_params), plan.state, values, plan.values, plan.indices, plan.counters},
+        div_ceil(n, group_size)
+    );
+}
+
+void topk_bitonic(Context& ctx, const TopKPlan& plan, BufferView values, uint32_t n) {
+    check_k(plan, n);
+    if (plan.k > topk_max_bitonic_k)
+        throw std::invalid_argument("Bitonic top-k only supports small k");
+
+    auto in_values = values;
+    // Not read in the first pass, bound as placeholder.
+    auto in_indices = BufferView(plan.scratch_indices[0]);
+    uint32_t has_indices = 0;
+    uint32_t segment_length = bitonic_segment_length(n);
+    size_t pass = 0;
+
+    while (true) {
+        uint32_t segments = div_ceil(n, segment_length);
+        bool last = segments == 1;
+        const auto& out_values = last ? plan.values : plan.scratch_values[pass % 2];
+        const auto& out_indices = last ? plan.indices : plan.scratch_indices[pass % 2];
+
+        auto params = BitonicParams{n, plan.k, segment_length, has_indices};
+        dispatch(
+            ctx,
+            shaders::topk_bitonic,
+            {ctx.params(params), plan.state, in_values, in_indices, out_values, out_indices},
+            segments
+        );
+
+        if (last)
+            break;
+
+        barrier(ctx);
+        n = segments * plan.k;
+        in_values = out_values;
+        in_indices = out_indices;
+        has_indices = 1;
+        // Every next pass reduces its input by at least a factor tile / k.
+        segment_length = tile;
+        ++pass;
+    }
+}
+
+void topk_segmented(Context& ctx, const TopKPlan& plan, BufferView values, BufferView offsets) {
+    auto params = BitonicParams{0, plan.k, 0, 0};
+    dispatch(
+        ctx,
+        shaders::topk_bitonic,
+        {ctx.params(params), offsets, values, plan.scratch_indices[0], plan.values, plan.indices},
+        plan.segments
+    );
+}
+
+std::vector<TopKEntry> read_topk(const TopKPlan& plan) {
+    auto values = download_buffer<float>(plan.values);
+    auto indices = download_buffer<uint32_t>(plan.indices);
+
+    auto result = std::vector<TopKEntry>(values.size());
+    for (size_t i = 0; i < result.size(); ++i) {
+        result[i] = {values[i], indices[i]};
+    }
+
+    // Radix select does not sort, and equal values may be in any order.
+    for (size_t s = 0; s < plan.segments; ++s) {
+        auto first = result.begin() + s * plan.k;
+        std::sort(first, first + plan.k, descending);
+    }
+
+    return result;
+}
+
+std::vector<TopKEntry> topk_reference(std::span<const float> values, uint32_t k) {
+    auto entries = std::vector<TopKEntry>(values.size());
+    for (uint32_t i = 0; i < values.size(); ++i) {
+        entries[i] = {values[i], i};
+    }
+
+    k = std::min<uint32_t>(k, entries.size());
+    std::nth_element(entries.begin(), entries.begin() + k, entries.end(), descending);
+    entries.resize(k);
+    std::sort(entries.begin(), entries.end(), descending);
+    return entries;
+}
+
+std::vector<TopKEntry> topk_segmented_reference(std::span<const float> values, std::span<const uint32_t> offsets, uint32_t k) {
+    auto result = std::vector<TopKEntry>();
+    for (size_t s = 0; s + 1 < offsets.size(); ++s) {
+        auto segment = values.subspan(offsets[s], offsets[s + 1] - offsets[s]);
+        auto entries = topk_reference(segment, k);
+        for (auto& entry : entries) {
+            entry.index += offsets[s];
+        }
+        entries.resize(k, {-std::numeric_limits<float>::infinity(), 0xFFFFFFFF});
+        result.insert(result.end(), entries.begin(), entries.end());
+    }
+    return result;
+}
@@ -0,0 +1,64 @@
+#ifndef _NIRAH_TOPK_HPP
+#define _NIRAH_TOPK_HPP
+
+#include "context.hpp"
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// Largest k for which the bitonic per-workgroup kernel can be used.
+constexpr uint32_t topk_max_bitonic_k = 256;
+
+struct TopKEntry {
+    float value;
+    uint32_t index;
+};
+
+// Output and scratch buffers for top-k queries of the k largest elements of arrays of up to n
+// floats, or of `segments` segments of a single array.
+struct TopKPlan {
+    uint32_t n;
+    uint32_t k;
+    uint32_t segments;
+
+    // k entries per segment.
+    Buffer values;
+    Buffer indices;
+
+    // Radix select state.
+    Buffer state;
+    Buffer histogram;
+    Buffer counters;
+
+    // Candidates of intermediate bitonic passes.
+    Buffer scratch_values[2];
+    Buffer scratch_indices[2];
+};
+
+TopKPlan create_topk_plan(Context& ctx, uint32_t n, uint32_t k, uint32_t segments = 1);
+
+// Records a query for the k largest of the first `n` values. Uses the bitonic kernel for
+// k <= topk_max_bitonic_k and radix select otherwise.
+void topk(Context& ctx, const TopKPlan& plan, BufferView values, uint32_t n);
+
+// Radix select: 4 passes of 8 bits over the input to find the k-th largest element, followed by
+// a pass that gathers the result. The result is not sorted on the device.
+void topk_radix(Context& ctx, const TopKPlan& plan, BufferView values, uint32_t n);
+
+// Workgroups reduce chunks of the input to k sorted candidates, which are reduced further until
+// a single workgroup remains.
+void topk_bitonic(Context& ctx, const TopKPlan& plan, BufferView values, uint32_t n);
+
+// Records a query for the k largest values of every segment [offsets[s], offsets[s + 1]) of `values`.
+// Indices in the result are positions in `values`.
+void topk_segmented(Context& ctx, const TopKPlan& plan, BufferView values, BufferView offsets);
+
+// Reads back only the k results of every segment, each sorted by descending value.
+std::vector<TopKEntry> read_topk(const TopKPlan& plan);
+
+std::vector<TopKEntry> topk_reference(std::span<const float> values, uint32_t k);
+
+std::vector<TopKEntry> topk_segmented_reference(std::span<const float> values, std::span<const uint32_t> offsets, uint32_t k);
+
+#endif
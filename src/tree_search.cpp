@@ -0,0 +1,100 @@
+#include "tree_search.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+
+NIRAH_SHADER(uts)
+
+namespace {
+    struct Params {
+        uint32_t capacity;
+        uint32_t seed_lo;
+        uint32_t seed_hi;
+        uint32_t root_children;
+        uint32_t children;
+        uint32_t interior_threshold;
+    };
+
+    uint32_t interior_threshold(double q) {
+        return static_cast<uint32_t>(std::clamp(q, 0.0, 1.0) * 4294967295.0);
+    }
+}
+
+UtsPlan create_uts_plan(Context& ctx, uint32_t queue_capacity) {
+    auto groups = persistent_groups(ctx);
+    if (queue_capacity <= groups * 256)
+        throw std::invalid_argument("Work queue capacity must exceed the number of persistent invocations");
+
+    return {
+        .queue = create_work_queue(ctx, queue_capacity),
+        .groups = groups,
+        .result = create_device_buffer(ctx, 3 * sizeof(uint32_t)),
+    };
+}
+
+void uts(Context& ctx, const UtsPlan& plan, const UtsTree& tree) {
+    auto params = Params{
+        .capacity = plan.queue.capacity,
+        .seed_lo = static_cast<uint32_t>(tree.seed),
+        .seed_hi = static_cast<uint32_t>(tree.seed >> 32),
+        .root_children = tree.root_children,
+        .children = tree.children,
+        .interior_threshold = interior_threshold(tree.q),
+    };
+
+    // The root has key 0 and depth 0.
+    auto root = Task{0, 0, 0, 0};
+    reset_work_queue(ctx, plan.queue, {&root, 1});
+    fill(ctx, plan.result, 0);
+    barrier(ctx);
+    dispatch_whole(ctx, shaders::uts, {ctx.params(params), plan.queue.header, plan.queue.states, plan.queue.tasks, plan.result},
+        plan.groups);
+}
+
+UtsResult read_uts(const UtsPlan& plan) {
+    auto stats = read_work_queue(plan.queue);
+    if (stats.cancelled)
+        throw CancelledError("Tree search was cancelled");
+    else if (stats.overflow)
+        throw std::runtime_error("Work queue overflowed during tree search");
+
+    auto result = download_buffer<uint32_t>(plan.result);
+    return {
+        .nodes = result[0],
+        .leaves = result[1],
+        .max_depth = result[2],
+    };
+}
+
+UtsResult uts_reference(const UtsTree& tree) {
+    struct Node {
+        uint32_t key[2];
+        uint32_t depth;
+    };
+
+    auto key = std::array{static_cast<uint32_t>(tree.seed), static_cast<uint32_t>(tree.seed >> 32)};
+    auto threshold = interior_threshold(tree.q);
+    auto result = UtsResult{0, 0, 0};
+    auto stack = std::vector<Node>{{{0, 0}, 0}};
+    while (!stack.empty()) {
+        auto node = stack.back();
+        stack.pop_back();
+
+        auto n = node.depth == 0 ? tree.root_children : tree.children;
+        ++result.nodes;
+        for (uint32_t i = 0; i < n; ++i) {
+            auto hash = philox4x32({i, 0, node.key[0], node.key[1]}, key);
+            if (hash[2] < threshold) {
+                stack.push_back({{hash[0], hash[1]}, node.depth + 1});
+            } else {
+                ++result.nodes;
+                ++result.leaves;
+            }
+        }
+        result.max_depth = std::max(result.max_depth, n != 0 ? node.depth + 1 : node.depth);
+    }
+    return result;
+}
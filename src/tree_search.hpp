@@ -0,0 +1,45 @@
+#ifndef _NIRAH_TREE_SEARCH_HPP
+#define _NIRAH_TREE_SEARCH_HPP
+
+#include "context.hpp"
+#include "work_queue.hpp"
+
+#include <cstdint>
+
+// Unbalanced Tree Search on binomial trees, a sample workload for the work queue of
+// work_queue.hpp: the shape of the tree is only discovered while it is traversed.
+
+struct UtsTree {
+    uint64_t seed;
+    uint32_t root_children;
+    // Every non-root node has `children` children with probability `q`, or none.
+    uint32_t children;
+    double q;
+};
+
+struct UtsResult {
+    uint64_t nodes;
+    uint64_t leaves;
+    uint32_t max_depth;
+
+    bool operator==(const UtsResult&) const = default;
+};
+
+struct UtsPlan {
+    WorkQueue queue;
+    uint32_t groups;
+    Buffer result;
+};
+
+UtsPlan create_uts_plan(Context& ctx, uint32_t queue_capacity);
+
+// Records a traversal of the tree by persistent workgroups.
+void uts(Context& ctx, const UtsPlan& plan, const UtsTree& tree);
+
+// Throws if the work queue overflowed, in which case part of the tree was not visited, and
+// CancelledError if the search was cancelled with cancel_work_queue.
+UtsResult read_uts(const UtsPlan& plan);
+
+UtsResult uts_reference(const UtsTree& tree);
+
+#endif
@@ -0,0 +1,186 @@
+#include "upload_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    constexpr Pal::gpusize staging_alignment = 256;
+
+    Pal::gpusize align(Pal::gpusize size) {
+        return (size + staging_alignment - 1) / staging_alignment * staging_alignment;
+    }
+
+    // Waits for the transfer in flight, if any, after which its entries are resident.
+    void finish_transfer(Context& ctx, UploadCache& cache) {
+        if (!cache.in_flight)
+            return;
+
+        wait_fence(ctx.device, cache.fence.ptr);
+        for (auto& [data, entry] : cache.entries) {
+            entry.pending = false;
+        }
+        cache.in_flight = false;
+    }
+
+    void evict(UploadCache& cache, Pal::gpusize size) {
+        while (cache.resident + size > cache.capacity) {
+            auto victim = cache.entries.end();
+            for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it) {
+                const auto& entry = it->second;
+                if (entry.pending || entry.last_used >= cache.job)
+                    continue;
+                if (victim == cache.entries.end() || entry.last_used < victim->second.last_used)
+                    victim = it;
+            }
+
+            if (victim == cache.entries.end())
+                break;
+
+            cache.resident -= victim->second.buffer.size;
+            cache.entries.erase(victim);
+            ++cache.stats.evictions;
+        }
+    }
+
+    // Creates an entry for `array` without contents, replacing an older version.
+    UploadCache::Entry& insert(Context& ctx, UploadCache& cache, HostArray array) {
+        auto it = cache.entries.find(array.data);
+        if (it != cache.entries.end()) {
+            // The transfer in flight may still write the old buffer.
+            if (it->second.pending)
+                finish_transfer(ctx, cache);
+            cache.resident -= it->second.buffer.size;
+            cache.entries.erase(it);
+        }
+
+        evict(cache, array.size);
+        cache.resident += array.size;
+        return cache.entries.emplace(array.data, UploadCache::Entry{
+            .buffer = create_device_buffer(ctx, array.size),
+            .version = array.version,
+            .last_used = cache.job,
+            .pending = false,
+        }).first->second;
+    }
+
+    void reserve_staging(Context& ctx, UploadCache& cache, Pal::gpusize size) {
+        if (cache.staging && cache.staging->size >= size)
+            return;
+
+        cache.staging.reset();
+        auto staging = create_host_buffer(ctx, size);
+        void* data;
+        checkResult(staging.memory->Map(&data));
+        cache.staging_data = static_cast<std::byte*>(data);
+        cache.staging = std::move(staging);
+    }
+}
+
+UploadCache create_upload_cache(Context& ctx, Pal::gpusize capacity) {
+    auto cmda = create_cmd_allocator(ctx.device);
+    auto cmd_buf = create_cmd_buffer(ctx.device, cmda.ptr, Pal::EngineTypeDma);
+    return {
+        .capacity = capacity,
+        .resident = 0,
+        .job = 0,
+        .entries = {},
+        .stats = {},
+        .dma_queue = create_queue(ctx.device, ctx.props, Pal::EngineTypeDma),
+        .cmda = std::move(cmda),
+        .cmd_buf = std::move(cmd_buf),
+        .fence = create_fence(ctx.device),
+        .staging = std::nullopt,
+        .staging_data = nullptr,
+        .in_flight = false,
+    };
+}
+
+void begin_job(UploadCache& cache) {
+    ++cache.job;
+}
+
+void prefetch(Context& ctx, UploadCache& cache, std::span<const HostArray> arrays) {
+    finish_transfer(ctx, cache);
+
+    auto is_resident = [&](const HostArray& array) {
+        auto it = cache.entries.find(array.data);
+        return it != cache.entries.end() && it->second.version == array.version;
+    };
+
+    // Arrays that are resident already must not be evicted to make room for the others.
+    for (const auto& array : arrays) {
+        auto it = cache.entries.find(array.data);
+        if (it != cache.entries.end() && it->second.version == array.version)
+            it->second.last_used = std::max(it->second.last_used, cache.job + 1);
+    }
+
+    // Empty arrays have nothing to transfer, so they are resident right away.
+    auto transfers = std::vector<HostArray>();
+    Pal::gpusize staging_size = 0;
+    for (const auto& array : arrays) {
+        if (is_resident(array))
+            continue;
+        if (array.size == 0) {
+            insert(ctx, cache, array).last_used = cache.job + 1;
+        } else {
+            transfers.push_back(array);
+            staging_size += align(array.size);
+        }
+    }
+    if (transfers.empty())
+        return;
+
+    reserve_staging(ctx, cache, staging_size);
+    checkResult(cache.cmd_buf->Begin({}));
+
+    Pal::gpusize offset = 0;
+    for (const auto& array : transfers) {
+        // Listed more than once.
+        if (is_resident(array))
+            continue;
+
+        auto it = cache.entries.find(array.data);
+        if (it != cache.entries.end() && it->second.pending)
+            throw std::invalid_argument("Array prefetched with different versions at once");
+
+        auto& entry = insert(ctx, cache, array);
+        entry.last_used = cache.job + 1;
+        entry.pending = true;
+
+        std::memcpy(cache.staging_data + offset, array.data, array.size);
+        auto region = Pal::MemoryCopyRegion{
+            .srcOffset = offset,
+            .dstOffset = 0,
+            .copySize = array.size,
+        };
+        cache.cmd_buf->CmdCopyMemory(*cache.staging->memory, *entry.buffer.memory, 1, &region);
+
+        offset += align(array.size);
+        ++cache.stats.prefetched;
+        cache.stats.uploaded_bytes += array.size;
+    }
+
+    checkResult(cache.cmd_buf->End());
+    submit_cmd_buffer(cache.dma_queue.ptr, cache.cmd_buf.ptr, cache.fence.ptr);
+    cache.in_flight = true;
+}
+
+BufferView acquire(Context& ctx, UploadCache& cache, HostArray array) {
+    auto it = cache.entries.find(array.data);
+    if (it != cache.entries.end() && it->second.version == array.version) {
+        if (it->second.pending)
+            finish_transfer(ctx, cache);
+        it->second.last_used = std::max(it->second.last_used, cache.job);
+        ++cache.stats.hits;
+        return it->second.buffer;
+    }
+
+    auto& entry = insert(ctx, cache, array);
+    if (array.size > 0)
+        write_buffer(entry.buffer, array.data);
+    ++cache.stats.misses;
+    cache.stats.uploaded_bytes += array.size;
+    return entry.buffer;
+}
@@ -0,0 +1,81 @@
+#ifndef _NIRAH_UPLOAD_CACHE_HPP
+#define _NIRAH_UPLOAD_CACHE_HPP
+
+#include "context.hpp"
+
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <cstdint>
+
+// Device copies of host arrays that jobs read, such as weights or lookup tables, kept resident up to
+// a capacity and evicted least recently used first. An array is identified by its host address and
+// a version, which its owner bumps whenever it changes the contents.
+//
+// Arrays are normally uploaded when a job acquires them, by writing through the host mapping of the
+// device buffer. When the inputs of the next job are known early, prefetch uploads them on the dma
+// queue instead, while the current job runs on the compute queue.
+
+struct HostArray {
+    const void* data;
+    Pal::gpusize size;
+    uint64_t version = 0;
+};
+
+struct UploadCacheStats {
+    // Acquired arrays that were resident or being prefetched.
+    uint64_t hits;
+    // Acquired arrays that had to be uploaded on the spot.
+    uint64_t misses;
+    uint64_t prefetched;
+    uint64_t evictions;
+    Pal::gpusize uploaded_bytes;
+};
+
+struct UploadCache {
+    struct Entry {
+        Buffer buffer;
+        uint64_t version;
+        // The job that last acquired the entry, or the next job for prefetched entries.
+        uint64_t last_used;
+        // Whether the transfer in flight writes the entry.
+        bool pending;
+    };
+
+    Pal::gpusize capacity;
+    Pal::gpusize resident;
+    // The current job, see begin_job.
+    uint64_t job;
+    std::unordered_map<const void*, Entry> entries;
+    UploadCacheStats stats;
+
+    // Prefetches are copied to a staging buffer that grows as needed, and transferred from there
+    // in one submission on the dma queue. At most one transfer is in flight at a time, and its
+    // arrays must have been acquired before the cache is destroyed.
+    Unique<Pal::IQueue> dma_queue;
+    Unique<Pal::ICmdAllocator> cmda;
+    Unique<Pal::ICmdBuffer> cmd_buf;
+    Unique<Pal::IFence> fence;
+    std::optional<Buffer> staging;
+    std::byte* staging_data;
+    bool in_flight;
+};
+
+// Requires a device with a dma engine.
+UploadCache create_upload_cache(Context& ctx, Pal::gpusize capacity);
+
+// Starts a new job. Arrays acquired by the current job, or prefetched for the next one, are never
+// evicted; if they do not fit, the cache exceeds its capacity instead. Submissions that read arrays
+// acquired by earlier jobs must have completed.
+void begin_job(UploadCache& cache);
+
+// Starts uploading the arrays that are not resident on the dma queue, for the next job, and returns
+// without waiting for the transfer. The arrays are copied to staging memory first, so they may be
+// changed as soon as this returns. Waits for an earlier transfer that is still in flight.
+void prefetch(Context& ctx, UploadCache& cache, std::span<const HostArray> arrays);
+
+// Returns the device copy of `array`, uploading it first if it is not resident, or waiting for its
+// transfer if it is being prefetched.
+BufferView acquire(Context& ctx, UploadCache& cache, HostArray array);
+
+#endif
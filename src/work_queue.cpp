@@ -0,0 +1,77 @@
+#include "work_queue.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <cstddef>
+#include <vector>
+
+namespace {
+    // Invocations per compute unit. GCN holds up to 2560 at once, but persistent kernels tend to
+    // use enough registers that fewer fit, and more only add contention on the queue.
+    constexpr uint32_t invocations_per_cu = 1024;
+
+    struct Header {
+        uint32_t head;
+        uint32_t tail;
+        uint32_t pending;
+        uint32_t overflow;
+        uint32_t cancelled;
+    };
+}
+
+WorkQueue create_work_queue(Context& ctx, uint32_t capacity) {
+    if (!std::has_single_bit(capacity))
+        throw std::invalid_argument("Work queue capacity must be a power of two");
+
+    return {
+        .capacity = capacity,
+        .header = create_device_buffer(ctx, sizeof(Header)),
+        .states = create_device_buffer(ctx, Pal::gpusize{capacity} * sizeof(uint32_t)),
+        .tasks = create_device_buffer(ctx, Pal::gpusize{capacity} * sizeof(Task)),
+    };
+}
+
+uint32_t persistent_groups(Context& ctx, uint32_t group_size) {
+    const auto& core = ctx.props.gfxipProperties.shaderCore;
+    return std::max(core.numAvailableCus * invocations_per_cu / group_size, 1u);
+}
+
+void reset_work_queue(Context& ctx, const WorkQueue& queue, std::span<const Task> tasks) {
+    if (tasks.size() > queue.capacity)
+        throw std::invalid_argument("Too many initial tasks for the work queue");
+
+    auto n = static_cast<uint32_t>(tasks.size());
+    auto header = Header{
+        .head = 0,
+        .tail = n,
+        .pending = n,
+        .overflow = 0,
+        .cancelled = 0,
+    };
+
+    // Cells of the initial tasks are full for round 0, the others free for it.
+    fill(ctx, queue.states, 0);
+    barrier(ctx);
+    if (n != 0) {
+        update(ctx, queue.states.view(0, n * sizeof(uint32_t)), std::vector<uint32_t>(n, 1));
+        update(ctx, queue.tasks.view(0, tasks.size_bytes()), {tasks.front().data(), 4 * tasks.size()});
+    }
+    update(ctx, queue.header, std::bit_cast<std::array<uint32_t, 5>>(header));
+    barrier(ctx);
+}
+
+void cancel_work_queue(Context& ctx, const WorkQueue& queue) {
+    const uint32_t cancelled = 1;
+    update(ctx, queue.header.view(offsetof(Header, cancelled), sizeof(uint32_t)), {&cancelled, 1});
+}
+
+WorkQueueStats read_work_queue(const WorkQueue& queue) {
+    Header header;
+    read_buffer(queue.header, &header);
+    return {
+        .pushed = header.tail,
+        .overflow = header.overflow != 0,
+        .cancelled = header.cancelled != 0,
+    };
+}
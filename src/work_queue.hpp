@@ -0,0 +1,63 @@
+#ifndef _NIRAH_WORK_QUEUE_HPP
+#define _NIRAH_WORK_QUEUE_HPP
+
+#include "context.hpp"
+
+#include <array>
+#include <span>
+#include <cstdint>
+
+// A global task queue in device memory, for irregular workloads that generate work as they go.
+// It is a bounded multi-producer multi-consumer ring of 16-byte tasks, after Vyukov: every cell
+// has a state word that holds 2 * round while the cell is free for the round-th pass over the
+// ring, and 2 * round + 1 while it holds that pass's task, so that producers and consumers of a
+// position only need to agree on the cell, not on each other. `pending` counts tasks that were
+// pushed but not finished; the queue is drained once it drops to zero. Setting `cancelled` makes
+// kernels stop as if it was drained, see cancel_work_queue.
+//
+// Kernels use the queue as persistent threads: a fixed number of workgroups (see
+// persistent_groups) loop until the queue drains, taking tickets for positions from `head` and
+// pushing new tasks at `tail`. Invocations never block inside divergent code, they poll their
+// ticket once per iteration of a workgroup-uniform loop, which keeps waves from spinning on
+// each other. uts.comp is the reference kernel; new kernels copy its wq_* functions and main
+// loop, and replace process(). Queue bindings are 1 (header), 2 (states) and 3 (tasks).
+
+using Task = std::array<uint32_t, 4>;
+
+struct WorkQueue {
+    // Power of two. Also bounds how far tickets can run ahead, so it must exceed the number of
+    // persistent invocations.
+    uint32_t capacity;
+    // head, tail, pending, overflow, cancelled.
+    Buffer header;
+    Buffer states;
+    Buffer tasks;
+};
+
+struct WorkQueueStats {
+    // Number of tasks that were pushed in total, including the initial ones and dropped ones.
+    uint32_t pushed;
+    // Set if a push found the queue full; the task was dropped and results are incomplete.
+    bool overflow;
+    // Set if the queue was cancelled; its kernel may have stopped before the queue was drained.
+    bool cancelled;
+};
+
+WorkQueue create_work_queue(Context& ctx, uint32_t capacity);
+
+// Number of workgroups of `group_size` invocations to dispatch for persistent threads: enough to
+// fill every compute unit a few times over.
+uint32_t persistent_groups(Context& ctx, uint32_t group_size = 256);
+
+// Records emptying the queue and pushing `tasks` to it. The tasks are embedded in the command
+// buffer, so there should be few of them; kernels generate the rest.
+void reset_work_queue(Context& ctx, const WorkQueue& queue, std::span<const Task> tasks);
+
+// Records raising the cancelled flag of the queue, on which persistent kernels exit at the next
+// iteration of their main loop, leaving the remaining tasks. The kernel occupies its own queue until
+// then, so `ctx` must submit to another one, such as a context from create_queue_context.
+void cancel_work_queue(Context& ctx, const WorkQueue& queue);
+
+WorkQueueStats read_work_queue(const WorkQueue& queue);
+
+#endif